@@ -0,0 +1,439 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <common.h>
+#include "../lib/bit_stream.h"
+#include "bench.h"
+
+// Kernel microbenchmarks: every kernel runs a few warmup rounds and then `repetitions` timed ones over the same
+// synthetic data, and the results go to stdout as JSON. Times are per unit (a value written, a byte searched...)
+// so they compare across input sizes. On x86 the cycle counts come from rdtsc, which ticks at the nominal
+// frequency rather than the core's current one, so pin the clock when comparing cycle counts across runs.
+//
+// Usage: microbench [-r repetitions] [name filter], e.g. microbench -r 21 bit_stream
+
+#if (defined(__GNUC__) || defined(__TINYC__)) && (defined(__x86_64__) || defined(__i386__))
+#define BENCH_TIMER "rdtsc"
+
+static inline u64 __cycles(void)
+{
+    u32 low = 0, high = 0;
+    __asm__ volatile("lfence\n\trdtsc\n\tlfence" : "=a"(low), "=d"(high)::"memory");
+    return ((u64)high << 32) | low;
+}
+#else
+#define BENCH_TIMER "none"
+
+static inline u64 __cycles(void) { return 0; }
+#endif
+
+#define WARMUP_RUNS 3
+#define DEFAULT_REPETITIONS 11
+#define MAX_REPETITIONS 1001
+
+typedef u64 (*kernel_fn_t)(const void *argument);
+
+typedef struct bench_options_t
+{
+    const char *filter;
+    u32 repetitions;
+    u32 result_count;
+} bench_options_t;
+
+static bench_options_t options = {.filter = NULL, .repetitions = DEFAULT_REPETITIONS, .result_count = 0};
+
+// Keeps every kernel's result alive, so the compiler can't drop the work.
+static volatile u64 sink = 0;
+
+static inline double __nanoseconds(void)
+{
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+
+    return (double)time.tv_sec * 1e9 + (double)time.tv_nsec;
+}
+
+static int __compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Times the kernel and prints one result. params is a JSON object, units how many `unit`s a run handles and bytes
+// how many bytes it goes through, 0 when throughput doesn't mean anything for that kernel.
+static void __measure(const char *name, const char *params, const char *unit, u64 units, u64 bytes, kernel_fn_t kernel, const void *argument)
+{
+    if (options.filter && !strstr(name, options.filter))
+        return;
+
+    static double times[MAX_REPETITIONS], cycles[MAX_REPETITIONS];
+
+    for (u32 i = 0; i < WARMUP_RUNS; i += 1)
+        sink += kernel(argument);
+
+    for (u32 i = 0; i < options.repetitions; i += 1)
+    {
+        double start_time = __nanoseconds();
+        u64 start_cycles = __cycles();
+
+        sink += kernel(argument);
+
+        cycles[i] = (double)(__cycles() - start_cycles) / (double)units;
+        times[i] = (__nanoseconds() - start_time) / (double)units;
+    }
+
+    double mean = 0, variance = 0;
+
+    for (u32 i = 0; i < options.repetitions; i += 1)
+        mean += times[i] / options.repetitions;
+    for (u32 i = 0; i < options.repetitions; i += 1)
+        variance += (times[i] - mean) * (times[i] - mean) / options.repetitions;
+
+    qsort(times, options.repetitions, sizeof(double), __compare_doubles);
+    qsort(cycles, options.repetitions, sizeof(double), __compare_doubles);
+
+    const u32 middle = options.repetitions / 2;
+    const double median = times[middle];
+
+    printf("%s\n    {\"name\": \"%s\", \"params\": %s, \"unit\": \"%s\", \"units\": %" PRIu64 ", ", options.result_count ? "," : "", name, params, unit, units);
+    printf("\"ns_min\": %.4f, \"ns_median\": %.4f, \"ns_mean\": %.4f, \"ns_stddev\": %.4f, ", times[0], median, mean, sqrt(variance));
+    printf("\"cycles_min\": %.3f, \"cycles_median\": %.3f, ", cycles[0], cycles[middle]);
+
+    // Bytes per nanosecond are GB/s.
+    if (bytes > 0)
+        printf("\"gb_per_s\": %.4f}", (double)bytes / (median * (double)units));
+    else
+        printf("\"gb_per_s\": null}");
+
+    fflush(stdout);
+    options.result_count += 1;
+}
+
+// xorshift64, so the data is the same on every run and platform.
+static u64 random_state = 0x9E3779B97F4A7C15ull;
+
+static inline u64 __random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+static void __fill_random(array_t data)
+{
+    for (u64 i = 0; i < data.length; i += 1)
+        data.bytes[i] = (u8)__random();
+}
+
+// A 64-byte pattern over and over, with one byte in 64 changed so matches don't run forever.
+static void __fill_repetitive(array_t data)
+{
+    u8 pattern[64];
+    for (u32 i = 0; i < sizeof(pattern); i += 1)
+        pattern[i] = (u8)__random();
+
+    for (u64 i = 0; i < data.length; i += 1)
+        data.bytes[i] = __random() % 64 == 0 ? (u8)__random() : pattern[i % sizeof(pattern)];
+}
+
+// Words picked with a skew towards the first ones, like real text.
+static void __fill_text(array_t data)
+{
+    static const char *words[] = {"the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with", "be", "by", "on",
+                                  "not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have", "an", "had", "they", "you", "were",
+                                  "compression", "window", "dictionary", "match", "offset", "length", "literal", "stream", "block", "frame",
+                                  "decoder", "encoder", "buffer", "position", "history", "repeat"};
+    const u32 word_count = sizeof(words) / sizeof(words[0]);
+
+    for (u64 i = 0; i < data.length;)
+    {
+        u32 pick = (u32)((__random() % word_count) * (__random() % word_count) / word_count);
+        const char *word = words[pick];
+
+        for (u32 c = 0; word[c] && i < data.length; c += 1)
+            data.bytes[i++] = (u8)word[c];
+
+        if (i < data.length)
+            data.bytes[i++] = __random() % 12 == 0 ? '.' : ' ';
+    }
+}
+
+static array_t __allocate(u64 length)
+{
+    array_t data = {.bytes = (u8 *)malloc(length), .length = length};
+
+    if (data.bytes == NULL)
+    {
+        fprintf(stderr, "Could not allocate %" PRIu64 " bytes\n", length);
+        exit(EXIT_FAILURE);
+    }
+
+    return data;
+}
+
+// Bit stream: the same values written and read back at every width.
+#define BIT_STREAM_VALUES (1 << 20)
+
+typedef struct bit_stream_argument_t
+{
+    const u32 *values;
+    array_t buffer;
+    u8 bits;
+    u8 inlined; // bit_stream_write_bits/read_bits instead of the out-of-line _int versions.
+} bit_stream_argument_t;
+
+static u64 __bit_stream_write(const void *argument)
+{
+    const bit_stream_argument_t *a = (const bit_stream_argument_t *)argument;
+    bit_stream_t stream = bit_stream_init(a->buffer);
+
+    if (a->inlined)
+        for (u32 i = 0; i < BIT_STREAM_VALUES; i += 1)
+            bit_stream_write_bits(&stream, a->values[i], a->bits);
+    else
+        for (u32 i = 0; i < BIT_STREAM_VALUES; i += 1)
+            bit_stream_write_int(&stream, a->values[i], a->bits);
+
+    bit_stream_flush(&stream);
+    return stream.buffer_position;
+}
+
+static u64 __bit_stream_read(const void *argument)
+{
+    const bit_stream_argument_t *a = (const bit_stream_argument_t *)argument;
+    bit_stream_t stream = bit_stream_init(a->buffer);
+    u64 sum = 0;
+
+    for (u32 i = 0; i < BIT_STREAM_VALUES; i += 1)
+    {
+        u32 value = 0;
+
+        if (a->inlined)
+            bit_stream_read_bits(&stream, &value, a->bits);
+        else
+            bit_stream_read_int(&stream, &value, a->bits);
+
+        sum += value;
+    }
+
+    return sum;
+}
+
+static u64 __bit_stream_write_7bit(const void *argument)
+{
+    const bit_stream_argument_t *a = (const bit_stream_argument_t *)argument;
+    bit_stream_t stream = bit_stream_init(a->buffer);
+
+    for (u32 i = 0; i < BIT_STREAM_VALUES; i += 1)
+        bit_stream_write_7bit_int32(&stream, a->values[i]);
+
+    return stream.buffer_position;
+}
+
+static void bench_bit_stream(void)
+{
+    static const u8 widths[] = {1, 4, 8, 13, 24};
+
+    u32 *values = (u32 *)malloc(BIT_STREAM_VALUES * sizeof(u32));
+    array_t buffer = __allocate((u64)BIT_STREAM_VALUES * 5);
+
+    if (values == NULL)
+        exit(EXIT_FAILURE);
+
+    char params[64];
+
+    for (u32 w = 0; w < sizeof(widths); w += 1)
+    {
+        const u8 bits = widths[w];
+
+        for (u32 i = 0; i < BIT_STREAM_VALUES; i += 1)
+            values[i] = (u32)__random() & ((1u << bits) - 1);
+
+        for (u8 inlined = 0; inlined <= 1; inlined += 1)
+        {
+            bit_stream_argument_t argument = {.values = values, .buffer = buffer, .bits = bits, .inlined = inlined};
+            snprintf(params, sizeof(params), "{\"bits\": %u}", bits);
+
+            // Reading needs what writing left in the buffer.
+            __bit_stream_write(&argument);
+
+            __measure(inlined ? "bit_stream_write_bits" : "bit_stream_write_int", params, "value", BIT_STREAM_VALUES, (u64)BIT_STREAM_VALUES * bits / 8, __bit_stream_write, &argument);
+            __measure(inlined ? "bit_stream_read_bits" : "bit_stream_read_int", params, "value", BIT_STREAM_VALUES, (u64)BIT_STREAM_VALUES * bits / 8, __bit_stream_read, &argument);
+        }
+    }
+
+    // Lengths and counts, so mostly small values with a long tail.
+    for (u32 i = 0; i < BIT_STREAM_VALUES; i += 1)
+        values[i] = (u32)(__random() >> (32 + __random() % 32));
+
+    bit_stream_argument_t argument = {.values = values, .buffer = buffer};
+    __measure("bit_stream_write_7bit_int32", "{\"values\": \"mixed magnitudes\"}", "value", BIT_STREAM_VALUES, 0, __bit_stream_write_7bit, &argument);
+
+    free(values);
+    free(buffer.bytes);
+}
+
+// Match finders: every position of a small input, since the brute force LZSS search is slow on purpose.
+#define MATCH_FINDER_LENGTH (16 * 1024)
+
+typedef struct match_finder_argument_t
+{
+    array_t input;
+    u8 bits;
+    u8 rep_offsets;
+} match_finder_argument_t;
+
+static u64 __lzss_match_finder(const void *argument)
+{
+    const match_finder_argument_t *a = (const match_finder_argument_t *)argument;
+    return bench_lzss_longest_match(a->bits, a->rep_offsets, a->input);
+}
+
+static u64 __rolz_match_finder(const void *argument)
+{
+    const match_finder_argument_t *a = (const match_finder_argument_t *)argument;
+    return bench_rolz_longest_match(a->bits, a->input);
+}
+
+static void bench_match_finders(void)
+{
+    static const char *data_names[] = {"random", "repetitive", "text"};
+    static void (*const fills[])(array_t) = {__fill_random, __fill_repetitive, __fill_text};
+
+    array_t input = __allocate(MATCH_FINDER_LENGTH);
+    char params[96];
+
+    for (u32 d = 0; d < 3; d += 1)
+    {
+        fills[d](input);
+
+        for (u8 bits = 10; bits <= 12; bits += 2)
+        {
+            for (u8 rep_offsets = 0; rep_offsets <= 1; rep_offsets += 1)
+            {
+                match_finder_argument_t argument = {.input = input, .bits = bits, .rep_offsets = rep_offsets};
+                snprintf(params, sizeof(params), "{\"data\": \"%s\", \"offset_bits\": %u}", data_names[d], bits);
+
+                __measure(rep_offsets ? "lzss_find_match_rep" : "lzss_get_longest_match", params, "byte", input.length, input.length, __lzss_match_finder, &argument);
+            }
+        }
+
+        match_finder_argument_t argument = {.input = input, .bits = 16};
+        snprintf(params, sizeof(params), "{\"data\": \"%s\", \"history_buffer_bits\": 16}", data_names[d]);
+
+        __measure("rolz_get_longest_match", params, "byte", input.length, input.length, __rolz_match_finder, &argument);
+    }
+
+    free(input.bytes);
+}
+
+// Checksums over a buffer that doesn't fit in L2.
+#define CHECKSUM_LENGTH (4 * 1024 * 1024)
+
+static u64 __jenkins32(const void *argument) { return jenkins32(*(const array_t *)argument); }
+
+static u64 __adler32(const void *argument) { return adler32(*(const array_t *)argument); }
+
+static u64 __hash_bytes(const void *argument) { return hash_bytes(*(const array_t *)argument); }
+
+static void bench_checksums(void)
+{
+    array_t input = __allocate(CHECKSUM_LENGTH);
+    __fill_random(input);
+
+    __measure("jenkins32", "{}", "byte", input.length, input.length, __jenkins32, &input);
+    __measure("adler32", "{}", "byte", input.length, input.length, __adler32, &input);
+    __measure("hash_bytes", "{}", "byte", input.length, input.length, __hash_bytes, &input);
+
+    free(input.bytes);
+}
+
+// Match copies: back to back matches of the same offset and length, copied the way the decoders do. The single
+// stream decoders copy byte by byte, the split stream ones use memcpy when the match doesn't overlap itself.
+#define MATCH_COPY_LENGTH (1024 * 1024)
+#define MATCH_COPY_START 4096
+
+typedef struct match_copy_argument_t
+{
+    array_t output;
+    u32 offset;
+    u32 length;
+    u8 split;
+} match_copy_argument_t;
+
+static u64 __match_copy(const void *argument)
+{
+    const match_copy_argument_t *a = (const match_copy_argument_t *)argument;
+    u8 *bytes = a->output.bytes;
+    const u32 offset = a->offset, length = a->length;
+
+    for (u64 index = MATCH_COPY_START; index + length <= a->output.length; index += length)
+    {
+        if (a->split && offset >= length)
+            memcpy(bytes + index, bytes + index - offset, length);
+        else
+            for (u32 i = 0; i < length; i += 1)
+                bytes[index + i] = bytes[index - offset + i];
+    }
+
+    return bytes[a->output.length - 1];
+}
+
+static void bench_match_copy(void)
+{
+    static const u32 offsets[] = {1, 2, 4, 8, 16, 64, 1024};
+    static const u32 lengths[] = {4, 16, 63};
+
+    array_t output = __allocate(MATCH_COPY_LENGTH);
+    __fill_random(output);
+
+    char params[64];
+
+    for (u32 o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o += 1)
+    {
+        for (u32 l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l += 1)
+        {
+            for (u8 split = 0; split <= 1; split += 1)
+            {
+                match_copy_argument_t argument = {.output = output, .offset = offsets[o], .length = lengths[l], .split = split};
+                const u64 copied = (MATCH_COPY_LENGTH - MATCH_COPY_START) / lengths[l] * lengths[l];
+
+                snprintf(params, sizeof(params), "{\"offset\": %u, \"length\": %u}", offsets[o], lengths[l]);
+                __measure(split ? "match_copy_split" : "match_copy_bytes", params, "byte", copied, copied, __match_copy, &argument);
+            }
+        }
+    }
+
+    free(output.bytes);
+}
+
+int main(int argc, const char **argv)
+{
+    for (int i = 1; i < argc; i += 1)
+    {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            int repetitions = atoi(argv[++i]);
+            options.repetitions = repetitions < 1 ? 1 : repetitions > MAX_REPETITIONS ? MAX_REPETITIONS : (u32)repetitions;
+        }
+        else
+            options.filter = argv[i];
+    }
+
+    printf("{\n  \"version\": \"%s\",\n  \"timer\": \"%s\",\n  \"warmup\": %u,\n  \"repetitions\": %u,\n  \"results\": [", compression_version_string(), BENCH_TIMER,
+           WARMUP_RUNS, options.repetitions);
+
+    bench_bit_stream();
+    bench_checksums();
+    bench_match_copy();
+    bench_match_finders();
+
+    printf("\n  ]\n}\n");
+
+    return EXIT_SUCCESS;
+}
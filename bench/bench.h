@@ -0,0 +1,12 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <common.h>
+
+// The match finders are static to their codecs, so these live in translation units that include the codec's
+// source and run the finder over every position of the input. They return a checksum of the matches found, so
+// the calls can't be optimized away.
+u64 bench_lzss_longest_match(u8 offset_bits, u8 rep_offsets, array_t input);
+u64 bench_rolz_longest_match(u8 history_buffer_bits, array_t input);
+
+#endif
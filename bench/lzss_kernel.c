@@ -0,0 +1,25 @@
+#include "../lib/lzss.c"
+#include "bench.h"
+
+// With rep offsets the recent offsets get updated like the encoder does, so __find_match sees realistic ones.
+u64 bench_lzss_longest_match(u8 offset_bits, u8 rep_offsets, array_t input)
+{
+    lzss_config_t config = lzss_config_init(offset_bits, 6, 2);
+    if (rep_offsets)
+        config.flags |= LZSS_FLAG_REP_OFFSETS;
+
+    rep_offsets_t reps = __rep_offsets_init();
+    u64 checksum = 0, run_end = 0;
+
+    for (u64 index = 0; index < input.length; index += 1)
+    {
+        match_t match = __find_match(config, input, index, &reps, &run_end, NULL);
+
+        if (rep_offsets && match.length >= config.minimum_length)
+            __rep_offsets_update(&reps, match.offset, match.rep);
+
+        checksum += match.offset * 31 + match.length;
+    }
+
+    return checksum;
+}
@@ -0,0 +1,29 @@
+#include "../lib/rolz.c"
+#include "bench.h"
+
+// Every byte goes through the dictionary before its match is looked up, the same order the encoder uses.
+u64 bench_rolz_longest_match(u8 history_buffer_bits, array_t input)
+{
+    const rolz_config_t config = rolz_config_init(8, 4, 2, history_buffer_bits);
+    const u32 buffer_mask = (1 << config.history_buffer_bits) - 1;
+
+    u64 last_position_lookup[256] = {0};
+    u64 *dictionary = (u64 *)malloc((buffer_mask + 1) * sizeof(u64));
+    if (dictionary == NULL)
+        return 0;
+
+    u64 checksum = 0, run_end = 0;
+
+    for (u64 index = 0; index < input.length; index += 1)
+    {
+        u8 byte = input.bytes[index];
+        dictionary[index & buffer_mask] = last_position_lookup[byte];
+        last_position_lookup[byte] = index;
+
+        match_t match = __get_longest_match(config, input, index, dictionary, buffer_mask, &run_end);
+        checksum += match.steps * 31 + match.length;
+    }
+
+    free(dictionary);
+    return checksum;
+}
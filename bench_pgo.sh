@@ -0,0 +1,48 @@
+#!/bin/sh
+# Builds plain `release` and the PGO build, runs both over the corpus and reports the speedup of the PGO build.
+# RUNS, MARCH and FILES can be overridden from the environment.
+set -e
+
+RUNS=${RUNS:-5}
+MARCH=${MARCH:-x86-64}
+FILES=${FILES:-"files/KingsBounty.md files/package-lock.json"}
+
+mkdir -p out
+
+make release >/dev/null 2>&1 && cp compression compression-release
+make pgo MARCH=$MARCH >/dev/null 2>&1 && cp compression compression-pgo
+
+# Average wall time of a command over RUNS runs, in microseconds.
+time_us() {
+    start=$(date +%s%N)
+    for i in $(seq $RUNS); do "$@" >/dev/null; done
+    end=$(date +%s%N)
+    echo $(((end - start) / 1000 / RUNS))
+}
+
+total_release=0
+total_pgo=0
+
+printf "%-28s %-5s %-7s %12s %12s %8s\n" "file" "mode" "op" "release(us)" "pgo(us)" "speedup"
+
+for file in $FILES; do
+    for mode in lzss rolz lzb; do
+        name=$(basename "$file")
+
+        release=$(time_us ./compression-release e $mode "$file" out/$name.$mode)
+        pgo=$(time_us ./compression-pgo e $mode "$file" out/$name.$mode)
+        printf "%-28s %-5s %-7s %12d %12d %7.2fx\n" "$name" $mode encode $release $pgo $(echo "$release $pgo" | awk '{print $1 / $2}')
+        total_release=$((total_release + release))
+        total_pgo=$((total_pgo + pgo))
+
+        release=$(time_us ./compression-release d $mode out/$name.$mode out/$name.$mode.out)
+        pgo=$(time_us ./compression-pgo d $mode out/$name.$mode out/$name.$mode.out)
+        printf "%-28s %-5s %-7s %12d %12d %7.2fx\n" "$name" $mode decode $release $pgo $(echo "$release $pgo" | awk '{print $1 / $2}')
+        total_release=$((total_release + release))
+        total_pgo=$((total_pgo + pgo))
+
+        cmp -s "$file" out/$name.$mode.out || { echo "Round trip failed for $file with $mode"; exit 1; }
+    done
+done
+
+printf "%-42s %12d %12d %7.2fx\n" "total (MARCH=$MARCH)" $total_release $total_pgo $(echo "$total_release $total_pgo" | awk '{print $1 / $2}')
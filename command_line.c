@@ -5,13 +5,50 @@
 #include <stdlib.h>
 #include <string.h>
 
+// ftell/fseek use a 32-bit long on Windows, so we need the 64-bit variants for files over 2GB.
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+// Everything but the data goes to stderr, so it never mixes with output written to stdout.
 static void print_usage(const char *exe_name)
 {
-    printf("Usage:%s <e|d> <mode> <input> <output>\n", exe_name);
-    printf(" -> e for encoding, d for decoding.\n");
-    printf(" -> mode can be either of: LZSS, ROLZ or 1 or 2 respectively.\n");
-    printf(" -> input is the path of the file to process.\n");
-    printf(" -> output is the path of the resulting file.\n");
+    fprintf(stderr, "Usage:%s <e|d> <mode> <input> <output> [options]\n", exe_name);
+    fprintf(stderr, "      %s <e|d> <mode> <inputs...> [options]\n", exe_name);
+    fprintf(stderr, " -> e for encoding, d for decoding.\n");
+    fprintf(stderr, " -> mode can be either of: LZSS, ROLZ, LZB or 1, 2, 3 respectively. Decoding reads it from the file.\n");
+    fprintf(stderr, "    LZB is the fastest to decode, ROLZ compresses the most.\n");
+    fprintf(stderr, " -> input is the path of the file to process, - for stdin.\n");
+    fprintf(stderr, " -> output is the path of the resulting file, - for stdout.\n");
+    fprintf(stderr, " -> With one path or more than two, or with -m or -r, every path is an input and they're processed\n");
+    fprintf(stderr, "    at the same time. Outputs get " CLI_EXTENSION " added when encoding and removed when decoding.\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, " -> -l, --long: find repeats far beyond the codec window with a long distance matching pre-pass.\n");
+    fprintf(stderr, " -> -d, --dedup: replace repeated content-defined chunks with references before compressing.\n");
+    fprintf(stderr, "    Both are recorded in the compressed file and undone when decoding, which fails if -l or -d is given\n");
+    fprintf(stderr, "    but wasn't used. Both hold the whole file in memory, encoding and decoding: their references reach\n");
+    fprintf(stderr, "    anywhere back in it, so streaming them block by block would keep everything seen so far anyway.\n");
+    fprintf(stderr, "    That's why they don't go through the pipeline, and their files decode from a path, not stdin.\n");
+    fprintf(stderr, " -> -f, --filter <filter>: transform each block before compressing it. One of:\n");
+    fprintf(stderr, "    none, delta (bytes), delta16 (16-bit words), x86 (executables) or text (JSON and text).\n");
+    fprintf(stderr, " -> -b, --block-bits <bits>: blocks of 2^bits bytes, from 10 to 30 (22 by default). Blocks are\n");
+    fprintf(stderr, "    compressed independently, smaller ones give the pipeline more to work with in parallel.\n");
+    fprintf(stderr, " -> -t, --match-threads <count>: search for LZSS and ROLZ matches on count more threads, from 1\n");
+    fprintf(stderr, "    to 16, ahead of the encoder. Puts more CPUs on a single block, the output stays the same.\n");
+    fprintf(stderr, " -> -p, --pipeline: read, compress and write blocks at the same time, on every CPU, instead of one\n");
+    fprintf(stderr, "    step after the other. Can't be combined with -l or -d, which need the whole file at once.\n");
+    fprintf(stderr, "    Always on when reading stdin or writing stdout without -l or -d.\n");
+    fprintf(stderr, " -> -m, --multiple: every path is an input, even when there are two.\n");
+    fprintf(stderr, " -> -r, --recursive: every path is an input, directories included with all the files below them.\n");
 }
 
 static inline command_line_error_t parse_operation(const char *string, command_line_options_t *options)
@@ -32,6 +69,95 @@ static inline command_line_error_t parse_mode(const char *string, command_line_o
         options->mode = MODE_LZSS;
     else if (strcasecmp(string, "ROLZ") == 0 || strcasecmp(string, "2") == 0)
         options->mode = MODE_ROLZ;
+    else if (strcasecmp(string, "LZB") == 0 || strcasecmp(string, "3") == 0)
+        options->mode = MODE_LZB;
+    else
+        return CLI_BAD_FORMAT;
+
+    return CLI_NO_ERROR;
+}
+
+static inline command_line_error_t parse_filter(const char *string, command_line_options_t *options)
+{
+    if (string == NULL)
+        return CLI_NOT_ENOUGH_ARGUMENTS;
+
+    if (strcasecmp(string, "none") == 0)
+        options->filter = FILTER_NONE;
+    else if (strcasecmp(string, "delta") == 0)
+        options->filter = FILTER_DELTA_BYTE;
+    else if (strcasecmp(string, "delta16") == 0)
+        options->filter = FILTER_DELTA_WORD;
+    else if (strcasecmp(string, "x86") == 0)
+        options->filter = FILTER_X86;
+    else if (strcasecmp(string, "text") == 0)
+        options->filter = FILTER_TEXT;
+    else
+        return CLI_BAD_FORMAT;
+
+    return CLI_NO_ERROR;
+}
+
+static inline command_line_error_t parse_block_bits(const char *string, command_line_options_t *options)
+{
+    if (string == NULL)
+        return CLI_NOT_ENOUGH_ARGUMENTS;
+
+    char *end = NULL;
+    long bits = strtol(string, &end, 10);
+
+    if (*string == '\0' || *end != '\0' || bits < 10 || bits > 30)
+        return CLI_BAD_FORMAT;
+
+    options->block_bits = (u8)bits;
+    return CLI_NO_ERROR;
+}
+
+static inline command_line_error_t parse_match_threads(const char *string, command_line_options_t *options)
+{
+    if (string == NULL)
+        return CLI_NOT_ENOUGH_ARGUMENTS;
+
+    char *end = NULL;
+    long count = strtol(string, &end, 10);
+
+    if (*string == '\0' || *end != '\0' || count < 1 || count > 16)
+        return CLI_BAD_FORMAT;
+
+    options->match_threads = (u8)count;
+    return CLI_NO_ERROR;
+}
+
+// Parses the option at argv[*index], moving the index past any value the option takes.
+static inline command_line_error_t parse_option(int argc, const char **argv, int *index, command_line_options_t *options)
+{
+    const char *string = argv[*index];
+
+    if (strcmp(string, "-l") == 0 || strcmp(string, "--long") == 0)
+        options->long_range = 1;
+    else if (strcmp(string, "-d") == 0 || strcmp(string, "--dedup") == 0)
+        options->dedup = 1;
+    else if (strcmp(string, "-p") == 0 || strcmp(string, "--pipeline") == 0)
+        options->pipeline = 1;
+    else if (strcmp(string, "-m") == 0 || strcmp(string, "--multiple") == 0)
+        options->multiple = 1;
+    else if (strcmp(string, "-r") == 0 || strcmp(string, "--recursive") == 0)
+        options->recursive = options->multiple = 1;
+    else if (strcmp(string, "-b") == 0 || strcmp(string, "--block-bits") == 0)
+    {
+        *index += 1;
+        return parse_block_bits(*index < argc ? argv[*index] : NULL, options);
+    }
+    else if (strcmp(string, "-t") == 0 || strcmp(string, "--match-threads") == 0)
+    {
+        *index += 1;
+        return parse_match_threads(*index < argc ? argv[*index] : NULL, options);
+    }
+    else if (strcmp(string, "-f") == 0 || strcmp(string, "--filter") == 0)
+    {
+        *index += 1;
+        return parse_filter(*index < argc ? argv[*index] : NULL, options);
+    }
     else
         return CLI_BAD_FORMAT;
 
@@ -42,7 +168,7 @@ command_line_error_t parse_command_line_arguments(int argc, const char **argv, c
 {
     command_line_error_t error = CLI_NO_ERROR;
 
-    if (argc != 5)
+    if (argc < 4)
     {
         print_usage(argv[0]);
         return CLI_NOT_ENOUGH_ARGUMENTS;
@@ -62,23 +188,144 @@ command_line_error_t parse_command_line_arguments(int argc, const char **argv, c
 
     // TODO: Validate file exists? Ask to rewrite output file? Accept verbosity/silent options?
 
-    options->input_file = argv[3];
-    options->output_file = argv[4];
+    // Paths and options can come in any order, a lone - is a path.
+    if (!(options->paths = (const char **)malloc(argc * sizeof(const char *))))
+        return CLI_COULD_NOT_ALLOCATE;
+
+    for (int i = 3; i < argc; i += 1)
+    {
+        if (argv[i][0] != '-' || is_standard_stream(argv[i]))
+        {
+            options->paths[options->path_count++] = argv[i];
+            continue;
+        }
+
+        if ((error = parse_option(argc, argv, &i, options)))
+        {
+            print_usage(argv[0]);
+            return error;
+        }
+    }
+
+    options->multiple |= options->path_count != 2;
+
+    if (options->path_count == 0 || (options->pipeline && (options->long_range || options->dedup)))
+    {
+        print_usage(argv[0]);
+        return options->path_count == 0 ? CLI_NOT_ENOUGH_ARGUMENTS : CLI_BAD_FORMAT;
+    }
+
+    if (!options->multiple)
+    {
+        options->input_file = options->paths[0];
+        options->output_file = options->paths[1];
+        return error;
+    }
+
+    // Outputs are named after the inputs, which stdin doesn't have.
+    for (u32 i = 0; i < options->path_count; i += 1)
+    {
+        if (is_standard_stream(options->paths[i]))
+        {
+            print_usage(argv[0]);
+            return CLI_BAD_FORMAT;
+        }
+    }
 
     return error;
 }
 
+FILE *open_file(const char *file_name, const char *mode)
+{
+    if (!is_standard_stream(file_name))
+        return fopen(file_name, mode);
+
+    FILE *file = mode[0] == 'r' ? stdin : stdout;
+
+#ifdef _WIN32
+    _setmode(_fileno(file), _O_BINARY);
+#endif
+
+    return file;
+}
+
+void close_file(FILE *file)
+{
+    if (file == stdin || file == stdout)
+        fflush(file);
+    else
+        fclose(file);
+}
+
+u64 get_file_length(FILE *file)
+{
+    fseek64(file, 0, SEEK_END);  // Seek to the end of the file
+    u64 length = ftell64(file);  // Get how many bytes the file contains
+    fseek64(file, 0, SEEK_SET);  // Rewind the file pointer to 0
+
+    return length;
+}
+
+// stdin can't tell its length up front, so we read it in chunks, doubling the buffer as needed.
+static command_line_error_t __read_stream(FILE *file, array_t *buffer)
+{
+    u64 capacity = 1 << 20;
+    buffer->length = 0;
+
+    if (!(buffer->bytes = (u8 *)malloc(capacity)))
+        return CLI_COULD_NOT_ALLOCATE;
+
+    while (1)
+    {
+        buffer->length += fread(buffer->bytes + buffer->length, sizeof(u8), capacity - buffer->length, file);
+
+        if (buffer->length < capacity)
+            break;
+
+        u8 *bytes = (u8 *)realloc(buffer->bytes, capacity * 2);
+        if (bytes == NULL)
+        {
+            free(buffer->bytes);
+            buffer->bytes = NULL;
+            buffer->length = 0;
+            return CLI_COULD_NOT_ALLOCATE;
+        }
+
+        buffer->bytes = bytes;
+        capacity *= 2;
+    }
+
+    if (ferror(file))
+    {
+        free(buffer->bytes);
+        buffer->bytes = NULL;
+        buffer->length = 0;
+        return CLI_COULD_NOT_READ_FILE;
+    }
+
+    return CLI_NO_ERROR;
+}
+
 command_line_error_t read_file(const char *file_name, array_t *buffer)
 {
-    FILE *file = fopen(file_name, "rb");
+    FILE *file = open_file(file_name, "rb");
     if (file == NULL)
         return CLI_FILE_NOT_FOUND;
 
-    fseek(file, 0, SEEK_END);     // Seek to the end of the file
-    buffer->length = ftell(file); // Get how many bytes the file contains
-    fseek(file, 0, SEEK_SET);     // Rewind the file pointer to 0
+    if (file == stdin)
+        return __read_stream(file, buffer);
+
+    buffer->length = get_file_length(file);
+
+    // On 32-bit targets we can't hold more than SIZE_MAX bytes in memory.
+    if ((u64)(size_t)buffer->length != buffer->length)
+    {
+        fclose(file);
+        return CLI_COULD_NOT_ALLOCATE;
+    }
 
-    buffer->bytes = (u8 *)malloc(buffer->length);
+    // One byte at least, malloc(0) may give NULL and empty files are fine.
+    buffer->bytes = (u8 *)malloc(buffer->length > 0 ? buffer->length : 1);
 
     if (buffer->bytes == NULL)
     {
@@ -86,7 +333,7 @@ command_line_error_t read_file(const char *file_name, array_t *buffer)
         return CLI_COULD_NOT_ALLOCATE;
     }
 
-    u32 read_value = fread(buffer->bytes, sizeof(u8), buffer->length, file);
+    u64 read_value = fread(buffer->bytes, sizeof(u8), buffer->length, file);
 
     if (read_value != buffer->length)
     {
@@ -103,18 +350,201 @@ command_line_error_t read_file(const char *file_name, array_t *buffer)
 
 command_line_error_t write_file(const char *file_name, array_t buffer)
 {
-    FILE *file = fopen(file_name, "wb+");
+    FILE *file = open_file(file_name, "wb+");
 
     if (file == NULL)
         return CLI_COULD_NOT_OPEN_FILE;
 
-    u32 written_bytes = fwrite(buffer.bytes, sizeof(u8), buffer.length, file);
+    u64 written_bytes = fwrite(buffer.bytes, sizeof(u8), buffer.length, file);
 
-    fflush(file);
-    fclose(file);
+    u8 failed = fflush(file) != 0;
+    close_file(file);
 
-    if (written_bytes != buffer.length)
+    if (written_bytes != buffer.length || failed)
         return CLI_COULD_NOT_WRITE_FILE;
 
     return CLI_NO_ERROR;
 }
+
+static command_line_error_t __add_file(file_list_t *list, const char *name)
+{
+    if (list->count == list->capacity)
+    {
+        u32 capacity = list->capacity ? list->capacity * 2 : 16;
+        char **names = (char **)realloc(list->names, capacity * sizeof(char *));
+
+        if (names == NULL)
+            return CLI_COULD_NOT_ALLOCATE;
+
+        list->names = names;
+        list->capacity = capacity;
+    }
+
+    if (!(list->names[list->count] = (char *)malloc(strlen(name) + 1)))
+        return CLI_COULD_NOT_ALLOCATE;
+
+    strcpy(list->names[list->count++], name);
+    return CLI_NO_ERROR;
+}
+
+static char *__join_path(const char *directory, const char *name)
+{
+    size_t length = strlen(directory);
+    char *path = (char *)malloc(length + strlen(name) + 2);
+
+    if (path != NULL)
+        sprintf(path, "%s%s%s", directory, length && (directory[length - 1] == '/' || directory[length - 1] == '\\') ? "" : "/", name);
+
+    return path;
+}
+
+// Paths given on the command line have to be there, anything below them that can't be read is only skipped.
+static command_line_error_t __skip_path(const char *path, u8 given, command_line_error_t error)
+{
+    if (given)
+        return error;
+
+    fprintf(stderr, "Skipping \"%s\", it can't be read.\n", path);
+    return CLI_NO_ERROR;
+}
+
+#ifdef _WIN32
+static command_line_error_t __list_path(const char *path, u8 recursive, u8 given, file_list_t *list)
+{
+    DWORD attributes = GetFileAttributesA(path);
+
+    if (attributes == INVALID_FILE_ATTRIBUTES)
+        return __skip_path(path, given, CLI_FILE_NOT_FOUND);
+
+    if (!(attributes & FILE_ATTRIBUTE_DIRECTORY))
+        return __add_file(list, path);
+
+    // Junctions and links to directories found while recursing aren't followed, they could lead back up the tree.
+    if (!recursive || (!given && (attributes & FILE_ATTRIBUTE_REPARSE_POINT)))
+        return CLI_NO_ERROR;
+
+    command_line_error_t error = CLI_NO_ERROR;
+
+    char *pattern = __join_path(path, "*");
+    if (pattern == NULL)
+        return CLI_COULD_NOT_ALLOCATE;
+
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(pattern, &entry);
+    free(pattern);
+
+    if (find == INVALID_HANDLE_VALUE)
+        return __skip_path(path, given, CLI_COULD_NOT_OPEN_FILE);
+
+    do
+    {
+        if (strcmp(entry.cFileName, ".") == 0 || strcmp(entry.cFileName, "..") == 0)
+            continue;
+
+        char *child = __join_path(path, entry.cFileName);
+        error = child ? __list_path(child, recursive, 0, list) : CLI_COULD_NOT_ALLOCATE;
+        free(child);
+    } while (!error && FindNextFileA(find, &entry));
+
+    FindClose(find);
+    return error;
+}
+#else
+static command_line_error_t __list_path(const char *path, u8 recursive, u8 given, file_list_t *list)
+{
+    struct stat info;
+
+    // Links given on the command line are followed. The ones found while recursing only are when they lead to a
+    // file, a link to a directory could lead back up the tree. A dangling link fails the stat.
+    u8 link = !given && lstat(path, &info) == 0 && S_ISLNK(info.st_mode);
+
+    if (stat(path, &info) != 0)
+        return __skip_path(path, given, CLI_FILE_NOT_FOUND);
+
+    // Only regular files are compressed, devices, sockets and the like are skipped.
+    if (S_ISREG(info.st_mode))
+        return __add_file(list, path);
+
+    if (!S_ISDIR(info.st_mode) || !recursive || link)
+        return CLI_NO_ERROR;
+
+    command_line_error_t error = CLI_NO_ERROR;
+
+    DIR *directory = opendir(path);
+    if (directory == NULL)
+        return __skip_path(path, given, CLI_COULD_NOT_OPEN_FILE);
+
+    struct dirent *entry;
+    while (!error && (entry = readdir(directory)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        char *child = __join_path(path, entry->d_name);
+        error = child ? __list_path(child, recursive, 0, list) : CLI_COULD_NOT_ALLOCATE;
+        free(child);
+    }
+
+    closedir(directory);
+    return error;
+}
+#endif
+
+command_line_error_t list_files(const char **paths, u32 path_count, u8 recursive, file_list_t *list)
+{
+    command_line_error_t error = CLI_NO_ERROR;
+
+    for (u32 i = 0; i < path_count && !error; i += 1)
+        error = __list_path(paths[i], recursive, 1, list);
+
+    return error;
+}
+
+static u8 __has_extension(const char *name)
+{
+    size_t length = strlen(name), extension_length = strlen(CLI_EXTENSION);
+    return length > extension_length && strcmp(name + length - extension_length, CLI_EXTENSION) == 0;
+}
+
+void select_files(const command_line_options_t *options, file_list_t *list)
+{
+    u32 kept = 0;
+
+    for (u32 i = 0; i < list->count; i += 1)
+    {
+        if (!options->recursive || __has_extension(list->names[i]) == (options->operation == OP_DECODE))
+            list->names[kept++] = list->names[i];
+        else
+            free(list->names[i]);
+    }
+
+    list->count = kept;
+}
+
+char *get_output_name(operation_t operation, const char *input_name)
+{
+    size_t length = strlen(input_name), extension_length = strlen(CLI_EXTENSION);
+    char *name = (char *)malloc(length + extension_length + 5);
+
+    if (name == NULL)
+        return NULL;
+
+    if (operation == OP_DECODE && __has_extension(input_name))
+    {
+        memcpy(name, input_name, length - extension_length);
+        name[length - extension_length] = '\0';
+    }
+    else
+        sprintf(name, "%s%s", input_name, operation == OP_ENCODE ? CLI_EXTENSION : ".out");
+
+    return name;
+}
+
+void file_list_free(file_list_t *list)
+{
+    for (u32 i = 0; i < list->count; i += 1)
+        free(list->names[i]);
+
+    free(list->names);
+    *list = (file_list_t){0};
+}
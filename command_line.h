@@ -1,11 +1,12 @@
 #ifndef __COMMAND_LINE_H__
 #define __COMMAND_LINE_H__
 
-typedef enum mode_t
+typedef enum cli_mode_t
 {
     MODE_LZSS,
-    MODE_ROLZ
-} mode_t;
+    MODE_ROLZ,
+    MODE_LZB
+} cli_mode_t;
 
 typedef enum operation_t
 {
@@ -22,22 +23,89 @@ typedef enum command_line_error_t
     CLI_COULD_NOT_OPEN_FILE,
     CLI_COULD_NOT_ALLOCATE,
     CLI_COULD_NOT_READ_FILE,
-    CLI_COULD_NOT_WRITE_FILE
+    CLI_COULD_NOT_WRITE_FILE,
+    CLI_PRE_PASS_MISMATCH, // -l or -d given when decoding a file that wasn't compressed with it.
+    CLI_PRE_PASS_STREAM    // A file compressed with -l or -d read as a stream, which can't undo them.
 } command_line_error_t;
 
+#include <common.h>
+#include <filter.h>
+#include <frame.h>
+#include <stdio.h>
+
+// File name for stdin as input and stdout as output.
+#define CLI_STANDARD_STREAM "-"
+
+// Added to the inputs' names when encoding several files, and removed when decoding them.
+#define CLI_EXTENSION ".cmp"
+
 typedef struct command_line_options_t
 {
-    mode_t mode;
+    cli_mode_t mode;
     operation_t operation;
+
+    // With one input and one output, they're here. Otherwise every path is an input and outputs are named after them.
     const char *input_file;
     const char *output_file;
-} command_line_options_t;
+    const char **paths;
+    u32 path_count;
+    u8 multiple;
+    u8 recursive;
 
-#include <common.h>
+    u8 long_range;
+    u8 dedup;
+    u8 pipeline;
+    u8 block_bits;    // 0 for the default.
+    u8 match_threads; // Extra threads searching for matches ahead of the LZSS and ROLZ encoders.
+    filter_t filter;
+} command_line_options_t;
 
 command_line_error_t parse_command_line_arguments(int argc, const char **argv, command_line_options_t *options);
 
+static inline codec_t get_mode_codec(cli_mode_t mode)
+{
+    switch (mode)
+    {
+    case MODE_LZSS:
+        return CODEC_LZSS;
+    case MODE_LZB:
+        return CODEC_LZB;
+    default:
+        return CODEC_ROLZ;
+    }
+}
+
+static inline u8 is_standard_stream(const char *file_name) { return file_name[0] == '-' && file_name[1] == '\0'; }
+
+// Like fopen, with CLI_STANDARD_STREAM meaning stdin or stdout, switched to binary mode.
+FILE *open_file(const char *file_name, const char *mode);
+void close_file(FILE *file);
+
+// Leaves the file position at the start.
+u64 get_file_length(FILE *file);
+
+// Both take CLI_STANDARD_STREAM too. Reading stdin grows the buffer until it ends.
 command_line_error_t read_file(const char *file_name, array_t *buffer);
 command_line_error_t write_file(const char *file_name, array_t buffer);
 
+typedef struct file_list_t
+{
+    char **names;
+    u32 count;
+    u32 capacity;
+} file_list_t;
+
+// Adds every path that's a file, and with recursive the files in every directory below the ones given. Every path
+// given has to exist, entries below them that can't be read are skipped with a warning, and so are links to
+// directories, so recursing always ends.
+command_line_error_t list_files(const char **paths, u32 path_count, u8 recursive, file_list_t *list);
+void file_list_free(file_list_t *list);
+
+// Recursing into directories only keeps the files this operation produces or consumes, so running it twice doesn't
+// compress the compressed files again. Files given one by one are all kept.
+void select_files(const command_line_options_t *options, file_list_t *list);
+
+// Encoding adds the extension, decoding removes it, or adds .out when it isn't there. The caller frees the name.
+char *get_output_name(operation_t operation, const char *input_name);
+
 #endif
@@ -0,0 +1,59 @@
+#include <stdlib.h>
+
+#include <frame.h>
+
+#include "fuzz.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+// Any input must decode or fail cleanly. This is what the CLI and the pipeline feed files to, so the header picks
+// the codec, its parameters and flags, and the input may hold several frames back to back. Bit 0 of the selector
+// goes through the block level calls instead, for the first frame. Frames written by the CLI make good seeds.
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < 1)
+        return 0;
+
+    array_t input = {.bytes = (u8 *)data + 1, .length = size - 1};
+
+    u64 original_length = 0;
+    if (frame_get_original_length(input, &original_length) || original_length == 0 || original_length > FUZZ_MAX_OUTPUT)
+        return 0;
+
+    array_t output = {.bytes = (u8 *)malloc(original_length), .length = original_length};
+    if (output.bytes == NULL)
+        return 0;
+
+    if (data[0] & 0x01)
+    {
+        frame_config_t config;
+        u64 frame_length = 0, position = 0;
+
+        if (frame_read_header(input, &config, &frame_length, &position) == ERROR_ALL_GOOD)
+        {
+            // Every block is its big endian compressed length and its payload.
+            for (u64 index = 0; index < frame_length && input.length - position >= 4; index += config.block_length)
+            {
+                const u8 *length_bytes = input.bytes + position;
+                u64 payload_length = ((u64)length_bytes[0] << 24) | ((u64)length_bytes[1] << 16) | ((u64)length_bytes[2] << 8) | length_bytes[3];
+
+                position += 4;
+                if (payload_length > input.length - position)
+                    break;
+
+                array_t payload = {.bytes = input.bytes + position, .length = payload_length};
+                array_t block = {.bytes = output.bytes + index, .length = MIN(config.block_length, frame_length - index)};
+
+                if (frame_decode_block(config, payload, &block))
+                    break;
+
+                position += payload_length;
+            }
+        }
+    }
+    else
+        frame_decode(input, &output);
+
+    free(output.bytes);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#include <stdlib.h>
+
+#include <lzb.h>
+
+#include "fuzz.h"
+
+// Any input must decode or fail cleanly. LZB has no configuration to pick, the selector byte is only skipped so the
+// corpus is shared with the other targets.
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < 1)
+        return 0;
+
+    array_t input = {.bytes = (u8 *)data + 1, .length = size - 1};
+
+    u64 original_length = 0;
+    if (lzb_get_original_length(input, &original_length) || original_length == 0 || original_length > FUZZ_MAX_OUTPUT)
+        return 0;
+
+    array_t output = {.bytes = (u8 *)malloc(original_length), .length = original_length};
+    if (output.bytes == NULL)
+        return 0;
+
+    lzb_decode(input, &output);
+
+    free(output.bytes);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+
+// Any input must decode or fail cleanly. Bit 6 of the selector decodes in place instead, for the layouts that can.
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < 1)
+        return 0;
+
+    const lzss_config_t config = fuzz_lzss_config(data[0]);
+    array_t input = {.bytes = (u8 *)data + 1, .length = size - 1};
+
+    u64 original_length = 0;
+    if (lzss_get_original_length(input, &original_length) || original_length == 0 || original_length > FUZZ_MAX_OUTPUT)
+        return 0;
+
+    if (data[0] & 0x40)
+    {
+        u64 buffer_length = original_length + lzss_get_in_place_margin_bound(original_length);
+        if (buffer_length < input.length)
+            buffer_length = input.length;
+
+        array_t buffer = {.bytes = (u8 *)malloc(buffer_length), .length = buffer_length};
+        if (buffer.bytes == NULL)
+            return 0;
+
+        memcpy(buffer.bytes + buffer.length - input.length, input.bytes, input.length);
+        lzss_decode_in_place(config, buffer, input.length);
+
+        free(buffer.bytes);
+        return 0;
+    }
+
+    array_t output = {.bytes = (u8 *)malloc(original_length), .length = original_length};
+    if (output.bytes == NULL)
+        return 0;
+
+    lzss_decode(config, input, &output);
+
+    free(output.bytes);
+    return 0;
+}
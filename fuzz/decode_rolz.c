@@ -0,0 +1,60 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+
+// Any input must decode or fail cleanly. Bit 6 of the selector decodes in place instead, for the layouts that can.
+// Bit 7 goes through a context, whose dictionary is reused without clearing.
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < 1)
+        return 0;
+
+    const rolz_config_t config = fuzz_rolz_config(data[0]);
+    array_t input = {.bytes = (u8 *)data + 1, .length = size - 1};
+
+    u64 original_length = 0;
+    if (rolz_get_original_length(input, &original_length) || original_length == 0 || original_length > FUZZ_MAX_OUTPUT)
+        return 0;
+
+    if (data[0] & 0x40)
+    {
+        u64 buffer_length = original_length + rolz_get_in_place_margin_bound(original_length);
+        if (buffer_length < input.length)
+            buffer_length = input.length;
+
+        array_t buffer = {.bytes = (u8 *)malloc(buffer_length), .length = buffer_length};
+        if (buffer.bytes == NULL)
+            return 0;
+
+        memcpy(buffer.bytes + buffer.length - input.length, input.bytes, input.length);
+        rolz_decode_in_place(config, buffer, input.length);
+
+        free(buffer.bytes);
+        return 0;
+    }
+
+    array_t output = {.bytes = (u8 *)malloc(original_length), .length = original_length};
+    if (output.bytes == NULL)
+        return 0;
+
+    // The context lives across runs, so its dictionary holds whatever the previous inputs left in it.
+    static rolz_context_t context = {0};
+
+    if (data[0] & 0x80)
+    {
+        if (context.dictionary == NULL || memcmp(&context.config, &config, sizeof(config)) != 0)
+        {
+            rolz_context_free(&context);
+            rolz_context_init(config, &context);
+        }
+
+        if (context.dictionary)
+            rolz_decode_with_context(&context, input, &output);
+    }
+    else
+        rolz_decode(config, input, &output);
+
+    free(output.bytes);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fuzz.h"
+
+// Runs a fuzz target without libFuzzer: every argument is a file fed to the target once, or stdin when there are
+// none. That's what AFL expects (afl-fuzz -i seeds -o findings -- ./fuzz_decode_lzss @@), and it replays crashes.
+static int __run(FILE *file)
+{
+    size_t capacity = 4096, size = 0, read = 0;
+    u8 *data = (u8 *)malloc(capacity);
+
+    while (data && (read = fread(data + size, 1, capacity - size, file)) > 0)
+    {
+        size += read;
+
+        if (size == capacity)
+        {
+            u8 *grown = (u8 *)realloc(data, capacity * 2);
+            if (grown == NULL)
+                break;
+
+            data = grown;
+            capacity *= 2;
+        }
+    }
+
+    if (data == NULL)
+        return EXIT_FAILURE;
+
+    LLVMFuzzerTestOneInput(data, size);
+
+    free(data);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, const char **argv)
+{
+    if (argc < 2)
+        return __run(stdin);
+
+    for (int i = 1; i < argc; i += 1)
+    {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL)
+        {
+            fprintf(stderr, "Could not open \"%s\"\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+
+        int result = __run(file);
+        fclose(file);
+
+        if (result != EXIT_SUCCESS)
+            return result;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,48 @@
+#ifndef __FUZZ_H__
+#define __FUZZ_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <common.h>
+#include <lzss.h>
+#include <rolz.h>
+
+// Every target takes a selector byte first, so one corpus covers every config and layout, and the rest of the
+// input is the data. Decoders get at most FUZZ_MAX_OUTPUT bytes of output, so a corrupt length doesn't just
+// exhaust memory, and encoding stays under FUZZ_MAX_INPUT bytes so the brute force search keeps up.
+#define FUZZ_MAX_OUTPUT (1 << 20)
+#define FUZZ_MAX_INPUT (16 * 1024)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+// Low nibble: the flags, bits 4-5: the parameters. Long matches have no bit left, the last two sets turn them on.
+static inline lzss_config_t fuzz_lzss_config(u8 selector)
+{
+    static const u8 parameters[4][3] = {{10, 6, 2}, {12, 8, 3}, {8, 4, 2}, {14, 5, 4}};
+    const u8 *p = parameters[(selector >> 4) & 3];
+
+    lzss_config_t config = lzss_config_init(p[0], p[1], p[2]);
+    config.flags = selector & 0x0F;
+    if (selector & 0x20)
+        config.flags |= LZSS_FLAG_LONG_MATCHES;
+
+    return config;
+}
+
+// Low nibble: the flags, bits 4-5: the parameters, the last two with long matches. History buffers stay small,
+// they're allocated on every call.
+static inline rolz_config_t fuzz_rolz_config(u8 selector)
+{
+    static const u8 parameters[4][4] = {{8, 4, 2, 16}, {4, 4, 2, 10}, {6, 5, 3, 12}, {8, 8, 2, 8}};
+    const u8 *p = parameters[(selector >> 4) & 3];
+
+    rolz_config_t config = rolz_config_init(p[0], p[1], p[2], p[3]);
+    config.flags = selector & 0x0F;
+    if (selector & 0x20)
+        config.flags |= ROLZ_FLAG_LONG_MATCHES;
+
+    return config;
+}
+
+#endif
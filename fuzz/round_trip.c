@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+
+// Differential target: whatever the encoders write must decode back to the input, through the regular decoder and,
+// for the layouts that support it, in place with the margin the encoder reported. Bit 7 of the selector picks ROLZ.
+static void __check(int condition, const char *what, u8 selector)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "Round trip failed: %s, selector 0x%02x\n", what, selector);
+        abort();
+    }
+}
+
+static void __round_trip(u8 selector, array_t input)
+{
+    const u8 is_rolz = (selector & 0x80) != 0;
+    const lzss_config_t lzss = fuzz_lzss_config(selector);
+    const rolz_config_t rolz = fuzz_rolz_config(selector);
+
+    array_t encoded = {.length = is_rolz ? rolz_get_upper_bound(input.length) : lzss_get_upper_bound(input.length)};
+    array_t decoded = {.length = input.length};
+
+    encoded.bytes = (u8 *)malloc(encoded.length);
+    decoded.bytes = (u8 *)malloc(decoded.length);
+
+    if (encoded.bytes && decoded.bytes)
+    {
+        error_t error = is_rolz ? rolz_encode(rolz, input, &encoded) : lzss_encode(lzss, input, &encoded);
+        __check(error == ERROR_ALL_GOOD, "encoding", selector);
+
+        error = is_rolz ? rolz_decode(rolz, encoded, &decoded) : lzss_decode(lzss, encoded, &decoded);
+        __check(error == ERROR_ALL_GOOD && memcmp(decoded.bytes, input.bytes, input.length) == 0, "decoding", selector);
+    }
+
+    free(encoded.bytes);
+    free(decoded.bytes);
+
+    // The split layouts can't decode in place.
+    if (is_rolz ? rolz.flags & (ROLZ_FLAG_SPLIT_STREAMS | ROLZ_FLAG_LITERAL_RUNS) : lzss.flags & (LZSS_FLAG_SPLIT_STREAMS | LZSS_FLAG_LITERAL_RUNS))
+        return;
+
+    u64 margin = 0;
+    array_t buffer = {.length = input.length + (is_rolz ? rolz_get_upper_bound(input.length) : lzss_get_upper_bound(input.length))};
+
+    if (!(buffer.bytes = (u8 *)malloc(buffer.length)))
+        return;
+
+    // Encode at the start of the buffer, then move it to the end of original length + margin bytes.
+    array_t compressed = {.bytes = buffer.bytes, .length = buffer.length};
+    error_t error = is_rolz ? rolz_encode_with_margin(rolz, input, &compressed, &margin) : lzss_encode_with_margin(lzss, input, &compressed, &margin);
+    __check(error == ERROR_ALL_GOOD && margin <= (is_rolz ? rolz_get_in_place_margin_bound(input.length) : lzss_get_in_place_margin_bound(input.length)),
+            "encoding with margin", selector);
+
+    array_t in_place = {.bytes = buffer.bytes, .length = input.length + margin};
+    __check(compressed.length <= in_place.length, "compressed data fitting the margin", selector);
+
+    memmove(in_place.bytes + in_place.length - compressed.length, compressed.bytes, compressed.length);
+
+    error = is_rolz ? rolz_decode_in_place(rolz, in_place, compressed.length) : lzss_decode_in_place(lzss, in_place, compressed.length);
+    __check(error == ERROR_ALL_GOOD && memcmp(in_place.bytes, input.bytes, input.length) == 0, "decoding in place", selector);
+
+    free(buffer.bytes);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < 2 || size - 1 > FUZZ_MAX_INPUT)
+        return 0;
+
+    __round_trip(data[0], (array_t){.bytes = (u8 *)data + 1, .length = size - 1});
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <common.h>
+#include <frame.h>
+
+// Batch API for many small buffers: one codec context per thread is reused for every input, and the results go
+// back to back into a single caller-provided arena. offsets has count + 1 entries, item i lives in
+// [offsets[i], offsets[i + 1]) of the arena. Empty inputs are allowed and take no space.
+typedef struct batch_config_t
+{
+    codec_t codec;
+    lzss_config_t lzss;
+    rolz_config_t rolz;
+    lzb_config_t lzb;
+
+    u32 threads; // 0 means one per CPU, 1 runs everything on the calling thread.
+} batch_config_t;
+
+// Uses the same codec defaults as frames, which can be replaced afterwards through the lzss/rolz/lzb fields.
+_API batch_config_t batch_config_init(codec_t codec, u32 threads);
+
+// Arena size that's always enough to encode all the inputs.
+_API u64 batch_get_upper_bound(batch_config_t config, const array_t *inputs, u64 count);
+_API error_t batch_encode(batch_config_t config, const array_t *inputs, u64 count, array_t *arena, u64 *offsets);
+
+// Total length of the decoded items, i.e. the size of the arena batch_decode needs.
+_API error_t batch_get_original_length(batch_config_t config, array_t arena, const u64 *offsets, u64 count, u64 *original_length);
+_API error_t batch_decode(batch_config_t config, array_t arena, const u64 *offsets, u64 count, array_t *output_arena, u64 *output_offsets);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <common.h>
+#include <batch.h>
+
+// A single stream that still decodes on several cores: the encoder resets the LZSS window, or the ROLZ dictionary
+// and last position lookup, every (1 << interval_bits) input bytes, so every checkpoint decodes on its own.
+// Where each one starts in the stream goes in a side index of count + 1 compressed offsets, the last being the
+// stream's length, which the caller stores next to the stream. Checkpoint i holds the original bytes from
+// i * interval on.
+typedef struct checkpoint_config_t
+{
+    batch_config_t batch; // Codec, its parameters and the number of threads.
+
+    u8 interval_bits;
+    u64 interval;
+} checkpoint_config_t;
+
+// Uses the same codec defaults as frames, which can be replaced afterwards through the batch.lzss/rolz/lzb fields.
+_API checkpoint_config_t checkpoint_config_init(codec_t codec, u8 interval_bits, u32 threads);
+
+// Number of checkpoints for an input of that length, the index needs one entry more.
+_API u64 checkpoint_get_count(checkpoint_config_t config, u64 input_length);
+
+_API u64 checkpoint_get_upper_bound(checkpoint_config_t config, u64 input_length);
+_API error_t checkpoint_encode(checkpoint_config_t config, array_t input, array_t *output, u64 *index);
+
+_API error_t checkpoint_get_original_length(checkpoint_config_t config, array_t input, const u64 *index, u64 count, u64 *original_length);
+
+// Decodes checkpoints [first, last) into output, which must be exactly their original length, spread over the
+// configured threads. Decoding everything is first = 0 and last = count, and callers that schedule the work
+// themselves can hand each thread its own range with threads set to 1.
+_API error_t checkpoint_decode_range(checkpoint_config_t config, array_t input, const u64 *index, u64 first, u64 last, array_t *output);
+_API error_t checkpoint_decode(checkpoint_config_t config, array_t input, const u64 *index, u64 count, array_t *output);
+
+#endif
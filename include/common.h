@@ -1,11 +1,23 @@
 #ifndef __COMMON_H__
 #define __COMMON_H__
 
+// Only _API functions are exported from the shared library, everything else is built with hidden visibility.
+#if defined(_WIN32)
 #ifdef _SHARED
 #define _API __declspec(dllexport)
 #else
 #define _API
 #endif
+#elif defined(__GNUC__)
+#define _API __attribute__((visibility("default")))
+#else
+#define _API
+#endif
+
+// Bumped in the major version whenever a public struct, signature or the encoded formats change incompatibly.
+#define COMPRESSION_VERSION_MAJOR 1
+#define COMPRESSION_VERSION_MINOR 0
+#define COMPRESSION_VERSION_PATCH 0
 
 #include <stdint.h>
 
@@ -14,23 +26,34 @@ typedef uint16_t u16;
 typedef uint32_t u32;
 typedef uint64_t u64;
 
+typedef int8_t i8;
+typedef int16_t i16;
+typedef int32_t i32;
+typedef int64_t i64;
+
 typedef enum error_t
 {
     ERROR_ALL_GOOD = 0,
     ERROR_NO_OP,
     ERROR_BUFFER_OUT_OF_BOUNDS,
     ERROR_COULD_NOT_ALLOCATE,
-    ERROR_WRONG_OUTPUT_SIZE
+    ERROR_WRONG_OUTPUT_SIZE,
+    ERROR_UNKNOWN_FORMAT
 } error_t;
 
 typedef struct array_t
 {
     u8 *bytes;
-    u32 length;
+    u64 length;
 } array_t;
 
-#endif
+// Version of the library actually loaded, packed as (major << 16) | (minor << 8) | patch. Compare the major
+// version against COMPRESSION_VERSION_MAJOR to make sure the headers match the shared library.
+_API u32 compression_version(void);
+_API const char *compression_version_string(void);
 
-u32 jenkins32(array_t buffer);
-u32 adler32(array_t buffer);
-u32 hash_bytes(array_t buffer);
+_API u32 jenkins32(array_t buffer);
+_API u32 adler32(array_t buffer);
+_API u32 hash_bytes(array_t buffer);
+
+#endif
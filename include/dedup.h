@@ -0,0 +1,29 @@
+#ifndef __DEDUP_H__
+#define __DEDUP_H__
+
+#include <common.h>
+
+// Deduplication pre-pass: splits the input into content-defined chunks (gear hash) and replaces chunks that
+// were already seen with references. Like ldm, its output is meant to be fed to lzss_encode/rolz_encode.
+// It works on whole buffers only. References can point to any earlier chunk, so an incremental encoder or decoder
+// would have to keep everything it had seen anyway, and its output length is only known at the end.
+typedef struct dedup_config_t
+{
+    u8 average_bits; // Chunks average (1 << average_bits) bytes.
+    u64 boundary_mask;
+
+    u32 minimum_chunk;
+    u32 maximum_chunk;
+
+    u32 threads; // Chunking and hashing run on this many threads, 0 means one per CPU.
+} dedup_config_t;
+
+_API dedup_config_t dedup_config_init(u8 average_bits, u32 threads);
+
+_API u64 dedup_get_upper_bound(u64 input_length);
+_API error_t dedup_encode(dedup_config_t config, array_t input, array_t *output);
+
+_API error_t dedup_get_original_length(array_t input, u64 *original_length);
+_API error_t dedup_decode(dedup_config_t config, array_t input, array_t *output);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include <common.h>
+
+// Reversible transforms that run over a block before the codec sees it.
+typedef enum filter_t
+{
+    FILTER_NONE = 0,
+    FILTER_DELTA_BYTE, // Each byte minus the previous one, for 8-bit tables and samples.
+    FILTER_DELTA_WORD, // Same for little-endian 16-bit words.
+    FILTER_X86,        // x86 CALL/JMP relative addresses turned absolute, so repeated calls to a function match.
+    FILTER_TEXT,       // Common JSON/text sequences folded into single bytes.
+    FILTER_COUNT
+} filter_t;
+
+_API u64 filter_get_upper_bound(filter_t filter, u64 input_length);
+
+// The output length is updated with the filtered length. When decoding it must be set to the original length.
+_API error_t filter_encode(filter_t filter, array_t input, array_t *output);
+_API error_t filter_decode(filter_t filter, array_t input, array_t *output);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __FRAME_H__
+#define __FRAME_H__
+
+#include <common.h>
+#include <dedup.h>
+#include <filter.h>
+#include <ldm.h>
+#include <lzb.h>
+#include <lzss.h>
+#include <rolz.h>
+
+// A frame splits the input in blocks, runs the filter and then the codec over each one, and records everything
+// the decoder needs in its header, so frames decode without any configuration.
+typedef enum codec_t
+{
+    CODEC_LZSS = 1,
+    CODEC_ROLZ = 2,
+    CODEC_LZB = 3 // Byte aligned, decodes several times faster than LZSS for a lower ratio.
+} codec_t;
+
+// Pre-passes run over the whole input before it's split in blocks. The frame doesn't run them, its caller does, but
+// the header records them and their configuration so the decoder knows to undo them after frame_decode, long
+// distance matching first and then dedup. A frame with pre-passes has to be the only one in its input.
+typedef enum frame_pre_pass_t
+{
+    FRAME_PRE_PASS_DEDUP = 1 << 0,
+    FRAME_PRE_PASS_LDM = 1 << 1
+} frame_pre_pass_t;
+
+typedef struct frame_config_t
+{
+    codec_t codec;
+    lzss_config_t lzss;
+    rolz_config_t rolz;
+    lzb_config_t lzb;
+
+    filter_t filter;
+
+    u8 pre_passes; // frame_pre_pass_t bits, none by default.
+    dedup_config_t dedup;
+    ldm_config_t ldm;
+
+    u8 block_bits;
+    u64 block_length;
+} frame_config_t;
+
+// Uses the default configuration of the codec, which can be replaced afterwards through the lzss/rolz/lzb fields.
+_API frame_config_t frame_config_init(codec_t codec, filter_t filter, u8 block_bits);
+
+_API u64 frame_get_upper_bound(frame_config_t config, u64 input_length);
+_API error_t frame_encode(frame_config_t config, array_t input, array_t *output);
+
+// The input can hold several frames back to back too: their lengths add up and they decode one after the other.
+// frame_read_config reads the first one's.
+_API error_t frame_get_original_length(array_t input, u64 *original_length);
+_API error_t frame_read_config(array_t input, frame_config_t *config);
+_API error_t frame_decode(array_t input, array_t *output);
+
+// Block level access, for callers that schedule the blocks themselves, e.g. to overlap I/O with compression.
+// A frame is the header followed by every block in order, each block being its compressed length (4 bytes, big
+// endian) and its payload. Every block but the last holds block_length original bytes.
+_API u64 frame_get_header_upper_bound(void);
+_API u64 frame_get_block_upper_bound(frame_config_t config, u64 block_length);
+_API error_t frame_write_header(frame_config_t config, u64 input_length, array_t *output);
+_API error_t frame_encode_block(frame_config_t config, array_t block, array_t *output);
+
+// header_length is where the first block starts. frame_decode_block takes a payload without its length, and block
+// must be its original length.
+_API error_t frame_read_header(array_t input, frame_config_t *config, u64 *original_length, u64 *header_length);
+_API error_t frame_decode_block(frame_config_t config, array_t payload, array_t *block);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __LDM_H__
+#define __LDM_H__
+
+#include <common.h>
+
+// Long distance matching: a pre-pass that finds repeats far beyond the LZSS/ROLZ windows.
+// The output is a table of long matches followed by the remaining literal bytes, meant to be fed to lzss_encode/rolz_encode.
+typedef struct ldm_config_t
+{
+    u8 hash_bits;
+    u32 table_size;
+
+    u32 minimum_length; // Also the length of the rolling hash window.
+
+    u8 stride_bits; // Only one in (1 << stride_bits) positions is sampled into the table.
+    u32 stride_mask;
+} ldm_config_t;
+
+_API ldm_config_t ldm_config_init(u8 hash_bits, u32 minimum_length, u8 stride_bits);
+
+_API u64 ldm_get_upper_bound(u64 input_length);
+_API error_t ldm_encode(ldm_config_t config, array_t input, array_t *output);
+
+_API error_t ldm_get_original_length(array_t input, u64 *original_length);
+_API error_t ldm_decode(ldm_config_t config, array_t input, array_t *output);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __LZB_H__
+#define __LZB_H__
+
+#include <common.h>
+#include <sequence.h>
+
+// Byte aligned LZ77 for when decode speed matters more than ratio. Every sequence is a token byte holding the
+// literal count and the match length over the minimum in a nibble each, the literals, a 16-bit little endian offset
+// and the match length's extra bytes. Counts that don't fit their nibble continue in bytes of 255 plus a last one
+// under it. The last sequence only has literals. The decoder never touches single bits and copies 16 bytes at a
+// time, the encoder checks a single hashed position for every match.
+typedef struct lzb_config_t
+{
+    u8 hash_bits; // Size of the encoder's position table, from 10 to 20 bits. The decoder doesn't need it.
+} lzb_config_t;
+
+_API lzb_config_t lzb_config_init(u8 hash_bits);
+
+_API u64 lzb_get_upper_bound(u64 input_length);
+_API error_t lzb_encode(lzb_config_t config, array_t input, array_t *output);
+
+// lzb_encode in two steps, see sequence.h. lzb_encode_sequences takes sequences from any parser with distances for
+// offsets, e.g. lzss_parse, as long as they cover the whole input. Matches LZB can't hold, under 4 bytes or further
+// than 64KB back, become literals.
+_API error_t lzb_parse(lzb_config_t config, array_t input, sequence_buffer_t *sequences);
+_API error_t lzb_encode_sequences(array_t input, const sequence_buffer_t *sequences, array_t *output);
+
+_API error_t lzb_get_original_length(array_t input, u64 *original_length);
+_API error_t lzb_decode(array_t input, array_t *output);
+
+#endif
@@ -1,6 +1,37 @@
+#ifndef __LZSS_H__
+#define __LZSS_H__
+
 #include <common.h>
+#include <sequence.h>
 
-_API typedef struct lzss_config_t
+typedef enum lzss_flag_t
+{
+    // Store token flags, literals and match fields in separate streams, so the decoder copies literal runs with
+    // memcpy instead of reading them bit by bit. Not compatible with in-place decoding.
+    LZSS_FLAG_SPLIT_STREAMS = 1 << 0,
+
+    // Like split streams, but literals are counted in runs instead of flagged one by one. A literal run costs a few
+    // bits and is a single memcpy when decoding, so poorly compressible data decodes at about memcpy speed.
+    // Takes precedence over LZSS_FLAG_SPLIT_STREAMS.
+    LZSS_FLAG_LITERAL_RUNS = 1 << 1,
+
+    // Exp-Golomb coded lengths instead of a fixed length_bits field. Most matches are only a few bytes over the
+    // minimum, so they get cheaper and length_bits only sets the longest match. Works with any layout.
+    LZSS_FLAG_VARIABLE_CODES = 1 << 2,
+
+    // Keep the offsets of the last 3 matches. While the recent matches keep reusing them, they get a 2 or 3 bit code
+    // and new offsets pay 1 bit more. Otherwise an offset of 0, which no match uses, escapes to them, and new offsets
+    // cost what they do without the flag. Pays off with structured data (tables, arrays of records) that repeats
+    // the same distances, and the encoder checks them before searching the window. Works with any layout.
+    LZSS_FLAG_REP_OFFSETS = 1 << 3,
+
+    // Matches longer than max_length: a length of max_length is followed by the rest of it, Exp-Golomb coded, so a long
+    // repeat or a run of the same byte goes in one match instead of a string of them. Pays off with tar and disk
+    // images. Works with any layout.
+    LZSS_FLAG_LONG_MATCHES = 1 << 4
+} lzss_flag_t;
+
+typedef struct lzss_config_t
 {
     u8 offset_bits;
     u32 max_offset;
@@ -8,12 +39,77 @@ _API typedef struct lzss_config_t
     u8 minimum_length;
     u8 length_bits;
     u32 max_length;
+
+    u8 flags; // lzss_flag_t bits, set them after lzss_config_init. The decoder needs the same ones.
+
+    // Threads searching the window ahead of the encoder, 0 to search on the calling thread. The output is the same
+    // either way, the decoder doesn't need it. Only the encoders that parse as they go use them, on inputs over 16KB.
+    u8 match_threads;
 } lzss_config_t;
 
+// offset_bits is clamped to 1-24, length_bits to 1-16 and minimum_length to at least 1.
 _API lzss_config_t lzss_config_init(u8 offset_bits, u8 length_bits, u8 minimum_length);
 
-_API u32 lzss_get_upper_bound(u32 input_length);
+_API u64 lzss_get_upper_bound(u64 input_length);
 _API error_t lzss_encode(lzss_config_t config, array_t input, array_t *output);
 
-_API error_t lzss_get_original_length(array_t input, u32 *original_length);
+// In-place decoding: the compressed data sits at the end of a buffer of original length + margin bytes and
+// gets decoded into its start. lzss_encode_with_margin reports the exact margin for this input, and
+// lzss_get_in_place_margin_bound a margin that works for any input of that length.
+_API u64 lzss_get_in_place_margin_bound(u64 input_length);
+_API error_t lzss_encode_with_margin(lzss_config_t config, array_t input, array_t *output, u64 *in_place_margin);
+
+// lzss_encode in two steps, see sequence.h. The parse depends on the layout flags, which decide what a match has to
+// save to be worth it, so it should be written with the same config. lzss_encode_sequences takes sequences from any
+// parser with distances for offsets, as long as they cover the whole input and fit the config's fields.
+_API error_t lzss_parse(lzss_config_t config, array_t input, sequence_buffer_t *sequences);
+_API error_t lzss_encode_sequences(lzss_config_t config, array_t input, const sequence_buffer_t *sequences, array_t *output);
+
+_API error_t lzss_get_original_length(array_t input, u64 *original_length);
 _API error_t lzss_decode(lzss_config_t config, array_t input, array_t *output);
+_API error_t lzss_decode_in_place(lzss_config_t config, array_t buffer, u64 compressed_length);
+
+// Scatter/gather, for data held in chains of buffers such as network messages. The input fragments get encoded as one
+// buffer, so lzss_decode takes the result too. lzss_decode_fragments fills the output fragments in order as if they
+// were one buffer, matches crossing from one to the next included, and they must add up to the original length. The
+// decoder writes straight into them. The encoder reads them through cursors too, comparing matches that cross a
+// boundary piece by piece, and only gathers them into one buffer first as a fallback, when they average under eight
+// windows (max_offset) long and the boundaries would cost more than the copy.
+_API error_t lzss_encode_fragments(lzss_config_t config, const array_t *input, u64 input_count, array_t *output);
+_API error_t lzss_decode_fragments(lzss_config_t config, array_t input, const array_t *output, u64 output_count);
+
+// Message streams, for protocols that have to put every message on the wire as soon as it's written: a flush turns
+// the bytes written since the last one into a byte aligned chunk that decodes as soon as it arrives, while the window
+// carries over, so later messages still match against earlier ones. A chunk is its payload length (4 bytes, big
+// endian) followed by an lzss stream of the message. Chunks must be decoded in the order they were flushed, by a
+// stream with the same config. A stream either encodes or decodes, and must only be used by one thread at a time.
+#define LZSS_STREAM_CHUNK_HEADER_LENGTH 4
+
+typedef struct lzss_stream_t
+{
+    lzss_config_t config;
+
+    u8 *window; // History the next chunk can match against, followed by the bytes not flushed yet.
+    u64 history_length;
+    u64 length;
+    u64 capacity;
+} lzss_stream_t;
+
+_API error_t lzss_stream_init(lzss_config_t config, lzss_stream_t *stream);
+_API void lzss_stream_free(lzss_stream_t *stream);
+
+// Writes only buffer the bytes. lzss_stream_flush encodes everything pending as one chunk, and returns ERROR_NO_OP
+// when there's nothing to flush.
+_API error_t lzss_stream_write(lzss_stream_t *stream, array_t input);
+_API u64 lzss_stream_get_flush_upper_bound(const lzss_stream_t *stream);
+_API error_t lzss_stream_flush(lzss_stream_t *stream, array_t *output);
+
+// Full length of the chunk input starts with, which only needs its header to have arrived.
+_API error_t lzss_stream_get_chunk_length(array_t input, u64 *chunk_length);
+
+// Decodes the chunk input starts with. A chunk that hasn't fully arrived yet gives ERROR_BUFFER_OUT_OF_BOUNDS and
+// leaves the stream as it was, any other error leaves it unusable. message points into the window and stays valid
+// until the next call.
+_API error_t lzss_stream_decode(lzss_stream_t *stream, array_t input, array_t *message);
+
+#endif
@@ -1,6 +1,39 @@
+#ifndef __ROLZ_H__
+#define __ROLZ_H__
+
 #include <common.h>
+#include <sequence.h>
+
+typedef enum rolz_flag_t
+{
+    // Store token flags, literals and match fields in separate streams, so the decoder reads literal runs straight
+    // from memory instead of bit by bit. Not compatible with in-place decoding.
+    ROLZ_FLAG_SPLIT_STREAMS = 1 << 0,
+
+    // Like split streams, but literals are counted in runs instead of flagged one by one, so a literal run is a single
+    // memcpy plus its dictionary updates when decoding. Takes precedence over ROLZ_FLAG_SPLIT_STREAMS.
+    ROLZ_FLAG_LITERAL_RUNS = 1 << 1,
+
+    // Exp-Golomb coded steps instead of a fixed step_bits field, so the most recent positions are a bit cheaper and
+    // the oldest ones a bit more expensive. Pays off with data that repeats close by. Works with any layout.
+    ROLZ_FLAG_VARIABLE_CODES = 1 << 2,
+
+    // Matches can also give their distance back, LZ77 style, for the close repeats the order-1 chains don't reach: the
+    // ones whose byte before differs, or that are more than max_step positions back on the chain. A count of 0 marks
+    // them, followed by their length in count_bits and the distance in ROLZ_EXPLICIT_OFFSET_BITS, so context matches
+    // cost the same as without. The encoder takes whichever is cheaper per byte. Pays off with binary data, text does
+    // about as well without. Works with any layout.
+    ROLZ_FLAG_EXPLICIT_OFFSETS = 1 << 3,
+
+    // Matches longer than max_count: a count of max_count is followed by the rest of the length, Exp-Golomb coded, so
+    // a long repeat or a run of the same byte goes in one match instead of a string of them. Pays off with tar and
+    // disk images. Works with any layout.
+    ROLZ_FLAG_LONG_MATCHES = 1 << 4
+} rolz_flag_t;
 
-_API typedef struct rolz_config_t
+#define ROLZ_EXPLICIT_OFFSET_BITS 12
+
+typedef struct rolz_config_t
 {
     u8 step_bits;
     u32 max_step;
@@ -12,12 +45,98 @@ _API typedef struct rolz_config_t
     u32 max_offset;
 
     u8 minimum_match;
+
+    u8 flags; // rolz_flag_t bits, set them after rolz_config_init. The decoder needs the same ones.
+
+    // Threads searching ahead of the encoder, 0 to search on the calling thread. The output is the same either way,
+    // the decoder doesn't need it. Only rolz_encode and rolz_encode_with_margin use them, on inputs over 16KB, the
+    // encoders that carry a dictionary over search on their own.
+    u8 match_threads;
 } rolz_config_t;
 
+// Keeps the dictionary around between calls, so encoding or decoding many small inputs doesn't allocate every time.
+// A context must only be used by one thread at a time.
+typedef struct rolz_context_t
+{
+    rolz_config_t config;
+    u64 *dictionary;
+} rolz_context_t;
+
+// step_bits and count_bits are clamped to 1-16, history_buffer_bits to 1-24 and minimum_match to at least 1.
 _API rolz_config_t rolz_config_init(u8 step_bits, u8 count_bits, u8 minimum_match, u8 history_buffer_bits);
 
-_API u32 rolz_get_upper_bound(u32 input_length);
+_API error_t rolz_context_init(rolz_config_t config, rolz_context_t *context);
+_API void rolz_context_free(rolz_context_t *context);
+
+_API u64 rolz_get_upper_bound(u64 input_length);
 _API error_t rolz_encode(rolz_config_t config, array_t input, array_t *output);
 
-_API error_t rolz_get_original_length(array_t input, u32 *original_length);
+// In-place decoding: the compressed data sits at the end of a buffer of original length + margin bytes and
+// gets decoded into its start. rolz_encode_with_margin reports the exact margin for this input, and
+// rolz_get_in_place_margin_bound a margin that works for any input of that length.
+_API u64 rolz_get_in_place_margin_bound(u64 input_length);
+_API error_t rolz_encode_with_margin(rolz_config_t config, array_t input, array_t *output, u64 *in_place_margin);
+
+// rolz_encode in two steps, see sequence.h. The parse depends on the layout flags, which decide what a match has to
+// save to be worth it, so it should be written with the same config. The offsets are steps, so only ROLZ parses make
+// sense to rolz_encode_sequences, and they must cover the whole input and fit the config's fields. With
+// ROLZ_FLAG_EXPLICIT_OFFSETS, matches with an explicit distance have ROLZ_SEQUENCE_EXPLICIT_OFFSET set in theirs.
+#define ROLZ_SEQUENCE_EXPLICIT_OFFSET (1u << 31)
+
+_API error_t rolz_parse(rolz_config_t config, array_t input, sequence_buffer_t *sequences);
+_API error_t rolz_encode_sequences(rolz_config_t config, array_t input, const sequence_buffer_t *sequences, array_t *output);
+
+_API error_t rolz_get_original_length(array_t input, u64 *original_length);
 _API error_t rolz_decode(rolz_config_t config, array_t input, array_t *output);
+_API error_t rolz_encode_with_context(rolz_context_t *context, array_t input, array_t *output);
+_API error_t rolz_decode_with_context(rolz_context_t *context, array_t input, array_t *output);
+
+_API error_t rolz_decode_in_place(rolz_config_t config, array_t buffer, u64 compressed_length);
+
+// Scatter/gather, for data held in chains of buffers such as network messages. The input fragments get encoded as one
+// buffer, so rolz_decode takes the result too. rolz_decode_fragments fills the output fragments in order as if they
+// were one buffer, matches crossing from one to the next included, and they must add up to the original length. The
+// decoder writes straight into them. The encoder reads them through cursors too, comparing matches that cross a
+// boundary piece by piece, and only gathers them into one buffer first as a fallback, when they average under eight
+// windows (max_offset) long and the boundaries would cost more than the copy.
+_API error_t rolz_encode_fragments(rolz_config_t config, const array_t *input, u64 input_count, array_t *output);
+_API error_t rolz_decode_fragments(rolz_config_t config, array_t input, const array_t *output, u64 output_count);
+
+// Message streams, for protocols that have to put every message on the wire as soon as it's written: a flush turns
+// the bytes written since the last one into a byte aligned chunk that decodes as soon as it arrives, while the
+// dictionary and the history carry over, so later messages still match against earlier ones. A chunk is its payload
+// length (4 bytes, big endian) followed by a rolz stream of the message. Chunks must be decoded in the order they were
+// flushed, by a stream with the same config. A stream either encodes or decodes, and must only be used by one thread
+// at a time.
+#define ROLZ_STREAM_CHUNK_HEADER_LENGTH 4
+
+typedef struct rolz_stream_t
+{
+    rolz_config_t config;
+    u64 *dictionary;
+    u64 last_position_lookup[256];
+
+    u8 *window; // History the next chunk can match against, followed by the bytes not flushed yet.
+    u64 history_length;
+    u64 length;
+    u64 capacity;
+} rolz_stream_t;
+
+_API error_t rolz_stream_init(rolz_config_t config, rolz_stream_t *stream);
+_API void rolz_stream_free(rolz_stream_t *stream);
+
+// Writes only buffer the bytes. rolz_stream_flush encodes everything pending as one chunk, and returns ERROR_NO_OP
+// when there's nothing to flush. A flush that fails leaves the stream unusable.
+_API error_t rolz_stream_write(rolz_stream_t *stream, array_t input);
+_API u64 rolz_stream_get_flush_upper_bound(const rolz_stream_t *stream);
+_API error_t rolz_stream_flush(rolz_stream_t *stream, array_t *output);
+
+// Full length of the chunk input starts with, which only needs its header to have arrived.
+_API error_t rolz_stream_get_chunk_length(array_t input, u64 *chunk_length);
+
+// Decodes the chunk input starts with. A chunk that hasn't fully arrived yet gives ERROR_BUFFER_OUT_OF_BOUNDS and
+// leaves the stream as it was, any other error leaves it unusable. message points into the window and stays valid
+// until the next call.
+_API error_t rolz_stream_decode(rolz_stream_t *stream, array_t input, array_t *message);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef __SEQUENCE_H__
+#define __SEQUENCE_H__
+
+#include <common.h>
+
+// Intermediate representation between parsing and coding. A parser (lzss_parse, rolz_parse, lzb_parse) turns the
+// input into sequences, each a run of literals followed by a match, and a back end (lzss_encode_sequences,
+// rolz_encode_sequences, lzb_encode_sequences) writes them in its format, taking the literals from the input. So
+// parsing and coding can run on different blocks at the same time, a parse can be coded more than once, and new
+// formats only need a back end. The LZSS and ROLZ encoders go through it too, a few thousand sequences at a time.
+typedef struct sequence_t
+{
+    u64 literal_count;
+    u32 match_length;
+    u32 offset; // Distance back for LZSS and LZB. For ROLZ, the steps back through the positions after the same byte.
+} sequence_t;
+
+typedef struct sequence_buffer_t
+{
+    sequence_t *sequences;
+    u64 count;
+    u64 capacity;
+
+    u64 literal_count; // Literals after the last match, which the next sequence starts with or the input ends with.
+} sequence_buffer_t;
+
+_API error_t sequence_buffer_init(sequence_buffer_t *buffer, u64 capacity);
+_API void sequence_buffer_free(sequence_buffer_t *buffer);
+_API void sequence_buffer_reset(sequence_buffer_t *buffer);
+
+// Grows the buffer to at least capacity sequences, keeping the ones it has.
+_API error_t sequence_buffer_reserve(sequence_buffer_t *buffer, u64 capacity);
+
+// Input bytes the sequences cover, the literals at the end included.
+_API u64 sequence_buffer_get_length(const sequence_buffer_t *buffer);
+
+// Parsers call these for every token, so they're here to be inlined. Matches need a free slot.
+static inline void sequence_buffer_add_literals(sequence_buffer_t *buffer, u64 count) { buffer->literal_count += count; }
+
+static inline void sequence_buffer_add_match(sequence_buffer_t *buffer, u32 match_length, u32 offset)
+{
+    buffer->sequences[buffer->count++] = (sequence_t){.literal_count = buffer->literal_count, .match_length = match_length, .offset = offset};
+    buffer->literal_count = 0;
+}
+
+#endif
@@ -0,0 +1,393 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <batch.h>
+#include "thread.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+// Each worker handles a contiguous range of items with its own codec context.
+typedef struct worker_t
+{
+    const batch_config_t *config;
+    rolz_context_t rolz;
+
+    u64 first;
+    u64 last; // One past the last item.
+
+    // Encoding: the inputs and the part of the arena this worker writes to, starting at region_start.
+    const array_t *inputs;
+    array_t arena;
+    u64 *offsets;
+    u64 region_start;
+    u64 region_length;
+    u64 used;
+
+    // Decoding: the compressed arena and where each decoded item goes.
+    const u64 *input_offsets;
+    array_t output_arena;
+    const u64 *output_offsets;
+
+    error_t error;
+} worker_t;
+
+_API batch_config_t batch_config_init(codec_t codec, u32 threads)
+{
+    const frame_config_t defaults = frame_config_init(codec, FILTER_NONE, 0);
+
+    return (batch_config_t){
+        .codec = codec,
+        .lzss = defaults.lzss,
+        .rolz = defaults.rolz,
+        .lzb = defaults.lzb,
+
+        .threads = threads,
+    };
+}
+
+static inline u64 __item_get_upper_bound(const batch_config_t *config, u64 input_length)
+{
+    if (input_length == 0)
+        return 0;
+
+    switch (config->codec)
+    {
+    case CODEC_LZSS:
+        return lzss_get_upper_bound(input_length);
+    case CODEC_LZB:
+        return lzb_get_upper_bound(input_length);
+    default:
+        return rolz_get_upper_bound(input_length);
+    }
+}
+
+_API u64 batch_get_upper_bound(batch_config_t config, const array_t *inputs, u64 count)
+{
+    u64 bound = 0;
+
+    for (u64 i = 0; i < count; i += 1)
+        bound += __item_get_upper_bound(&config, inputs[i].length);
+
+    return bound;
+}
+
+static inline error_t __item_get_original_length(const batch_config_t *config, array_t input, u64 *length)
+{
+    // Empty inputs are stored as nothing at all.
+    if (input.length == 0)
+    {
+        *length = 0;
+        return ERROR_ALL_GOOD;
+    }
+
+    switch (config->codec)
+    {
+    case CODEC_LZSS:
+        return lzss_get_original_length(input, length);
+    case CODEC_LZB:
+        return lzb_get_original_length(input, length);
+    default:
+        return rolz_get_original_length(input, length);
+    }
+}
+
+_API error_t batch_get_original_length(batch_config_t config, array_t arena, const u64 *offsets, u64 count, u64 *original_length)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    *original_length = 0;
+
+    for (u64 i = 0; i < count; i += 1)
+    {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > arena.length)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        u64 length = 0;
+        if ((error = __item_get_original_length(&config, (array_t){.bytes = arena.bytes + offsets[i], .length = offsets[i + 1] - offsets[i]}, &length)))
+            return error;
+
+        *original_length += length;
+    }
+
+    return error;
+}
+
+static void *__encode_range(void *argument)
+{
+    worker_t *worker = (worker_t *)argument;
+
+    worker->used = 0;
+
+    for (u64 i = worker->first; i < worker->last && !worker->error; i += 1)
+    {
+        worker->offsets[i] = worker->region_start + worker->used;
+
+        if (worker->inputs[i].length == 0)
+            continue;
+
+        array_t output = {.bytes = worker->arena.bytes + worker->region_start + worker->used, .length = worker->region_length - worker->used};
+
+        if (worker->config->codec == CODEC_LZSS)
+            worker->error = lzss_encode(worker->config->lzss, worker->inputs[i], &output);
+        else if (worker->config->codec == CODEC_LZB)
+            worker->error = lzb_encode(worker->config->lzb, worker->inputs[i], &output);
+        else
+            worker->error = rolz_encode_with_context(&worker->rolz, worker->inputs[i], &output);
+
+        worker->used += output.length;
+    }
+
+    return NULL;
+}
+
+static void *__decode_range(void *argument)
+{
+    worker_t *worker = (worker_t *)argument;
+
+    for (u64 i = worker->first; i < worker->last && !worker->error; i += 1)
+    {
+        array_t input = {.bytes = worker->arena.bytes + worker->input_offsets[i], .length = worker->input_offsets[i + 1] - worker->input_offsets[i]};
+        array_t output = {.bytes = worker->output_arena.bytes + worker->output_offsets[i], .length = worker->output_offsets[i + 1] - worker->output_offsets[i]};
+
+        if (input.length == 0)
+            continue;
+
+        if (worker->config->codec == CODEC_LZSS)
+            worker->error = lzss_decode(worker->config->lzss, input, &output);
+        else if (worker->config->codec == CODEC_LZB)
+            worker->error = lzb_decode(input, &output);
+        else
+            worker->error = rolz_decode_with_context(&worker->rolz, input, &output);
+    }
+
+    return NULL;
+}
+
+// Splits the items in ranges of about the same amount of bytes, one per worker, and sets up their contexts.
+static error_t __workers_init(const batch_config_t *config, const u64 *lengths, u64 count, worker_t **workers, u32 *worker_count)
+{
+    u32 thread_count = config->threads ? config->threads : thread_get_cpu_count();
+    thread_count = (u32)MAX(1, MIN(thread_count, count));
+
+    u64 total = 0;
+    for (u64 i = 0; i < count; i += 1)
+        total += lengths[i];
+
+    if (!(*workers = (worker_t *)calloc(thread_count, sizeof(worker_t))))
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    u64 item = 0, bytes = 0;
+
+    for (u32 w = 0; w < thread_count; w += 1)
+    {
+        worker_t *worker = &(*workers)[w];
+
+        worker->config = config;
+        worker->first = item;
+
+        // The last worker takes whatever is left.
+        u64 target = w + 1 == thread_count ? total : total / thread_count * (w + 1);
+        while (item < count && (bytes < target || w + 1 == thread_count))
+            bytes += lengths[item++];
+
+        worker->last = item;
+
+        if (config->codec == CODEC_ROLZ && worker->first < worker->last)
+        {
+            error_t error = rolz_context_init(config->rolz, &worker->rolz);
+            if (error)
+            {
+                *worker_count = w + 1;
+                return error;
+            }
+        }
+    }
+
+    *worker_count = thread_count;
+    return ERROR_ALL_GOOD;
+}
+
+static void __workers_free(worker_t *workers, u32 worker_count)
+{
+    if (workers == NULL)
+        return;
+
+    for (u32 w = 0; w < worker_count; w += 1)
+        rolz_context_free(&workers[w].rolz);
+
+    free(workers);
+}
+
+// Runs every worker, the first one on the calling thread, and returns the first error any of them hit.
+static error_t __workers_run(worker_t *workers, u32 worker_count, thread_function_t function)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    thread_t *threads = NULL;
+    u32 started = 0;
+
+    if (worker_count > 1 && !(threads = (thread_t *)calloc(worker_count, sizeof(thread_t))))
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    for (u32 w = 1; w < worker_count; w += 1, started += 1)
+        if ((error = thread_create(&threads[w], function, &workers[w])))
+            break;
+
+    // If a thread couldn't be started, we do its share ourselves.
+    for (u32 w = started + 1; w < worker_count; w += 1)
+        function(&workers[w]);
+
+    function(&workers[0]);
+
+    for (u32 w = 1; w <= started; w += 1)
+        thread_join(&threads[w]);
+
+    free(threads);
+
+    error = ERROR_ALL_GOOD;
+    for (u32 w = 0; w < worker_count && !error; w += 1)
+        error = workers[w].error;
+
+    return error;
+}
+
+#define try(fn)       \
+    if ((error = fn)) \
+        goto error_exit;
+
+_API error_t batch_encode(batch_config_t config, const array_t *inputs, u64 count, array_t *arena, u64 *offsets)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (count == 0)
+        return ERROR_NO_OP;
+
+    worker_t *workers = NULL;
+    u32 worker_count = 0;
+
+    u64 *lengths = (u64 *)malloc(count * sizeof(u64));
+    if (lengths == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    for (u64 i = 0; i < count; i += 1)
+        lengths[i] = inputs[i].length;
+
+    try(__workers_init(&config, lengths, count, &workers, &worker_count));
+
+    // Every worker gets the upper bound of its items, so they can all write to the arena at the same time.
+    u64 region_start = 0;
+
+    for (u32 w = 0; w < worker_count; w += 1)
+    {
+        worker_t *worker = &workers[w];
+
+        worker->inputs = inputs;
+        worker->arena = *arena;
+        worker->offsets = offsets;
+        worker->region_start = region_start;
+
+        for (u64 i = worker->first; i < worker->last; i += 1)
+            worker->region_length += __item_get_upper_bound(&config, inputs[i].length);
+
+        region_start += worker->region_length;
+    }
+
+    if (region_start > arena->length)
+    {
+        error = ERROR_BUFFER_OUT_OF_BOUNDS;
+        goto error_exit;
+    }
+
+    try(__workers_run(workers, worker_count, __encode_range));
+
+    // Close the gaps between the regions so the items end up back to back.
+    u64 position = 0;
+
+    for (u32 w = 0; w < worker_count; w += 1)
+    {
+        worker_t *worker = &workers[w];
+        u64 shift = worker->region_start - position;
+
+        memmove(arena->bytes + position, arena->bytes + worker->region_start, worker->used);
+
+        for (u64 i = worker->first; i < worker->last; i += 1)
+            offsets[i] -= shift;
+
+        position += worker->used;
+    }
+
+    offsets[count] = position;
+
+    goto no_error_exit;
+
+error_exit:
+    __workers_free(workers, worker_count);
+    free(lengths);
+    arena->length = 0;
+    return error;
+
+no_error_exit:
+    __workers_free(workers, worker_count);
+    free(lengths);
+    arena->length = position;
+    return error;
+}
+
+_API error_t batch_decode(batch_config_t config, array_t arena, const u64 *offsets, u64 count, array_t *output_arena, u64 *output_offsets)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (count == 0)
+        return ERROR_NO_OP;
+
+    worker_t *workers = NULL;
+    u32 worker_count = 0;
+
+    // Reading the headers is cheap, so we lay out the output up front and the workers never have to move anything.
+    output_offsets[0] = 0;
+
+    for (u64 i = 0; i < count; i += 1)
+    {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > arena.length)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        u64 length = 0;
+        if ((error = __item_get_original_length(&config, (array_t){.bytes = arena.bytes + offsets[i], .length = offsets[i + 1] - offsets[i]}, &length)))
+            return error;
+
+        output_offsets[i + 1] = output_offsets[i] + length;
+    }
+
+    if (output_offsets[count] > output_arena->length)
+        return ERROR_WRONG_OUTPUT_SIZE;
+
+    // Work is split by compressed bytes, which is what decoding time follows.
+    u64 *lengths = (u64 *)malloc(count * sizeof(u64));
+    if (lengths == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    for (u64 i = 0; i < count; i += 1)
+        lengths[i] = offsets[i + 1] - offsets[i];
+
+    try(__workers_init(&config, lengths, count, &workers, &worker_count));
+
+    for (u32 w = 0; w < worker_count; w += 1)
+    {
+        workers[w].arena = arena;
+        workers[w].input_offsets = offsets;
+        workers[w].output_arena = *output_arena;
+        workers[w].output_offsets = output_offsets;
+    }
+
+    try(__workers_run(workers, worker_count, __decode_range));
+
+    output_arena->length = output_offsets[count];
+
+error_exit:
+    __workers_free(workers, worker_count);
+    free(lengths);
+    return error;
+}
+
+#undef try
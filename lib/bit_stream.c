@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "bit_stream.h"
 
 void bit_stream_reset(bit_stream_t *stream)
@@ -77,40 +79,66 @@ error_t bit_stream_write_bit(bit_stream_t *stream, u8 bit)
     return ERROR_ALL_GOOD;
 }
 
-error_t bit_stream_read_int(bit_stream_t *stream, u32 *number, u8 bits)
+error_t bit_stream_read_int(bit_stream_t *stream, u32 *number, u8 bits) { return bit_stream_read_bits(stream, number, bits); }
+
+error_t bit_stream_write_int(bit_stream_t *stream, u32 number, u8 bits) { return bit_stream_write_bits(stream, number, bits); }
+
+u32 bit_stream_peek_int(const bit_stream_t *stream, u8 bits)
 {
-    error_t error = ERROR_ALL_GOOD;
+    // The unread bits of the current byte are its lowest bit_count bits.
+    u32 value = stream->byte_buffer & ((1u << stream->bit_count) - 1);
+    u32 available = stream->bit_count;
+    u64 position = stream->buffer_position;
 
-    u32 value = 0;
-    for (u32 i = 0; i < bits; i += 1)
+    while (available < bits)
     {
-        value <<= 1;
-
-        u8 bit = 0;
+        value = (value << 8) | (position < stream->buffer_length ? stream->buffer[position] : 0);
+        position += 1;
+        available += 8;
+    }
 
-        if ((error = bit_stream_read_bit(stream, &bit)))
-            return error;
+    return (value >> (available - bits)) & ((1u << bits) - 1);
+}
 
-        value |= bit & 1;
+error_t bit_stream_skip(bit_stream_t *stream, u32 bits)
+{
+    if (bits <= stream->bit_count)
+    {
+        stream->bit_count -= bits;
+        return ERROR_ALL_GOOD;
     }
-    *number = value;
 
-    return error;
+    bits -= stream->bit_count;
+    stream->bit_count = 0;
+
+    if ((bits - 1) / 8 >= stream->buffer_length - stream->buffer_position)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    stream->buffer_position += (bits - 1) / 8;
+    bit_stream_unflush(stream);
+    stream->bit_count -= 1 + (bits - 1) % 8;
+
+    return ERROR_ALL_GOOD;
 }
 
-error_t bit_stream_write_int(bit_stream_t *stream, u32 number, u8 bits)
+error_t bit_stream_read_bytes(bit_stream_t *stream, u8 *bytes, u64 length)
 {
-    while (bits > 0)
-    {
-        u32 mask = 1 << (bits - 1);
-        u8 bit = (number & mask) > 0;
-        error_t error = bit_stream_write_bit(stream, bit);
+    if (stream->bit_count != 0 || stream->buffer_length - stream->buffer_position < length)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
 
-        if (error != ERROR_ALL_GOOD)
-            return error;
+    memcpy(bytes, stream->buffer + stream->buffer_position, length);
+    stream->buffer_position += length;
 
-        bits -= 1;
-    }
+    return ERROR_ALL_GOOD;
+}
+
+error_t bit_stream_write_bytes(bit_stream_t *stream, const u8 *bytes, u64 length)
+{
+    if (stream->bit_count != 0 || stream->buffer_length - stream->buffer_position < length)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    memcpy(stream->buffer + stream->buffer_position, bytes, length);
+    stream->buffer_position += length;
 
     return ERROR_ALL_GOOD;
 }
@@ -161,3 +189,47 @@ error_t bit_stream_write_7bit_int32(bit_stream_t *stream, u32 number)
 
     return error;
 }
+
+// Reads a 64-bit int using 7-bit VLQ approach
+error_t bit_stream_read_7bit_int64(bit_stream_t *stream, u64 *number)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    u64 n = 0;
+    u8 shift = 0;
+    while (1)
+    {
+        u32 byte = 0;
+        if ((error = bit_stream_read_int(stream, &byte, 8)))
+            return error;
+
+        n |= (u64)(byte & 127) << shift;
+        shift += 7;
+
+        if ((byte & 128) == 0 || shift > 63)
+            break;
+    }
+    *number = n;
+
+    return error;
+}
+
+// Writes a 64-bit int using 7-bit VLQ approach
+error_t bit_stream_write_7bit_int64(bit_stream_t *stream, u64 number)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    u64 n = number;
+    // 127 = 7 bits
+    while (n > 127)
+    {
+        u32 b = 128 | (n & 127); // Set the first bit as 1
+        if ((error = bit_stream_write_int(stream, b, 8)))
+            return error;
+
+        n >>= 7;
+    }
+
+    // Unlike the 32-bit version, we always write the last group so zero round-trips.
+    return bit_stream_write_int(stream, n & 127, 8);
+}
@@ -1,10 +1,20 @@
+#ifndef __BIT_STREAM_H__
+#define __BIT_STREAM_H__
+
 #include <common.h>
 
+// For the codecs' hot paths, where inlining is what lets constant field widths fold into the code.
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
 typedef struct bit_stream_t
 {
     u8 *buffer;
-    u32 buffer_length;
-    u32 buffer_position;
+    u64 buffer_length;
+    u64 buffer_position;
 
     u8 byte_buffer;
     u8 bit_count;
@@ -23,6 +33,74 @@ error_t bit_stream_write_bit(bit_stream_t *stream, u8 bit);
 error_t bit_stream_read_int(bit_stream_t *stream, u32 *number, u8 bits);
 error_t bit_stream_write_int(bit_stream_t *stream, u32 number, u8 bits);
 
+// Same bits as bit_stream_read_int/write_int, but a byte at a time instead of a bit at a time, and inlined. When
+// `bits` is a compile-time constant the loop unrolls to a couple of shifts and the masks fold.
+static ALWAYS_INLINE error_t bit_stream_read_bits(bit_stream_t *stream, u32 *number, u8 bits)
+{
+    u32 value = 0;
+
+    while (bits > 0)
+    {
+        if (stream->bit_count == 0)
+        {
+            if (stream->buffer_position >= stream->buffer_length)
+                return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+            stream->byte_buffer = stream->buffer[stream->buffer_position++];
+            stream->bit_count = 8;
+        }
+
+        // The unread bits of the current byte are its lowest bit_count bits.
+        u8 take = bits < stream->bit_count ? bits : stream->bit_count;
+        bits -= take;
+        stream->bit_count -= take;
+
+        value = (value << take) | ((stream->byte_buffer >> stream->bit_count) & ((1u << take) - 1));
+    }
+
+    *number = value;
+    return ERROR_ALL_GOOD;
+}
+
+static ALWAYS_INLINE error_t bit_stream_write_bits(bit_stream_t *stream, u32 number, u8 bits)
+{
+    while (bits > 0)
+    {
+        u8 take = bits < 8 - stream->bit_count ? bits : 8 - stream->bit_count;
+        bits -= take;
+
+        stream->byte_buffer = (u8)((stream->byte_buffer << take) | ((number >> bits) & ((1u << take) - 1)));
+        stream->bit_count += take;
+
+        if (stream->bit_count == 8)
+        {
+            if (stream->buffer_position >= stream->buffer_length)
+                return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+            stream->buffer[stream->buffer_position++] = stream->byte_buffer;
+            stream->byte_buffer = 0;
+            stream->bit_count = 0;
+        }
+    }
+
+    return ERROR_ALL_GOOD;
+}
+
+// Returns the next `bits` bits (up to 24) without consuming them. Bits past the end of the buffer read as zeros,
+// so check what bit_stream_skip returns before trusting them.
+u32 bit_stream_peek_int(const bit_stream_t *stream, u8 bits);
+error_t bit_stream_skip(bit_stream_t *stream, u32 bits);
+
+// Copies whole bytes, the stream must be byte aligned (no pending bits).
+error_t bit_stream_read_bytes(bit_stream_t *stream, u8 *bytes, u64 length);
+error_t bit_stream_write_bytes(bit_stream_t *stream, const u8 *bytes, u64 length);
+
 // Reads an int using 7-bit VLQ approach
 error_t bit_stream_read_7bit_int32(bit_stream_t *stream, u32 *number);
 error_t bit_stream_write_7bit_int32(bit_stream_t *stream, u32 number);
+
+// Same 7-bit VLQ encoding, wide enough for 64-bit lengths. Values that fit in 32 bits are encoded identically.
+error_t bit_stream_read_7bit_int64(bit_stream_t *stream, u64 *number);
+error_t bit_stream_write_7bit_int64(bit_stream_t *stream, u64 number);
+
+#endif
@@ -0,0 +1,141 @@
+#include <stdlib.h>
+
+#include <checkpoint.h>
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+// Same limits as frame blocks: below 1KB the resets cost too much ratio, above 1GB nothing is left to split.
+static const u8 CHECKPOINT_MINIMUM_INTERVAL_BITS = 10;
+static const u8 CHECKPOINT_MAXIMUM_INTERVAL_BITS = 30;
+
+_API checkpoint_config_t checkpoint_config_init(codec_t codec, u8 interval_bits, u32 threads)
+{
+    if (interval_bits < CHECKPOINT_MINIMUM_INTERVAL_BITS)
+        interval_bits = CHECKPOINT_MINIMUM_INTERVAL_BITS;
+    if (interval_bits > CHECKPOINT_MAXIMUM_INTERVAL_BITS)
+        interval_bits = CHECKPOINT_MAXIMUM_INTERVAL_BITS;
+
+    return (checkpoint_config_t){
+        .batch = batch_config_init(codec, threads),
+
+        .interval_bits = interval_bits,
+        .interval = (u64)1 << interval_bits,
+    };
+}
+
+_API u64 checkpoint_get_count(checkpoint_config_t config, u64 input_length)
+{
+    return (input_length + config.interval - 1) >> config.interval_bits;
+}
+
+static inline u64 __codec_get_upper_bound(const checkpoint_config_t *config, u64 input_length)
+{
+    switch (config->batch.codec)
+    {
+    case CODEC_LZSS:
+        return lzss_get_upper_bound(input_length);
+    case CODEC_LZB:
+        return lzb_get_upper_bound(input_length);
+    default:
+        return rolz_get_upper_bound(input_length);
+    }
+}
+
+_API u64 checkpoint_get_upper_bound(checkpoint_config_t config, u64 input_length)
+{
+    u64 full_count = input_length >> config.interval_bits;
+    u64 tail_length = input_length & (config.interval - 1);
+
+    u64 bound = full_count * __codec_get_upper_bound(&config, config.interval);
+
+    if (tail_length > 0)
+        bound += __codec_get_upper_bound(&config, tail_length);
+
+    return bound;
+}
+
+// Every checkpoint is a codec stream of its own, so resetting the state is just starting a new one, and the batch
+// workers already encode them in parallel and lay them out back to back.
+_API error_t checkpoint_encode(checkpoint_config_t config, array_t input, array_t *output, u64 *index)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (input.length == 0)
+        return ERROR_NO_OP;
+
+    u64 count = checkpoint_get_count(config, input.length);
+
+    array_t *inputs = (array_t *)malloc(count * sizeof(array_t));
+    if (inputs == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    for (u64 i = 0; i < count; i += 1)
+    {
+        u64 start = i << config.interval_bits;
+        inputs[i] = (array_t){.bytes = input.bytes + start, .length = MIN(config.interval, input.length - start)};
+    }
+
+    error = batch_encode(config.batch, inputs, count, output, index);
+
+    free(inputs);
+    return error;
+}
+
+// Checks the index too: every checkpoint but the last must hold exactly interval bytes, or they'd decode to the wrong
+// place.
+_API error_t checkpoint_get_original_length(checkpoint_config_t config, array_t input, const u64 *index, u64 count, u64 *original_length)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    *original_length = 0;
+
+    if (count == 0)
+        return ERROR_NO_OP;
+
+    for (u64 i = 0; i < count; i += 1)
+    {
+        if (index[i] >= index[i + 1] || index[i + 1] > input.length)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        u64 length = 0;
+        if ((error = batch_get_original_length(config.batch, input, index + i, 1, &length)))
+            return error;
+
+        if (length == 0 || length > config.interval || (i + 1 < count && length != config.interval))
+            return ERROR_UNKNOWN_FORMAT;
+
+        *original_length += length;
+    }
+
+    return error;
+}
+
+_API error_t checkpoint_decode_range(checkpoint_config_t config, array_t input, const u64 *index, u64 first, u64 last, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (first >= last)
+        return ERROR_NO_OP;
+
+    // A range can stop before the stream does, so its last checkpoint is only checked not to be too long.
+    u64 expected_length = 0;
+    if ((error = checkpoint_get_original_length(config, input, index + first, last - first, &expected_length)))
+        return error;
+
+    if (expected_length != output->length)
+        return ERROR_WRONG_OUTPUT_SIZE;
+
+    u64 *output_offsets = (u64 *)malloc((last - first + 1) * sizeof(u64));
+    if (output_offsets == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    error = batch_decode(config.batch, input, index + first, last - first, output, output_offsets);
+
+    free(output_offsets);
+    return error;
+}
+
+_API error_t checkpoint_decode(checkpoint_config_t config, array_t input, const u64 *index, u64 count, array_t *output)
+{
+    return checkpoint_decode_range(config, input, index, 0, count, output);
+}
@@ -0,0 +1,393 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <dedup.h>
+#include "bit_stream.h"
+#include "thread.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+// Each thread chunks and hashes this many bytes at a time. Segment ends are forced chunk boundaries,
+// content-defined chunking re-synchronizes right after them so the dedup ratio barely notices.
+static const u64 DEDUP_SEGMENT_LENGTH = 4 * 1024 * 1024;
+
+// A reference costs up to 14 bytes, so we only try to deduplicate chunks longer than this.
+static const u32 DEDUP_MINIMUM_REFERENCE = 32;
+
+// Bounds for the chunk size, applied to the configured average.
+static const u8 DEDUP_MINIMUM_AVERAGE_BITS = 8;
+static const u8 DEDUP_MAXIMUM_AVERAGE_BITS = 20;
+
+typedef struct chunk_t
+{
+    u64 position;
+    u32 length;
+    u32 hash;
+} chunk_t;
+
+typedef struct segment_t
+{
+    const dedup_config_t *config;
+    const u64 *gear;
+
+    array_t input;
+    u64 start;
+    u64 end;
+
+    chunk_t *chunks;
+    u64 chunk_count;
+} segment_t;
+
+typedef struct index_t
+{
+    chunk_t *slots; // Empty slots have a length of 0.
+    u64 mask;
+    u64 count;
+} index_t;
+
+_API dedup_config_t dedup_config_init(u8 average_bits, u32 threads)
+{
+    average_bits = MIN(MAX(average_bits, DEDUP_MINIMUM_AVERAGE_BITS), DEDUP_MAXIMUM_AVERAGE_BITS);
+
+    return (dedup_config_t){
+        .average_bits = average_bits,
+        // We look at the top bits since they depend on the last 64 bytes, the bottom ones only see the last few.
+        .boundary_mask = ~0ULL << (64 - average_bits),
+
+        .minimum_chunk = 1 << (average_bits - 2),
+        .maximum_chunk = 1 << (average_bits + 2),
+
+        .threads = threads,
+    };
+}
+
+_API u64 dedup_get_upper_bound(u64 input_length)
+{
+    // 10 bytes for the original length plus a header of up to 4 bytes for every chunk. Chunks are at least 64 bytes
+    // long except for the ones cut at segment ends, which are way less than one per 64 bytes.
+    return 10 + input_length + 4 * (input_length / 32 + 1);
+}
+
+_API error_t dedup_get_original_length(array_t input, u64 *original_length)
+{
+    bit_stream_t stream = bit_stream_init(input);
+
+    u64 length = 0;
+    error_t error = bit_stream_read_7bit_int64(&stream, &length);
+
+    if (error)
+    {
+        *original_length = 0;
+        return error;
+    }
+
+    *original_length = length;
+    return error;
+}
+
+static inline void __gear_table_init(u64 *gear)
+{
+    // splitmix64, any fixed sequence of random-looking numbers does the job.
+    u64 state = 0;
+
+    for (u32 i = 0; i < 256; i += 1)
+    {
+        u64 z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+static void *__chunk_segment(void *argument)
+{
+    segment_t *segment = (segment_t *)argument;
+    const dedup_config_t *config = segment->config;
+    const u8 *bytes = segment->input.bytes;
+
+    segment->chunk_count = 0;
+
+    for (u64 start = segment->start; start < segment->end;)
+    {
+        u64 limit = MIN(start + config->maximum_chunk, segment->end);
+        u64 end = MIN(start + config->minimum_chunk, limit);
+        u64 hash = 0;
+
+        // Gear rolling hash: each byte shifts out of the hash after 64 steps.
+        while (end < limit)
+        {
+            hash = (hash << 1) + segment->gear[bytes[end]];
+            end += 1;
+
+            if ((hash & config->boundary_mask) == 0)
+                break;
+        }
+
+        u32 length = (u32)(end - start);
+        segment->chunks[segment->chunk_count++] = (chunk_t){
+            .position = start,
+            .length = length,
+            .hash = hash_bytes((array_t){.bytes = segment->input.bytes + start, .length = length}),
+        };
+
+        start = end;
+    }
+
+    return NULL;
+}
+
+// Chunks up to `threads` segments starting at `position`, on worker threads if there's more than one.
+static error_t __chunk_span(segment_t *segments, thread_t *threads, u32 thread_count, u64 position, u32 *segment_count)
+{
+    error_t error = ERROR_ALL_GOOD;
+    array_t input = segments[0].input;
+
+    *segment_count = 0;
+
+    for (u32 i = 0; i < thread_count && position < input.length; i += 1)
+    {
+        segments[i].start = position;
+        segments[i].end = MIN(position + DEDUP_SEGMENT_LENGTH, input.length);
+        position = segments[i].end;
+
+        if (thread_count == 1)
+            __chunk_segment(&segments[i]);
+        else if ((error = thread_create(&threads[i], __chunk_segment, &segments[i])))
+            return error;
+
+        // Only count segments that are actually being worked on, so we never join a thread that doesn't exist.
+        *segment_count += 1;
+    }
+
+    return error;
+}
+
+static void __join_span(thread_t *threads, u32 thread_count, u32 segment_count)
+{
+    if (thread_count == 1)
+        return;
+
+    for (u32 i = 0; i < segment_count; i += 1)
+        thread_join(&threads[i]);
+}
+
+static error_t __index_grow(index_t *index)
+{
+    u64 capacity = (index->mask + 1) * 2;
+    chunk_t *slots = (chunk_t *)calloc(capacity, sizeof(chunk_t));
+
+    if (slots == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    for (u64 i = 0; i <= index->mask; i += 1)
+    {
+        chunk_t chunk = index->slots[i];
+        if (chunk.length == 0)
+            continue;
+
+        u64 slot = chunk.hash & (capacity - 1);
+        while (slots[slot].length != 0)
+            slot = (slot + 1) & (capacity - 1);
+
+        slots[slot] = chunk;
+    }
+
+    free(index->slots);
+    index->slots = slots;
+    index->mask = capacity - 1;
+
+    return ERROR_ALL_GOOD;
+}
+
+// Returns a previous chunk with the same contents, or inserts this one and returns NULL.
+static inline const chunk_t *__index_find_or_insert(index_t *index, array_t input, chunk_t chunk, error_t *error)
+{
+    u64 slot = chunk.hash & index->mask;
+
+    while (index->slots[slot].length != 0)
+    {
+        const chunk_t *candidate = &index->slots[slot];
+
+        if (candidate->hash == chunk.hash && candidate->length == chunk.length && memcmp(input.bytes + candidate->position, input.bytes + chunk.position, chunk.length) == 0)
+            return candidate;
+
+        slot = (slot + 1) & index->mask;
+    }
+
+    index->slots[slot] = chunk;
+    index->count += 1;
+
+    // Keep the load factor under 1/2 so probe sequences stay short.
+    if (index->count * 2 > index->mask)
+        *error = __index_grow(index);
+
+    return NULL;
+}
+
+#define try(fn)       \
+    if ((error = fn)) \
+        goto error_exit;
+
+_API error_t dedup_encode(dedup_config_t config, array_t input, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    // If there are no input bytes, we don't have to do anything.
+    if (input.length == 0)
+        return ERROR_NO_OP;
+
+    u32 thread_count = config.threads ? config.threads : thread_get_cpu_count();
+    thread_count = MAX(1, MIN(thread_count, (u32)(input.length / DEDUP_SEGMENT_LENGTH + 1)));
+
+    u64 gear[256];
+    __gear_table_init(gear);
+
+    // Two banks of segments: workers chunk the next span in one while we emit the current one from the other.
+    const u64 chunk_capacity = DEDUP_SEGMENT_LENGTH / config.minimum_chunk + 1;
+    segment_t *segments = (segment_t *)calloc(thread_count * 2, sizeof(segment_t));
+    thread_t *threads = (thread_t *)calloc(thread_count * 2, sizeof(thread_t));
+    chunk_t *chunks = (chunk_t *)malloc(thread_count * 2 * chunk_capacity * sizeof(chunk_t));
+    index_t index = {.slots = (chunk_t *)calloc(1024, sizeof(chunk_t)), .mask = 1023, .count = 0};
+
+    u32 segment_counts[2] = {0, 0};
+    int in_flight = -1; // Bank whose threads still have to be joined.
+
+    if (segments == NULL || threads == NULL || chunks == NULL || index.slots == NULL)
+    {
+        error = ERROR_COULD_NOT_ALLOCATE;
+        goto error_exit;
+    }
+
+    for (u32 i = 0; i < thread_count * 2; i += 1)
+        segments[i] = (segment_t){.config = &config, .gear = gear, .input = input, .chunks = chunks + i * chunk_capacity};
+
+    bit_stream_t stream = bit_stream_init(*output);
+
+    try(bit_stream_write_7bit_int64(&stream, input.length));
+
+    u64 position = 0;
+    u32 bank = 0;
+
+    in_flight = bank;
+    try(__chunk_span(segments, threads, thread_count, position, &segment_counts[bank]));
+
+    while (segment_counts[bank] > 0)
+    {
+        segment_t *current = segments + bank * thread_count;
+
+        __join_span(threads + bank * thread_count, thread_count, segment_counts[bank]);
+        in_flight = -1;
+
+        // Start chunking the next span before we emit this one.
+        position = current[segment_counts[bank] - 1].end;
+        u32 next = bank ^ 1;
+
+        in_flight = next;
+        try(__chunk_span(segments + next * thread_count, threads + next * thread_count, thread_count, position, &segment_counts[next]));
+
+        for (u32 s = 0; s < segment_counts[bank]; s += 1)
+        {
+            for (u64 c = 0; c < current[s].chunk_count; c += 1)
+            {
+                chunk_t chunk = current[s].chunks[c];
+                const chunk_t *previous = NULL;
+
+                if (chunk.length >= DEDUP_MINIMUM_REFERENCE)
+                {
+                    previous = __index_find_or_insert(&index, input, chunk, &error);
+                    if (error)
+                        goto error_exit;
+                }
+
+                if (previous)
+                {
+                    // Reference: length with the low bit set, then how far back the previous copy starts.
+                    try(bit_stream_write_7bit_int64(&stream, ((u64)chunk.length << 1) | 1));
+                    try(bit_stream_write_7bit_int64(&stream, chunk.position - previous->position));
+                }
+                else
+                {
+                    try(bit_stream_write_7bit_int64(&stream, (u64)chunk.length << 1));
+                    try(bit_stream_write_bytes(&stream, input.bytes + chunk.position, chunk.length));
+                }
+            }
+        }
+
+        segment_counts[bank] = 0;
+        bank = next;
+    }
+
+    goto no_error_exit;
+
+error_exit:
+    if (in_flight >= 0)
+        __join_span(threads + in_flight * thread_count, thread_count, segment_counts[in_flight]);
+
+    free(segments);
+    free(threads);
+    free(chunks);
+    free(index.slots);
+    output->length = 0;
+    return error;
+
+no_error_exit:
+    free(segments);
+    free(threads);
+    free(chunks);
+    free(index.slots);
+    output->length = stream.buffer_position;
+    return error;
+}
+
+_API error_t dedup_decode(dedup_config_t config, array_t input, array_t *output)
+{
+    (void)config; // Chunk boundaries are only needed by the encoder.
+
+    error_t error = ERROR_ALL_GOOD;
+
+    if (input.length == 0 || output->length == 0)
+        return ERROR_NO_OP;
+
+    bit_stream_t stream = bit_stream_init(input);
+
+    u64 original_size = 0;
+    try(bit_stream_read_7bit_int64(&stream, &original_size));
+
+    if (original_size != output->length)
+        return ERROR_WRONG_OUTPUT_SIZE;
+
+    u64 index = 0;
+
+    while (index < output->length)
+    {
+        u64 tag = 0;
+        try(bit_stream_read_7bit_int64(&stream, &tag));
+
+        u64 length = tag >> 1;
+
+        if (length == 0 || length > output->length - index)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        if (tag & 1)
+        {
+            u64 offset = 0;
+            try(bit_stream_read_7bit_int64(&stream, &offset));
+
+            // References always point to a whole chunk before this one, so they never overlap.
+            if (offset < length || offset > index)
+                return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+            memcpy(output->bytes + index, output->bytes + index - offset, length);
+        }
+        else
+            try(bit_stream_read_bytes(&stream, output->bytes + index, length));
+
+        index += length;
+    }
+
+error_exit:
+    return error;
+}
+
+#undef try
@@ -0,0 +1,459 @@
+#include <string.h>
+
+#include <filter.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Bytes in [TEXT_ESCAPE, TEXT_ESCAPE + 16) are codes. TEXT_ESCAPE itself means "the next byte is a literal",
+// so any input byte in that range comes out as two bytes. They're control characters, rare in text.
+#define TEXT_ESCAPE 0x10
+#define TEXT_FIRST_TOKEN (TEXT_ESCAPE + 1)
+
+typedef struct token_t
+{
+    const char *string;
+    u8 length;
+} token_t;
+
+#define TOKEN(s) {.string = s, .length = sizeof(s) - 1}
+
+// Longer tokens go first since the first match wins. They all start with one of '"', '}', ']' or ' '.
+static const token_t TEXT_TOKENS[] = {
+    TOKEN("\": {\n"),
+    TOKEN("\": [\n"),
+    TOKEN("\": \""),
+    TOKEN("\": "),
+    TOKEN("\",\n"),
+    TOKEN("\"\n"),
+    TOKEN("},\n"),
+    TOKEN("}\n"),
+    TOKEN("],\n"),
+    TOKEN("]\n"),
+    TOKEN("        "),
+    TOKEN("    "),
+    TOKEN("  "),
+};
+
+#undef TOKEN
+
+static const u8 TEXT_TOKEN_COUNT = sizeof(TEXT_TOKENS) / sizeof(TEXT_TOKENS[0]);
+
+_API u64 filter_get_upper_bound(filter_t filter, u64 input_length)
+{
+    // Only the text filter can grow, when every byte has to be escaped.
+    return filter == FILTER_TEXT ? input_length * 2 : input_length;
+}
+
+// Delta filters
+
+static void __delta_byte_encode(const u8 *input, u8 *output, u64 length)
+{
+    u64 i = 0;
+
+#if defined(__SSE2__)
+    if (length >= 17)
+    {
+        output[0] = input[0];
+
+        // Each lane subtracts the byte right before it, which is just the same load shifted by one.
+        for (i = 1; i + 16 <= length; i += 16)
+        {
+            __m128i current = _mm_loadu_si128((const __m128i *)(input + i));
+            __m128i previous = _mm_loadu_si128((const __m128i *)(input + i - 1));
+            _mm_storeu_si128((__m128i *)(output + i), _mm_sub_epi8(current, previous));
+        }
+    }
+#endif
+
+    u8 previous = i > 0 ? input[i - 1] : 0;
+    for (; i < length; i += 1)
+    {
+        output[i] = input[i] - previous;
+        previous = input[i];
+    }
+}
+
+static void __delta_byte_decode(const u8 *input, u8 *output, u64 length)
+{
+    u64 i = 0;
+    u8 previous = 0;
+
+#if defined(__SSE2__)
+    // Prefix sum in log2(16) steps, then add the last byte of the previous vector to every lane.
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(input + i));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi8(x, _mm_set1_epi8((char)previous));
+        _mm_storeu_si128((__m128i *)(output + i), x);
+
+        previous = output[i + 15];
+    }
+#endif
+
+    for (; i < length; i += 1)
+    {
+        previous += input[i];
+        output[i] = previous;
+    }
+}
+
+static inline u16 __read_word(const u8 *bytes) { return (u16)(bytes[0] | (bytes[1] << 8)); }
+
+static inline void __write_word(u8 *bytes, u16 word)
+{
+    bytes[0] = (u8)word;
+    bytes[1] = (u8)(word >> 8);
+}
+
+static void __delta_word_encode(const u8 *input, u8 *output, u64 length)
+{
+    u64 i = 0;
+
+#if defined(__SSE2__)
+    // x86 is little-endian, so 16-bit lanes line up with the words of the format.
+    if (length >= 18)
+    {
+        __write_word(output, __read_word(input));
+
+        for (i = 2; i + 16 <= length; i += 16)
+        {
+            __m128i current = _mm_loadu_si128((const __m128i *)(input + i));
+            __m128i previous = _mm_loadu_si128((const __m128i *)(input + i - 2));
+            _mm_storeu_si128((__m128i *)(output + i), _mm_sub_epi16(current, previous));
+        }
+    }
+#endif
+
+    u16 previous = i > 0 ? __read_word(input + i - 2) : 0;
+    for (; i + 2 <= length; i += 2)
+    {
+        u16 word = __read_word(input + i);
+        __write_word(output + i, word - previous);
+        previous = word;
+    }
+
+    // An odd trailing byte goes through untouched.
+    if (i < length)
+        output[i] = input[i];
+}
+
+static void __delta_word_decode(const u8 *input, u8 *output, u64 length)
+{
+    u64 i = 0;
+    u16 previous = 0;
+
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(input + i));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi16(x, _mm_set1_epi16((short)previous));
+        _mm_storeu_si128((__m128i *)(output + i), x);
+
+        previous = __read_word(output + i + 14);
+    }
+#endif
+
+    for (; i + 2 <= length; i += 2)
+    {
+        previous += __read_word(input + i);
+        __write_word(output + i, previous);
+    }
+
+    if (i < length)
+        output[i] = input[i];
+}
+
+// x86 BCJ filter
+
+// Finds the next E8 (CALL) or E9 (JMP) opcode in [start, end), or returns end.
+static inline u64 __x86_next_opcode(const u8 *bytes, u64 start, u64 end)
+{
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi8((char)0xFE);
+    const __m128i opcode = _mm_set1_epi8((char)0xE8);
+
+    while (start + 16 <= end)
+    {
+        __m128i x = _mm_and_si128(_mm_loadu_si128((const __m128i *)(bytes + start)), mask);
+        u32 found = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(x, opcode));
+
+        if (found)
+            return start + __builtin_ctz(found);
+
+        start += 16;
+    }
+#endif
+
+    while (start < end && (bytes[start] & 0xFE) != 0xE8)
+        start += 1;
+
+    return start;
+}
+
+// Works in place. Only operands whose top byte is 0x00 or 0xFF (a displacement under 16MB) are converted, and the
+// result is wrapped to 25 bits and sign extended so it keeps that property. We always skip the 4 operand bytes, even
+// when we don't convert them, so both directions look at the same opcodes and the decoder makes the exact same
+// decision looking at the converted bytes.
+static void __x86_convert(u8 *bytes, u64 length, u8 encoding)
+{
+    if (length < 5)
+        return;
+
+    u64 i = 0;
+    while ((i = __x86_next_opcode(bytes, i, length - 4)) < length - 4)
+    {
+        u8 top = bytes[i + 4];
+
+        if (top != 0x00 && top != 0xFF)
+        {
+            i += 5;
+            continue;
+        }
+
+        u32 operand = bytes[i + 1] | (bytes[i + 2] << 8) | (bytes[i + 3] << 16) | ((u32)top << 24);
+        u32 position = (u32)(i + 5);
+
+        operand = encoding ? operand + position : operand - position;
+        operand &= 0x1FFFFFF;
+        if (operand & 0x1000000)
+            operand |= 0xFF000000;
+
+        bytes[i + 1] = (u8)operand;
+        bytes[i + 2] = (u8)(operand >> 8);
+        bytes[i + 3] = (u8)(operand >> 16);
+        bytes[i + 4] = (u8)(operand >> 24);
+
+        i += 5;
+    }
+}
+
+// Text filter
+
+// Finds the next byte that may start a token or needs escaping in [start, end), or returns end.
+static inline u64 __text_next_special(const u8 *bytes, u64 start, u64 end)
+{
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i brace = _mm_set1_epi8('}');
+    const __m128i bracket = _mm_set1_epi8(']');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i high_nibble = _mm_set1_epi8((char)0xF0);
+    const __m128i escape = _mm_set1_epi8(TEXT_ESCAPE);
+
+    while (start + 16 <= end)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(bytes + start));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, brace)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(x, bracket), _mm_cmpeq_epi8(x, space)));
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_and_si128(x, high_nibble), escape));
+
+        u32 found = (u32)_mm_movemask_epi8(special);
+        if (found)
+            return start + __builtin_ctz(found);
+
+        start += 16;
+    }
+#endif
+
+    for (; start < end; start += 1)
+    {
+        u8 byte = bytes[start];
+        if (byte == '"' || byte == '}' || byte == ']' || byte == ' ' || (byte & 0xF0) == TEXT_ESCAPE)
+            break;
+    }
+
+    return start;
+}
+
+// Finds the next code byte in [start, end), or returns end.
+static inline u64 __text_next_code(const u8 *bytes, u64 start, u64 end)
+{
+#if defined(__SSE2__)
+    const __m128i high_nibble = _mm_set1_epi8((char)0xF0);
+    const __m128i escape = _mm_set1_epi8(TEXT_ESCAPE);
+
+    while (start + 16 <= end)
+    {
+        __m128i x = _mm_and_si128(_mm_loadu_si128((const __m128i *)(bytes + start)), high_nibble);
+        u32 found = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(x, escape));
+
+        if (found)
+            return start + __builtin_ctz(found);
+
+        start += 16;
+    }
+#endif
+
+    while (start < end && (bytes[start] & 0xF0) != TEXT_ESCAPE)
+        start += 1;
+
+    return start;
+}
+
+static u64 __text_encode(const u8 *input, u8 *output, u64 length)
+{
+    u64 written = 0;
+
+    for (u64 i = 0; i < length;)
+    {
+        // Plain bytes are copied in bulk up to the next interesting one.
+        u64 next = __text_next_special(input, i, length);
+        memcpy(output + written, input + i, next - i);
+        written += next - i;
+        i = next;
+
+        if (i == length)
+            break;
+
+        u8 byte = input[i];
+
+        if ((byte & 0xF0) == TEXT_ESCAPE)
+        {
+            output[written++] = TEXT_ESCAPE;
+            output[written++] = byte;
+            i += 1;
+            continue;
+        }
+
+        u8 token = 0;
+        for (; token < TEXT_TOKEN_COUNT; token += 1)
+            if (TEXT_TOKENS[token].length <= length - i && memcmp(input + i, TEXT_TOKENS[token].string, TEXT_TOKENS[token].length) == 0)
+                break;
+
+        if (token < TEXT_TOKEN_COUNT)
+        {
+            output[written++] = TEXT_FIRST_TOKEN + token;
+            i += TEXT_TOKENS[token].length;
+        }
+        else
+            output[written++] = input[i++];
+    }
+
+    return written;
+}
+
+static error_t __text_decode(const u8 *input, u64 input_length, u8 *output, u64 output_length)
+{
+    u64 written = 0;
+
+    for (u64 i = 0; i < input_length;)
+    {
+        u64 next = __text_next_code(input, i, input_length);
+
+        if (next - i > output_length - written)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        memcpy(output + written, input + i, next - i);
+        written += next - i;
+        i = next;
+
+        if (i == input_length)
+            break;
+
+        u8 code = input[i];
+
+        if (code == TEXT_ESCAPE)
+        {
+            if (i + 1 >= input_length || written >= output_length)
+                return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+            output[written++] = input[i + 1];
+            i += 2;
+            continue;
+        }
+
+        u8 token = code - TEXT_FIRST_TOKEN;
+
+        if (token >= TEXT_TOKEN_COUNT || TEXT_TOKENS[token].length > output_length - written)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        memcpy(output + written, TEXT_TOKENS[token].string, TEXT_TOKENS[token].length);
+        written += TEXT_TOKENS[token].length;
+        i += 1;
+    }
+
+    return written == output_length ? ERROR_ALL_GOOD : ERROR_WRONG_OUTPUT_SIZE;
+}
+
+_API error_t filter_encode(filter_t filter, array_t input, array_t *output)
+{
+    if (output->length < filter_get_upper_bound(filter, input.length))
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    switch (filter)
+    {
+    case FILTER_NONE:
+        memcpy(output->bytes, input.bytes, input.length);
+        output->length = input.length;
+        break;
+
+    case FILTER_DELTA_BYTE:
+        __delta_byte_encode(input.bytes, output->bytes, input.length);
+        output->length = input.length;
+        break;
+
+    case FILTER_DELTA_WORD:
+        __delta_word_encode(input.bytes, output->bytes, input.length);
+        output->length = input.length;
+        break;
+
+    case FILTER_X86:
+        memcpy(output->bytes, input.bytes, input.length);
+        __x86_convert(output->bytes, input.length, 1);
+        output->length = input.length;
+        break;
+
+    case FILTER_TEXT:
+        output->length = __text_encode(input.bytes, output->bytes, input.length);
+        break;
+
+    default:
+        return ERROR_NO_OP;
+    }
+
+    return ERROR_ALL_GOOD;
+}
+
+_API error_t filter_decode(filter_t filter, array_t input, array_t *output)
+{
+    // Every filter but the text one keeps the length.
+    if (filter != FILTER_TEXT && input.length != output->length)
+        return ERROR_WRONG_OUTPUT_SIZE;
+
+    switch (filter)
+    {
+    case FILTER_NONE:
+        memcpy(output->bytes, input.bytes, input.length);
+        break;
+
+    case FILTER_DELTA_BYTE:
+        __delta_byte_decode(input.bytes, output->bytes, input.length);
+        break;
+
+    case FILTER_DELTA_WORD:
+        __delta_word_decode(input.bytes, output->bytes, input.length);
+        break;
+
+    case FILTER_X86:
+        memcpy(output->bytes, input.bytes, input.length);
+        __x86_convert(output->bytes, input.length, 0);
+        break;
+
+    case FILTER_TEXT:
+        return __text_decode(input.bytes, input.length, output->bytes, output->length);
+
+    default:
+        return ERROR_NO_OP;
+    }
+
+    return ERROR_ALL_GOOD;
+}
@@ -0,0 +1,156 @@
+#ifndef __FRAGMENTS_H__
+#define __FRAGMENTS_H__
+
+#include <string.h>
+
+#include <common.h>
+
+// A buffer spread over fragments, which the decoders fill as if it was one run of positions. Every access goes
+// through a cursor holding the fragment it last landed in, so going through the positions in order costs a compare
+// per access, and only a boundary or a match reaching back into an earlier fragment looks the fragment up again.
+// Writes and match sources get a cursor each, so a match copying from the fragment before doesn't thrash them.
+typedef struct fragment_cursor_t
+{
+    u8 *bytes; // The fragment, which holds the positions from start to end.
+    u64 start;
+    u64 end;
+} fragment_cursor_t;
+
+typedef struct fragments_t
+{
+    const array_t *fragments;
+    u64 count;
+    u64 *starts; // Position of every fragment's first byte, and the total length after the last one.
+    u64 length;
+
+    fragment_cursor_t write;
+    fragment_cursor_t read;
+} fragments_t;
+
+error_t fragments_init(fragments_t *fragments, const array_t *arrays, u64 count);
+void fragments_free(fragments_t *fragments);
+
+// Copies the fragments to one buffer of their total length, which the caller frees.
+error_t fragments_gather(const array_t *arrays, u64 count, array_t *gathered);
+
+// Whether an encoder whose searches reach window bytes back is better off gathering the fragments first. When they're
+// short next to the window, most compares cross a boundary and seek, and the copy costs less than that.
+u8 fragments_worth_gathering(const array_t *arrays, u64 count, u64 window);
+
+// Points the cursor at the fragment holding position, which must be under the total length.
+u8 *fragments_seek(const fragments_t *fragments, fragment_cursor_t *cursor, u64 position);
+
+static inline u8 *fragments_at(const fragments_t *fragments, fragment_cursor_t *cursor, u64 position)
+{
+    if (position - cursor->start < cursor->end - cursor->start)
+        return cursor->bytes + (position - cursor->start);
+
+    return fragments_seek(fragments, cursor, position);
+}
+
+static inline void fragments_put(fragments_t *fragments, u64 position, u8 byte) { *fragments_at(fragments, &fragments->write, position) = byte; }
+static inline u8 fragments_get(fragments_t *fragments, u64 position) { return *fragments_at(fragments, &fragments->read, position); }
+
+// The slow paths of the two below, for bytes that cross from one fragment to the next.
+void fragments_write_pieces(fragments_t *fragments, u64 position, const u8 *bytes, u64 count);
+void fragments_copy_pieces(fragments_t *fragments, u64 position, u64 offset, u64 length);
+
+// Writes count bytes from position on.
+static inline void fragments_write(fragments_t *fragments, u64 position, const u8 *bytes, u64 count)
+{
+    if (count == 0)
+        return;
+
+    u8 *to = fragments_at(fragments, &fragments->write, position);
+
+    if (position + count <= fragments->write.end)
+        memcpy(to, bytes, count);
+    else
+        fragments_write_pieces(fragments, position, bytes, count);
+}
+
+// Copies a match of length bytes from offset back to position, forwards, so it may overlap its own output.
+static inline void fragments_copy(fragments_t *fragments, u64 position, u64 offset, u64 length)
+{
+    if (length == 0)
+        return;
+
+    u8 *to = fragments_at(fragments, &fragments->write, position);
+    const u8 *from = fragments_at(fragments, &fragments->read, position - offset);
+
+    if (position + length > fragments->write.end || position - offset + length > fragments->read.end)
+        fragments_copy_pieces(fragments, position, offset, length);
+    else if (offset == 1)
+        memset(to, from[0], length);
+    else if (offset >= length)
+        memcpy(to, from, length);
+    else
+        for (u64 i = 0; i < length; i += 1)
+            to[i] = from[i];
+}
+
+// Encoders take their input either as one buffer or, when gather isn't NULL, as fragments. They go through the
+// cursors the way the decoders do: write for the position being encoded, read for where its matches come from.
+// The input then only gives the total length.
+static inline u8 fragments_input_byte(array_t input, fragments_t *gather, u64 position)
+{
+    if (gather == NULL)
+        return input.bytes[position];
+
+    return *fragments_at(gather, &gather->write, position);
+}
+
+// Points to the bytes from position to end when they're all in one fragment, NULL when they cross to the next.
+static inline u8 *fragments_span(fragments_t *fragments, u64 position, u64 end)
+{
+    u8 *at = fragments_at(fragments, &fragments->read, position);
+    return end <= fragments->read.end ? at : NULL;
+}
+
+// The slow path of fragments_match_length, for matches crossing from one fragment to the next.
+u64 fragments_match_pieces(fragments_t *fragments, u64 position, u64 source, u64 limit);
+
+// How many bytes from position on are the same as the ones from source on, up to limit, which the input has to hold
+// from position on.
+static inline u64 fragments_match_length(array_t input, fragments_t *gather, u64 position, u64 source, u64 limit)
+{
+    u64 length = 0;
+
+    if (gather == NULL)
+    {
+        while (length < limit && input.bytes[source + length] == input.bytes[position + length])
+            length += 1;
+
+        return length;
+    }
+
+    const u8 *at = fragments_at(gather, &gather->write, position);
+    const u8 *from = fragments_at(gather, &gather->read, source);
+
+    if (position + limit > gather->write.end || source + limit > gather->read.end)
+        return fragments_match_pieces(gather, position, source, limit);
+
+    while (length < limit && from[length] == at[length])
+        length += 1;
+
+    return length;
+}
+
+// Points to count bytes from position on, or when they cross from one fragment to the next, copies them to stitch,
+// which has to hold count bytes, and points there.
+const u8 *fragments_stitch_pieces(fragments_t *fragments, u64 position, u64 count, u8 *stitch);
+
+static inline const u8 *fragments_input_bytes(array_t input, fragments_t *gather, u64 position, u64 count, u8 *stitch)
+{
+    if (gather == NULL)
+        return input.bytes + position;
+
+    const u8 *at = fragments_at(gather, &gather->write, position);
+
+    if (position + count <= gather->write.end)
+        return at;
+
+    return fragments_stitch_pieces(gather, position, count, stitch);
+}
+
+#endif
@@ -0,0 +1,585 @@
+#include <stdlib.h>
+
+#include <frame.h>
+#include "bit_stream.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+static const u8 FRAME_MAGIC[4] = {'C', 'M', 'P', 'F'};
+// Version 2 added the codec flags byte and version 3 the pre-passes, older frames are still read without them.
+static const u8 FRAME_VERSION = 3;
+
+// Blocks are capped at 1GB so the compressed length of a block always fits the 32-bit field in front of it.
+static const u8 FRAME_MINIMUM_BLOCK_BITS = 10;
+static const u8 FRAME_MAXIMUM_BLOCK_BITS = 30;
+
+// Magic, version, codec, up to 4 codec parameters, codec flags, filter, block bits, the pre-passes with the dedup
+// average bits, the ldm hash and stride bits and its minimum length as a 32-bit VLQ, and the original length as a
+// 64-bit VLQ.
+static const u64 FRAME_HEADER_LENGTH = 4 + 1 + 1 + 4 + 1 + 1 + 1 + 1 + 1 + 2 + 5 + 10;
+
+// The ldm table size and stride mask are 1 << their bits as an int.
+static const u8 FRAME_MAXIMUM_LDM_BITS = 30;
+
+_API frame_config_t frame_config_init(codec_t codec, filter_t filter, u8 block_bits)
+{
+    if (block_bits < FRAME_MINIMUM_BLOCK_BITS)
+        block_bits = FRAME_MINIMUM_BLOCK_BITS;
+    if (block_bits > FRAME_MAXIMUM_BLOCK_BITS)
+        block_bits = FRAME_MAXIMUM_BLOCK_BITS;
+
+    return (frame_config_t){
+        .codec = codec,
+        .lzss = lzss_config_init(10, 6, 2),
+        .rolz = rolz_config_init(8, 4, 2, 16),
+        .lzb = lzb_config_init(16),
+
+        .filter = filter,
+
+        .dedup = dedup_config_init(12, 0),
+        .ldm = ldm_config_init(20, 64, 4),
+
+        .block_bits = block_bits,
+        .block_length = (u64)1 << block_bits,
+    };
+}
+
+static inline u64 __codec_get_upper_bound(const frame_config_t *config, u64 input_length)
+{
+    switch (config->codec)
+    {
+    case CODEC_LZSS:
+        return lzss_get_upper_bound(input_length);
+    case CODEC_LZB:
+        return lzb_get_upper_bound(input_length);
+    default:
+        return rolz_get_upper_bound(input_length);
+    }
+}
+
+_API u64 frame_get_header_upper_bound(void) { return FRAME_HEADER_LENGTH; }
+
+// Every block is preceded by its 4-byte compressed length.
+_API u64 frame_get_block_upper_bound(frame_config_t config, u64 block_length)
+{
+    return 4 + __codec_get_upper_bound(&config, filter_get_upper_bound(config.filter, block_length));
+}
+
+_API u64 frame_get_upper_bound(frame_config_t config, u64 input_length)
+{
+    u64 block_count = input_length / config.block_length;
+    u64 tail_length = input_length % config.block_length;
+
+    u64 bound = FRAME_HEADER_LENGTH + block_count * frame_get_block_upper_bound(config, config.block_length);
+
+    if (tail_length > 0)
+        bound += frame_get_block_upper_bound(config, tail_length);
+
+    return bound;
+}
+
+static inline error_t __encode_block(const frame_config_t *config, array_t input, array_t *output)
+{
+    switch (config->codec)
+    {
+    case CODEC_LZSS:
+        return lzss_encode(config->lzss, input, output);
+    case CODEC_ROLZ:
+        return rolz_encode(config->rolz, input, output);
+    case CODEC_LZB:
+        return lzb_encode(config->lzb, input, output);
+    default:
+        return ERROR_UNKNOWN_FORMAT;
+    }
+}
+
+static inline error_t __decode_block(const frame_config_t *config, array_t input, array_t *output)
+{
+    switch (config->codec)
+    {
+    case CODEC_LZSS:
+        return lzss_decode(config->lzss, input, output);
+    case CODEC_ROLZ:
+        return rolz_decode(config->rolz, input, output);
+    case CODEC_LZB:
+        return lzb_decode(input, output);
+    default:
+        return ERROR_UNKNOWN_FORMAT;
+    }
+}
+
+static inline error_t __get_block_length(const frame_config_t *config, array_t input, u64 *length)
+{
+    switch (config->codec)
+    {
+    case CODEC_LZSS:
+        return lzss_get_original_length(input, length);
+    case CODEC_ROLZ:
+        return rolz_get_original_length(input, length);
+    case CODEC_LZB:
+        return lzb_get_original_length(input, length);
+    default:
+        return ERROR_UNKNOWN_FORMAT;
+    }
+}
+
+#define try(fn)       \
+    if ((error = fn)) \
+        goto error_exit;
+
+static error_t __read_pre_passes(bit_stream_t *stream, frame_config_t *config)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    u32 pre_passes = 0;
+    try(bit_stream_read_int(stream, &pre_passes, 8));
+
+    if (pre_passes & ~(u32)(FRAME_PRE_PASS_DEDUP | FRAME_PRE_PASS_LDM))
+        return ERROR_UNKNOWN_FORMAT;
+
+    config->pre_passes = (u8)pre_passes;
+
+    if (pre_passes & FRAME_PRE_PASS_DEDUP)
+    {
+        u32 average_bits = 0;
+        try(bit_stream_read_int(stream, &average_bits, 8));
+
+        config->dedup = dedup_config_init((u8)average_bits, 0);
+        if (config->dedup.average_bits != average_bits)
+            return ERROR_UNKNOWN_FORMAT;
+    }
+
+    if (pre_passes & FRAME_PRE_PASS_LDM)
+    {
+        u32 hash_bits = 0, stride_bits = 0, minimum_length = 0;
+        try(bit_stream_read_int(stream, &hash_bits, 8));
+        try(bit_stream_read_int(stream, &stride_bits, 8));
+        try(bit_stream_read_7bit_int32(stream, &minimum_length));
+
+        if (hash_bits > FRAME_MAXIMUM_LDM_BITS || stride_bits > FRAME_MAXIMUM_LDM_BITS)
+            return ERROR_UNKNOWN_FORMAT;
+
+        config->ldm = ldm_config_init((u8)hash_bits, minimum_length, (u8)stride_bits);
+        if (config->ldm.minimum_length != minimum_length)
+            return ERROR_UNKNOWN_FORMAT;
+    }
+
+error_exit:
+    return error;
+}
+
+static error_t __read_header(bit_stream_t *stream, frame_config_t *config, u64 *original_length)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    u32 value = 0;
+
+    for (u32 i = 0; i < sizeof(FRAME_MAGIC); i += 1)
+    {
+        try(bit_stream_read_int(stream, &value, 8));
+        if (value != FRAME_MAGIC[i])
+            return ERROR_UNKNOWN_FORMAT;
+    }
+
+    u32 version = 0;
+    try(bit_stream_read_int(stream, &version, 8));
+    if (version < 1 || version > FRAME_VERSION)
+        return ERROR_UNKNOWN_FORMAT;
+
+    u32 codec = 0, parameters[4] = {0}, flags = 0, filter = 0, block_bits = 0;
+
+    try(bit_stream_read_int(stream, &codec, 8));
+    for (u32 i = 0; i < 4; i += 1)
+        try(bit_stream_read_int(stream, &parameters[i], 8));
+    if (version >= 2)
+        try(bit_stream_read_int(stream, &flags, 8));
+    try(bit_stream_read_int(stream, &filter, 8));
+    try(bit_stream_read_int(stream, &block_bits, 8));
+
+    if ((codec < CODEC_LZSS || codec > CODEC_LZB) || filter >= FILTER_COUNT || block_bits < FRAME_MINIMUM_BLOCK_BITS || block_bits > FRAME_MAXIMUM_BLOCK_BITS)
+        return ERROR_UNKNOWN_FORMAT;
+
+    *config = frame_config_init((codec_t)codec, (filter_t)filter, (u8)block_bits);
+
+    // The config inits clamp their parameters to what the codecs support, so an encoder never wrote one that
+    // changes on the way in.
+    u8 in_range = 1;
+
+    if (codec == CODEC_LZSS)
+    {
+        config->lzss = lzss_config_init(parameters[0], parameters[1], parameters[2]);
+        config->lzss.flags = (u8)flags;
+        in_range = config->lzss.offset_bits == parameters[0] && config->lzss.length_bits == parameters[1] && config->lzss.minimum_length == parameters[2];
+    }
+    else if (codec == CODEC_LZB)
+    {
+        config->lzb = lzb_config_init(parameters[0]);
+        in_range = config->lzb.hash_bits == parameters[0];
+    }
+    else
+    {
+        config->rolz = rolz_config_init(parameters[0], parameters[1], parameters[2], parameters[3]);
+        config->rolz.flags = (u8)flags;
+        in_range = config->rolz.step_bits == parameters[0] && config->rolz.count_bits == parameters[1] && config->rolz.minimum_match == parameters[2] &&
+                   config->rolz.history_buffer_bits == parameters[3];
+    }
+
+    if (!in_range)
+        return ERROR_UNKNOWN_FORMAT;
+
+    if (version >= 3)
+        try(__read_pre_passes(stream, config));
+
+    try(bit_stream_read_7bit_int64(stream, original_length));
+
+error_exit:
+    return error;
+}
+
+static error_t __write_header(bit_stream_t *stream, const frame_config_t *config, u64 input_length)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    for (u32 i = 0; i < sizeof(FRAME_MAGIC); i += 1)
+        try(bit_stream_write_int(stream, FRAME_MAGIC[i], 8));
+
+    try(bit_stream_write_int(stream, FRAME_VERSION, 8));
+    try(bit_stream_write_int(stream, config->codec, 8));
+
+    if (config->codec == CODEC_LZSS)
+    {
+        try(bit_stream_write_int(stream, config->lzss.offset_bits, 8));
+        try(bit_stream_write_int(stream, config->lzss.length_bits, 8));
+        try(bit_stream_write_int(stream, config->lzss.minimum_length, 8));
+        try(bit_stream_write_int(stream, 0, 8));
+    }
+    else if (config->codec == CODEC_LZB)
+    {
+        // The decoder doesn't need the table size, it's there so the frame's configuration can be read back.
+        try(bit_stream_write_int(stream, config->lzb.hash_bits, 8));
+        for (u32 i = 1; i < 4; i += 1)
+            try(bit_stream_write_int(stream, 0, 8));
+    }
+    else
+    {
+        try(bit_stream_write_int(stream, config->rolz.step_bits, 8));
+        try(bit_stream_write_int(stream, config->rolz.count_bits, 8));
+        try(bit_stream_write_int(stream, config->rolz.minimum_match, 8));
+        try(bit_stream_write_int(stream, config->rolz.history_buffer_bits, 8));
+    }
+
+    // LZB has no flags.
+    u8 flags = config->codec == CODEC_LZSS ? config->lzss.flags : config->codec == CODEC_ROLZ ? config->rolz.flags : 0;
+    try(bit_stream_write_int(stream, flags, 8));
+    try(bit_stream_write_int(stream, config->filter, 8));
+    try(bit_stream_write_int(stream, config->block_bits, 8));
+
+    try(bit_stream_write_int(stream, config->pre_passes, 8));
+    if (config->pre_passes & FRAME_PRE_PASS_DEDUP)
+        try(bit_stream_write_int(stream, config->dedup.average_bits, 8));
+    if (config->pre_passes & FRAME_PRE_PASS_LDM)
+    {
+        try(bit_stream_write_int(stream, config->ldm.hash_bits, 8));
+        try(bit_stream_write_int(stream, config->ldm.stride_bits, 8));
+        try(bit_stream_write_7bit_int32(stream, config->ldm.minimum_length));
+    }
+
+    try(bit_stream_write_7bit_int64(stream, input_length));
+
+error_exit:
+    return error;
+}
+
+// Writes the block's compressed length and payload at the stream position. filtered is scratch space for the
+// filter's output, unused without a filter.
+static error_t __write_block(const frame_config_t *config, array_t block, array_t filtered, bit_stream_t *stream)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (config->filter != FILTER_NONE)
+    {
+        try(filter_encode(config->filter, block, &filtered));
+        block = filtered;
+    }
+
+    // Leave room for the compressed length and encode straight into the output.
+    u64 length_position = stream->buffer_position;
+    if (stream->buffer_length - length_position < 4)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    array_t payload = {.bytes = stream->buffer + length_position + 4, .length = stream->buffer_length - length_position - 4};
+    try(__encode_block(config, block, &payload));
+
+    try(bit_stream_write_int(stream, (u32)payload.length, 32));
+    stream->buffer_position += payload.length;
+
+error_exit:
+    return error;
+}
+
+_API error_t frame_encode(frame_config_t config, array_t input, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    // An empty input still gets its header, a frame with no blocks, so every input round-trips.
+    array_t filtered = {0};
+
+    if (config.filter != FILTER_NONE && input.length > 0)
+    {
+        filtered.length = filter_get_upper_bound(config.filter, MIN(config.block_length, input.length));
+        if (!(filtered.bytes = (u8 *)malloc(filtered.length)))
+            return ERROR_COULD_NOT_ALLOCATE;
+    }
+
+    bit_stream_t stream = bit_stream_init(*output);
+
+    try(__write_header(&stream, &config, input.length));
+
+    for (u64 index = 0; index < input.length; index += config.block_length)
+    {
+        array_t block = {.bytes = input.bytes + index, .length = MIN(config.block_length, input.length - index)};
+        try(__write_block(&config, block, filtered, &stream));
+    }
+
+    goto no_error_exit;
+
+error_exit:
+    free(filtered.bytes);
+    output->length = 0;
+    return error;
+
+no_error_exit:
+    free(filtered.bytes);
+    output->length = stream.buffer_position;
+    return error;
+}
+
+_API error_t frame_write_header(frame_config_t config, u64 input_length, array_t *output)
+{
+    bit_stream_t stream = bit_stream_init(*output);
+
+    error_t error = __write_header(&stream, &config, input_length);
+
+    output->length = error ? 0 : stream.buffer_position;
+    return error;
+}
+
+_API error_t frame_encode_block(frame_config_t config, array_t block, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (block.length == 0 || block.length > config.block_length)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    array_t filtered = {0};
+
+    if (config.filter != FILTER_NONE)
+    {
+        filtered.length = filter_get_upper_bound(config.filter, block.length);
+        if (!(filtered.bytes = (u8 *)malloc(filtered.length)))
+            return ERROR_COULD_NOT_ALLOCATE;
+    }
+
+    bit_stream_t stream = bit_stream_init(*output);
+
+    error = __write_block(&config, block, filtered, &stream);
+
+    free(filtered.bytes);
+    output->length = error ? 0 : stream.buffer_position;
+    return error;
+}
+
+// Moves the stream past the block's payload, which it returns.
+static error_t __next_payload(bit_stream_t *stream, array_t *payload)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    u32 payload_length = 0;
+    if ((error = bit_stream_read_int(stream, &payload_length, 32)))
+        return error;
+
+    if (payload_length > stream->buffer_length - stream->buffer_position)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    *payload = (array_t){.bytes = stream->buffer + stream->buffer_position, .length = payload_length};
+    stream->buffer_position += payload_length;
+
+    return error;
+}
+
+// Frames can be back to back, e.g. from encoders streaming an input whose length they don't know, so the length
+// is the sum of all of them.
+_API error_t frame_get_original_length(array_t input, u64 *original_length)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    bit_stream_t stream = bit_stream_init(input);
+    *original_length = 0;
+
+    u8 pre_passes = 0;
+    u64 frame_count = 0;
+
+    do
+    {
+        frame_config_t config;
+        u64 length = 0;
+        try(__read_header(&stream, &config, &length));
+
+        *original_length += length;
+        pre_passes |= config.pre_passes;
+        frame_count += 1;
+
+        // Only the block lengths are needed to find the next frame.
+        for (u64 index = 0; index < length; index += config.block_length)
+        {
+            array_t payload;
+            try(__next_payload(&stream, &payload));
+        }
+    } while (stream.buffer_position < stream.buffer_length);
+
+    // Pre-passes are undone over the whole output, which only works if it's a single frame's.
+    if (pre_passes && frame_count > 1)
+    {
+        error = ERROR_UNKNOWN_FORMAT;
+        goto error_exit;
+    }
+
+    return error;
+
+error_exit:
+    *original_length = 0;
+    return error;
+}
+
+_API error_t frame_read_config(array_t input, frame_config_t *config)
+{
+    bit_stream_t stream = bit_stream_init(input);
+    u64 original_length = 0;
+
+    return __read_header(&stream, config, &original_length);
+}
+
+// Decodes a block's payload into block, which must be the block's original length. filtered is scratch space for
+// the filter's input, unused without a filter.
+static error_t __read_block(const frame_config_t *config, array_t payload, array_t filtered, array_t *block)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (config->filter == FILTER_NONE)
+        return __decode_block(config, payload, block);
+
+    array_t filtered_block = {.bytes = filtered.bytes};
+    try(__get_block_length(config, payload, &filtered_block.length));
+
+    if (filtered_block.length > filtered.length)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    try(__decode_block(config, payload, &filtered_block));
+    try(filter_decode(config->filter, filtered_block, block));
+
+error_exit:
+    return error;
+}
+
+// Decodes the blocks of the frame whose header was just read, output being exactly its original length.
+static error_t __decode_frame(const frame_config_t *config, bit_stream_t *stream, array_t output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    array_t filtered = {0};
+
+    if (config->filter != FILTER_NONE && output.length > 0)
+    {
+        filtered.length = filter_get_upper_bound(config->filter, MIN(config->block_length, output.length));
+        if (!(filtered.bytes = (u8 *)malloc(filtered.length)))
+            return ERROR_COULD_NOT_ALLOCATE;
+    }
+
+    for (u64 index = 0; index < output.length; index += config->block_length)
+    {
+        array_t block = {.bytes = output.bytes + index, .length = MIN(config->block_length, output.length - index)};
+
+        array_t payload;
+        try(__next_payload(stream, &payload));
+        try(__read_block(config, payload, filtered, &block));
+    }
+
+error_exit:
+    free(filtered.bytes);
+    return error;
+}
+
+_API error_t frame_decode(array_t input, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    // Frames of an empty input have no blocks, so the output can be empty, but there has to be a header.
+    if (input.length == 0)
+        return ERROR_NO_OP;
+
+    bit_stream_t stream = bit_stream_init(input);
+    u64 index = 0;
+
+    u8 pre_passes = 0;
+    u64 frame_count = 0;
+
+    // Every frame decodes right after the previous one.
+    do
+    {
+        frame_config_t config;
+        u64 original_length = 0;
+
+        if ((error = __read_header(&stream, &config, &original_length)))
+            return error;
+
+        pre_passes |= config.pre_passes;
+        frame_count += 1;
+
+        if (pre_passes && frame_count > 1)
+            return ERROR_UNKNOWN_FORMAT;
+
+        if (original_length > output->length - index)
+            return ERROR_WRONG_OUTPUT_SIZE;
+
+        if ((error = __decode_frame(&config, &stream, (array_t){.bytes = output->bytes + index, .length = original_length})))
+            return error;
+
+        index += original_length;
+    } while (stream.buffer_position < stream.buffer_length);
+
+    return index == output->length ? ERROR_ALL_GOOD : ERROR_WRONG_OUTPUT_SIZE;
+}
+
+_API error_t frame_read_header(array_t input, frame_config_t *config, u64 *original_length, u64 *header_length)
+{
+    bit_stream_t stream = bit_stream_init(input);
+
+    error_t error = __read_header(&stream, config, original_length);
+
+    *header_length = error ? 0 : stream.buffer_position;
+    return error;
+}
+
+_API error_t frame_decode_block(frame_config_t config, array_t payload, array_t *block)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (payload.length == 0 || block->length == 0 || block->length > config.block_length)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    array_t filtered = {0};
+
+    if (config.filter != FILTER_NONE)
+    {
+        filtered.length = filter_get_upper_bound(config.filter, block->length);
+        if (!(filtered.bytes = (u8 *)malloc(filtered.length)))
+            return ERROR_COULD_NOT_ALLOCATE;
+    }
+
+    error = __read_block(&config, payload, filtered, block);
+
+    free(filtered.bytes);
+    return error;
+}
+
+#undef try
@@ -2,11 +2,11 @@
 
 static const u32 ADLER_32_MOD = 65521;
 
-u32 jenkins32(array_t buffer)
+_API u32 jenkins32(array_t buffer)
 {
     u32 hash = 0;
 
-    for (u32 i = 0; i < buffer.length; i += 1)
+    for (u64 i = 0; i < buffer.length; i += 1)
     {
         hash += buffer.bytes[i];
         hash += hash << 10;
@@ -20,12 +20,12 @@ u32 jenkins32(array_t buffer)
     return hash;
 }
 
-u32 adler32(array_t buffer)
+_API u32 adler32(array_t buffer)
 {
     u32 a = 1;
     u32 b = 0;
 
-    for (u32 i = 0; i < buffer.length; i += 1)
+    for (u64 i = 0; i < buffer.length; i += 1)
     {
         a = (a + buffer.bytes[i]) % ADLER_32_MOD;
         b = (b + a) % ADLER_32_MOD;
@@ -34,13 +34,13 @@ u32 adler32(array_t buffer)
     return (b << 16) | a;
 }
 
-u32 hash_bytes(array_t buffer)
+_API u32 hash_bytes(array_t buffer)
 {
     u32 a = 1; // Part of adler32
     u32 b = 0; // Part of adler32
     u32 j = 0; // Hash accumulator for jenkins32
 
-    for (u32 i = 0; i < buffer.length; i += 1)
+    for (u64 i = 0; i < buffer.length; i += 1)
     {
         // Read one byte from the buffer.
         const u8 byte = buffer.bytes[i];
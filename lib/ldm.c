@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <ldm.h>
+#include "bit_stream.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+// Multiplier for the polynomial rolling hash. Any large odd constant works.
+static const u64 LDM_HASH_PRIME = 0x9E3779B185EBCA87ULL;
+
+// A match must save more than the three 64-bit VLQs (30 bytes) it costs, so we never go below this.
+static const u32 LDM_MINIMUM_LENGTH = 32;
+
+typedef struct ldm_entry_t
+{
+    u64 position;
+    u32 check;
+} ldm_entry_t;
+
+_API ldm_config_t ldm_config_init(u8 hash_bits, u32 minimum_length, u8 stride_bits)
+{
+    return (ldm_config_t){
+        .hash_bits = hash_bits,
+        .table_size = 1 << hash_bits,
+
+        .minimum_length = MAX(minimum_length, LDM_MINIMUM_LENGTH),
+
+        .stride_bits = stride_bits,
+        .stride_mask = (1 << stride_bits) - 1,
+    };
+}
+
+_API u64 ldm_get_upper_bound(u64 input_length)
+{
+    // Every match costs less than it saves, so the worst case is all literals:
+    // 10 bytes for the original length, 10 for the single literal run length and the bytes themselves.
+    return 20 + input_length;
+}
+
+_API error_t ldm_get_original_length(array_t input, u64 *original_length)
+{
+    bit_stream_t stream = bit_stream_init(input);
+
+    u64 length = 0;
+    error_t error = bit_stream_read_7bit_int64(&stream, &length);
+
+    if (error)
+    {
+        *original_length = 0;
+        return error;
+    }
+
+    *original_length = length;
+    return error;
+}
+
+static inline u64 __hash_window(const u8 *bytes, u32 length)
+{
+    u64 hash = 0;
+
+    for (u32 i = 0; i < length; i += 1)
+        hash = hash * LDM_HASH_PRIME + bytes[i] + 1;
+
+    return hash;
+}
+
+#define try(fn)       \
+    if ((error = fn)) \
+        goto error_exit;
+
+_API error_t ldm_encode(ldm_config_t config, array_t input, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    // If there are no input bytes, we don't have to do anything.
+    if (input.length == 0)
+        return ERROR_NO_OP;
+
+    ldm_entry_t *table = (ldm_entry_t *)calloc(config.table_size, sizeof(ldm_entry_t));
+
+    if (table == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    const u32 window = config.minimum_length;
+    const u8 bucket_shift = 64 - config.hash_bits;
+    const u8 sample_shift = bucket_shift - config.stride_bits;
+
+    // Factor of the byte leaving the window: LDM_HASH_PRIME ^ window.
+    u64 remove_factor = 1;
+    for (u32 i = 0; i < window; i += 1)
+        remove_factor *= LDM_HASH_PRIME;
+
+    bit_stream_t stream = bit_stream_init(*output);
+
+    try(bit_stream_write_7bit_int64(&stream, input.length));
+
+    // Start of the literals that haven't been written yet.
+    u64 anchor = 0;
+
+    if (input.length >= window)
+    {
+        // Last byte of the hashed window, the window spans [end - window + 1, end].
+        u64 end = window - 1;
+        u64 hash = __hash_window(input.bytes, window);
+
+        while (1)
+        {
+            // Only sample positions whose hash has the stride bits cleared. Since the choice depends on content only,
+            // both copies of a repeat are sampled at the same spots and we don't need to look at every position.
+            if (((hash >> sample_shift) & config.stride_mask) == 0)
+            {
+                u64 start = end - window + 1;
+                ldm_entry_t *entry = &table[hash >> bucket_shift];
+
+                if (entry->check == (u32)hash && entry->position + window <= start && memcmp(input.bytes + entry->position, input.bytes + start, window) == 0)
+                {
+                    u64 candidate = entry->position;
+
+                    // Extend the match backwards into the pending literals...
+                    while (start > anchor && candidate > 0 && input.bytes[start - 1] == input.bytes[candidate - 1])
+                    {
+                        start -= 1;
+                        candidate -= 1;
+                    }
+
+                    // ...and forwards as far as it goes.
+                    u64 length = end + 1 - start;
+                    while (start + length < input.length && input.bytes[candidate + length] == input.bytes[start + length])
+                        length += 1;
+
+                    try(bit_stream_write_7bit_int64(&stream, start - anchor));
+                    try(bit_stream_write_bytes(&stream, input.bytes + anchor, start - anchor));
+                    try(bit_stream_write_7bit_int64(&stream, length));
+                    try(bit_stream_write_7bit_int64(&stream, start - candidate));
+
+                    entry->position = end + 1 - window;
+                    anchor = start + length;
+
+                    // Restart the rolling hash right after the match.
+                    if (anchor + window > input.length)
+                        break;
+
+                    end = anchor + window - 1;
+                    hash = __hash_window(input.bytes + anchor, window);
+                    continue;
+                }
+
+                *entry = (ldm_entry_t){.position = start, .check = (u32)hash};
+            }
+
+            end += 1;
+            if (end >= input.length)
+                break;
+
+            // Roll the window one byte forward.
+            hash = hash * LDM_HASH_PRIME + input.bytes[end] + 1 - (input.bytes[end - window] + 1) * remove_factor;
+        }
+    }
+
+    // Trailing literals, which may be the whole input if nothing was found.
+    try(bit_stream_write_7bit_int64(&stream, input.length - anchor));
+    try(bit_stream_write_bytes(&stream, input.bytes + anchor, input.length - anchor));
+
+    goto no_error_exit;
+
+error_exit:
+    free(table);
+    output->length = 0;
+    return error;
+
+no_error_exit:
+    free(table);
+    output->length = stream.buffer_position;
+    return error;
+}
+
+_API error_t ldm_decode(ldm_config_t config, array_t input, array_t *output)
+{
+    (void)config; // Matches carry their own lengths and offsets, the config only affects the encoder.
+
+    error_t error = ERROR_ALL_GOOD;
+
+    if (input.length == 0 || output->length == 0)
+        return ERROR_NO_OP;
+
+    bit_stream_t stream = bit_stream_init(input);
+
+    u64 original_size = 0;
+    try(bit_stream_read_7bit_int64(&stream, &original_size));
+
+    if (original_size != output->length)
+        return ERROR_WRONG_OUTPUT_SIZE;
+
+    u64 index = 0;
+
+    while (1)
+    {
+        u64 literal_length = 0;
+        try(bit_stream_read_7bit_int64(&stream, &literal_length));
+
+        if (literal_length > output->length - index)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        try(bit_stream_read_bytes(&stream, output->bytes + index, literal_length));
+        index += literal_length;
+
+        if (index == output->length)
+            break;
+
+        u64 length = 0, offset = 0;
+        try(bit_stream_read_7bit_int64(&stream, &length));
+        try(bit_stream_read_7bit_int64(&stream, &offset));
+
+        if (offset == 0 || offset > index || length > output->length - index)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        // Matches may overlap their own output, so copy forwards byte by byte when they do.
+        if (offset >= length)
+            memcpy(output->bytes + index, output->bytes + index - offset, length);
+        else
+            for (u64 i = 0; i < length; i += 1)
+                output->bytes[index + i] = output->bytes[index - offset + i];
+
+        index += length;
+    }
+
+error_exit:
+    return error;
+}
+
+#undef try
@@ -0,0 +1,483 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <lzb.h>
+#include "bit_stream.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+// A match covers at least the 4 bytes that got hashed, and reaches back 64KB at most.
+#define LZB_MINIMUM_MATCH 4
+#define LZB_MAX_OFFSET 65535
+#define LZB_NIBBLE_MAX 15
+
+// Wide copies move this many bytes at once, so they can write up to one less past what they need.
+#define LZB_WIDE_COPY 16
+
+// The encoder skips ahead faster after every (1 << LZB_SKIP_SHIFT) misses in a row, so incompressible data doesn't
+// get hashed byte by byte.
+#define LZB_SKIP_SHIFT 6
+
+static const u8 LZB_MINIMUM_HASH_BITS = 10;
+static const u8 LZB_MAXIMUM_HASH_BITS = 20;
+
+_API lzb_config_t lzb_config_init(u8 hash_bits)
+{
+    if (hash_bits < LZB_MINIMUM_HASH_BITS)
+        hash_bits = LZB_MINIMUM_HASH_BITS;
+    if (hash_bits > LZB_MAXIMUM_HASH_BITS)
+        hash_bits = LZB_MAXIMUM_HASH_BITS;
+
+    return (lzb_config_t){.hash_bits = hash_bits};
+}
+
+_API u64 lzb_get_upper_bound(u64 input_length)
+{
+    // 10 bytes for the original length (a 64-bit VLQ), then all literals: a token and a byte every 255 of them. A
+    // match never costs more than the literals it replaces, its token and offset take 3 bytes for 4 at least.
+    return 10 + input_length + input_length / 255 + 16;
+}
+
+_API error_t lzb_get_original_length(array_t input, u64 *original_length)
+{
+    bit_stream_t stream = bit_stream_init(input);
+
+    u64 length = 0;
+    error_t error = bit_stream_read_7bit_int64(&stream, &length);
+
+    if (error)
+    {
+        *original_length = 0;
+        return error;
+    }
+
+    *original_length = length;
+    return error;
+}
+
+static ALWAYS_INLINE u32 __read32(const u8 *bytes)
+{
+    u32 value = 0;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+// Multiplicative hashing, the top bits are the best mixed ones.
+static ALWAYS_INLINE u32 __hash(u32 sequence, u8 hash_bits) { return (sequence * 2654435761u) >> (32 - hash_bits); }
+
+// Equal bytes from a and b on, up to limit. Eight at a time where the first different byte can be found from the
+// lowest set bit of the xor, which needs little endian loads.
+static ALWAYS_INLINE u64 __count_equal(const u8 *a, const u8 *b, u64 limit)
+{
+    u64 count = 0;
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (count + 8 <= limit)
+    {
+        u64 x = 0, y = 0;
+        memcpy(&x, a + count, sizeof(x));
+        memcpy(&y, b + count, sizeof(y));
+
+        if (x != y)
+            return count + (__builtin_ctzll(x ^ y) >> 3);
+
+        count += 8;
+    }
+#endif
+
+    while (count < limit && a[count] == b[count])
+        count += 1;
+
+    return count;
+}
+
+// What doesn't fit the nibble goes in bytes of 255 and a last one under it.
+static ALWAYS_INLINE u8 *__write_count(u8 *out, u64 count)
+{
+    for (; count >= 255; count -= 255)
+        *out++ = 255;
+
+    *out++ = (u8)count;
+    return out;
+}
+
+// The literals up to the match, then the match, which the last sequence doesn't have (match_length 0).
+static ALWAYS_INLINE error_t __write_sequence(u8 **out, const u8 *out_end, const u8 *literals, u64 literal_count, u32 offset, u64 match_length)
+{
+    // Token, both counts' extra bytes, the literals and the offset.
+    if ((u64)(out_end - *out) < 1 + (literal_count / 255 + 1) + literal_count + 2 + (match_length / 255 + 1))
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    u8 *token = *out;
+    u8 *o = token + 1;
+
+    *token = (u8)(MIN(literal_count, LZB_NIBBLE_MAX) << 4);
+    if (literal_count >= LZB_NIBBLE_MAX)
+        o = __write_count(o, literal_count - LZB_NIBBLE_MAX);
+
+    memcpy(o, literals, literal_count);
+    o += literal_count;
+
+    if (match_length > 0)
+    {
+        o[0] = (u8)offset;
+        o[1] = (u8)(offset >> 8);
+        o += 2;
+
+        u64 length = match_length - LZB_MINIMUM_MATCH;
+
+        *token |= (u8)MIN(length, LZB_NIBBLE_MAX);
+        if (length >= LZB_NIBBLE_MAX)
+            o = __write_count(o, length - LZB_NIBBLE_MAX);
+    }
+
+    *out = o;
+    return ERROR_ALL_GOOD;
+}
+
+#define try(fn)       \
+    if ((error = fn)) \
+        goto error_exit;
+
+// Sequences lzb_parse starts with, the buffer doubles from there.
+#define LZB_SEQUENCE_CHUNK 4096
+
+// Where a parse stopped, so it can pick up from there once the sequences so far have been written. Positions are
+// stored in 32 bits. Every candidate gets its distance checked and its bytes compared anyway, so on inputs over 4GB
+// wrapping around only loses matches.
+typedef struct parser_t
+{
+    u64 index;
+    u64 anchor; // Where the literals not in a sequence yet start.
+    u32 misses;
+    u32 *table;
+} parser_t;
+
+// The back end's side: where it is in the input, and where the literals it hasn't written yet start.
+typedef struct coder_t
+{
+    u64 position;
+    u64 anchor;
+
+    u8 *out;
+    const u8 *out_end;
+} coder_t;
+
+// Parses until the input ends or the buffer is full. With coder every sequence is written as soon as it's found
+// instead, which is what lzb_encode does: this parse is cheap enough that going through a buffer shows.
+static ALWAYS_INLINE error_t __parse(u8 hash_bits, array_t input, parser_t *parser, sequence_buffer_t *sequences, coder_t *coder)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    const u8 *bytes = input.bytes;
+    u32 *table = parser->table;
+
+    u64 anchor = parser->anchor, index = parser->index;
+    u32 misses = parser->misses;
+
+    while (index + LZB_MINIMUM_MATCH <= input.length && (coder || sequences->count < sequences->capacity))
+    {
+        u32 sequence = __read32(bytes + index);
+        u32 *slot = table + __hash(sequence, hash_bits);
+        u32 distance = (u32)index - *slot;
+        *slot = (u32)index;
+
+        if (distance == 0 || distance > LZB_MAX_OFFSET || distance > index || __read32(bytes + index - distance) != sequence)
+        {
+            index += 1 + (misses++ >> LZB_SKIP_SHIFT);
+            continue;
+        }
+
+        // The match may start earlier, over literals we haven't written yet.
+        u64 start = index;
+        while (start > anchor && start > distance && bytes[start - 1] == bytes[start - 1 - distance])
+            start -= 1;
+
+        // Lengths are 32 bits in a sequence, longer repeats take a few matches.
+        u64 end = index + LZB_MINIMUM_MATCH;
+        end += __count_equal(bytes + end, bytes + end - distance, MIN(input.length - end, UINT32_MAX - (end - start)));
+
+        if (coder == NULL)
+        {
+            sequence_buffer_add_literals(sequences, start - anchor);
+            sequence_buffer_add_match(sequences, (u32)(end - start), distance);
+        }
+        else if ((error = __write_sequence(&coder->out, coder->out_end, bytes + anchor, start - anchor, distance, end - start)))
+            return error;
+
+        // Hashing a position near the end of the match is almost free and finds the next one more often.
+        if (end - 2 + LZB_MINIMUM_MATCH <= input.length)
+            table[__hash(__read32(bytes + end - 2), hash_bits)] = (u32)(end - 2);
+
+        anchor = index = end;
+        misses = 0;
+    }
+
+    // Too close to the end for another match, so the rest are literals.
+    if (index + LZB_MINIMUM_MATCH > input.length)
+    {
+        if (coder == NULL)
+            sequence_buffer_add_literals(sequences, input.length - anchor);
+        else if (anchor < input.length && (error = __write_sequence(&coder->out, coder->out_end, bytes + anchor, input.length - anchor, 0, 0)))
+            return error;
+
+        anchor = index = input.length;
+    }
+
+    parser->anchor = anchor;
+    parser->index = index;
+    parser->misses = misses;
+
+    if (coder)
+        coder->position = coder->anchor = index;
+
+    return error;
+}
+
+// Matches the format can't hold, shorter than the minimum or further than 64KB, go out as literals.
+static inline error_t __write_sequences(array_t input, const sequence_buffer_t *sequences, coder_t *coder)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    for (u64 i = 0; i < sequences->count; i += 1)
+    {
+        const sequence_t *sequence = &sequences->sequences[i];
+
+        if (sequence->literal_count > input.length - coder->position || sequence->match_length > input.length - coder->position - sequence->literal_count)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        coder->position += sequence->literal_count;
+
+        if (sequence->match_length < LZB_MINIMUM_MATCH || sequence->offset > LZB_MAX_OFFSET)
+        {
+            coder->position += sequence->match_length;
+            continue;
+        }
+
+        if (sequence->offset == 0 || sequence->offset > coder->position)
+            return ERROR_UNKNOWN_FORMAT;
+
+        const u64 literal_count = coder->position - coder->anchor;
+        if ((error = __write_sequence(&coder->out, coder->out_end, input.bytes + coder->anchor, literal_count, sequence->offset, sequence->match_length)))
+            return error;
+
+        coder->position += sequence->match_length;
+        coder->anchor = coder->position;
+    }
+
+    if (sequences->literal_count > input.length - coder->position)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    coder->position += sequences->literal_count;
+
+    if (coder->anchor < coder->position)
+        error = __write_sequence(&coder->out, coder->out_end, input.bytes + coder->anchor, coder->position - coder->anchor, 0, 0);
+
+    coder->anchor = coder->position;
+    return error;
+}
+
+// Writes the original length and sets the coder up right after it.
+static inline error_t __coder_init(array_t input, array_t *output, coder_t *coder)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    bit_stream_t stream = bit_stream_init(*output);
+    if ((error = bit_stream_write_7bit_int64(&stream, input.length)))
+        return error;
+
+    *coder = (coder_t){.position = 0, .anchor = 0, .out = output->bytes + stream.buffer_position, .out_end = output->bytes + output->length};
+    return error;
+}
+
+_API error_t lzb_encode(lzb_config_t config, array_t input, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (input.length == 0)
+        return ERROR_NO_OP;
+
+    parser_t parser = {.index = 0, .anchor = 0, .misses = 0, .table = (u32 *)calloc((u64)1 << config.hash_bits, sizeof(u32))};
+    if (parser.table == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    coder_t coder;
+    try(__coder_init(input, output, &coder));
+    try(__parse(config.hash_bits, input, &parser, NULL, &coder));
+
+    goto no_error_exit;
+
+error_exit:
+    free(parser.table);
+    output->length = 0;
+    return error;
+
+no_error_exit:
+    free(parser.table);
+    output->length = (u64)(coder.out - output->bytes);
+    return error;
+}
+
+_API error_t lzb_parse(lzb_config_t config, array_t input, sequence_buffer_t *sequences)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    sequence_buffer_reset(sequences);
+
+    if (input.length == 0)
+        return ERROR_NO_OP;
+
+    parser_t parser = {.index = 0, .anchor = 0, .misses = 0, .table = (u32 *)calloc((u64)1 << config.hash_bits, sizeof(u32))};
+    if (parser.table == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    while (parser.index < input.length && !error)
+    {
+        if (sequences->count == sequences->capacity && (error = sequence_buffer_reserve(sequences, MAX(LZB_SEQUENCE_CHUNK, sequences->capacity * 2))))
+            break;
+
+        error = __parse(config.hash_bits, input, &parser, sequences, NULL);
+    }
+
+    free(parser.table);
+    return error;
+}
+
+_API error_t lzb_encode_sequences(array_t input, const sequence_buffer_t *sequences, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (input.length == 0)
+        return ERROR_NO_OP;
+
+    coder_t coder;
+    try(__coder_init(input, output, &coder));
+    try(__write_sequences(input, sequences, &coder));
+
+    if (coder.position != input.length)
+    {
+        error = ERROR_UNKNOWN_FORMAT;
+        goto error_exit;
+    }
+
+    output->length = (u64)(coder.out - output->bytes);
+    return error;
+
+error_exit:
+    output->length = 0;
+    return error;
+}
+
+static ALWAYS_INLINE error_t __read_count(const u8 **in, const u8 *in_end, u64 *count)
+{
+    u8 byte = 0;
+
+    do
+    {
+        if (*in >= in_end)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        byte = *(*in)++;
+        *count += byte;
+    } while (byte == 255);
+
+    return ERROR_ALL_GOOD;
+}
+
+// Copies whole chunks until length is covered, so it writes up to chunk - 1 bytes too many, and reads as many past
+// src + length. Overlapping copies are fine as long as dst - src is at least a chunk.
+static ALWAYS_INLINE void __wide_copy(u8 *dst, const u8 *src, u64 length, const u64 chunk)
+{
+    for (u64 copied = 0; copied < length; copied += chunk)
+        memcpy(dst + copied, src + copied, chunk);
+}
+
+// Every count is checked against both buffers before copying, which is all a corrupt input can get wrong.
+_API error_t lzb_decode(array_t input, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (input.length == 0 || output->length == 0)
+        return ERROR_NO_OP;
+
+    bit_stream_t stream = bit_stream_init(input);
+
+    u64 original_length = 0;
+    if ((error = bit_stream_read_7bit_int64(&stream, &original_length)))
+        return error;
+
+    if (original_length != output->length)
+        return ERROR_WRONG_OUTPUT_SIZE;
+
+    const u8 *in = input.bytes + stream.buffer_position;
+    const u8 *const in_end = input.bytes + input.length;
+    u8 *out = output->bytes;
+    u8 *const out_end = output->bytes + output->length;
+
+    while (1)
+    {
+        if (in >= in_end)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        const u8 token = *in++;
+
+        u64 literal_count = token >> 4;
+        if (literal_count == LZB_NIBBLE_MAX && (error = __read_count(&in, in_end, &literal_count)))
+            return error;
+
+        if (literal_count > (u64)(out_end - out) || literal_count > (u64)(in_end - in))
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        // Away from the ends of both buffers the literals take wide copies, close to them an exact one.
+        if ((u64)(out_end - out) - literal_count >= LZB_WIDE_COPY && (u64)(in_end - in) - literal_count >= LZB_WIDE_COPY)
+            __wide_copy(out, in, literal_count, LZB_WIDE_COPY);
+        else
+            memcpy(out, in, literal_count);
+
+        out += literal_count;
+        in += literal_count;
+
+        if (out == out_end)
+            break;
+
+        if (in_end - in < 2)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        const u64 offset = in[0] | ((u64)in[1] << 8);
+        in += 2;
+
+        u64 match_length = token & LZB_NIBBLE_MAX;
+        if (match_length == LZB_NIBBLE_MAX && (error = __read_count(&in, in_end, &match_length)))
+            return error;
+
+        match_length += LZB_MINIMUM_MATCH;
+
+        if (offset == 0 || offset > (u64)(out - output->bytes) || match_length > (u64)(out_end - out))
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        // Wide copies need the match at least a chunk behind, runs of a single byte are a memset, and other short
+        // distances repeat byte by byte.
+        const u8 *match = out - offset;
+        const u64 room = (u64)(out_end - out) - match_length;
+
+        if (offset >= LZB_WIDE_COPY && room >= LZB_WIDE_COPY)
+            __wide_copy(out, match, match_length, LZB_WIDE_COPY);
+        else if (offset >= 8 && room >= 8)
+            __wide_copy(out, match, match_length, 8);
+        else if (offset == 1)
+            memset(out, *match, match_length);
+        else
+            for (u64 i = 0; i < match_length; i += 1)
+                out[i] = match[i];
+
+        out += match_length;
+
+        if (out == out_end)
+            break;
+    }
+
+    return error;
+}
+
+#undef try
@@ -1,10 +1,29 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include <lzss.h>
 #include "bit_stream.h"
+#include "fragments.h"
+#include "match_ring.h"
+#include "split_stream.h"
+#include "vlc.h"
 
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+// Flags that store the tokens in split streams instead of a single bit stream.
+#define LZSS_SPLIT_LAYOUTS (LZSS_FLAG_SPLIT_STREAMS | LZSS_FLAG_LITERAL_RUNS)
+
+// The fields have to fit a shift of an int, and longer windows only slow the search down.
+static const u8 LZSS_MAXIMUM_OFFSET_BITS = 24;
+static const u8 LZSS_MAXIMUM_LENGTH_BITS = 16;
 
 _API lzss_config_t lzss_config_init(u8 offset_bits, u8 length_bits, u8 minimum_length)
 {
+    offset_bits = MAX(1, MIN(offset_bits, LZSS_MAXIMUM_OFFSET_BITS));
+    length_bits = MAX(1, MIN(length_bits, LZSS_MAXIMUM_LENGTH_BITS));
+    minimum_length = MAX(1, minimum_length);
+
     return (lzss_config_t){
 
         .offset_bits = offset_bits,
@@ -13,24 +32,28 @@ _API lzss_config_t lzss_config_init(u8 offset_bits, u8 length_bits, u8 minimum_l
         .minimum_length = minimum_length,
         .length_bits = length_bits,
         .max_length = (1 << length_bits) - 1,
+
+        .flags = 0,
+        .match_threads = 0,
     };
 }
 
-_API u32 lzss_get_upper_bound(u32 input_length)
+_API u64 lzss_get_upper_bound(u64 input_length)
 {
-    // We sum all bits in the worst case scenario: 32 for the total input length and input_lenght * 9 (literal flag + byte)
-    u32 total_bits = 32 + input_length * 9;
+    // We sum all bits in the worst case scenario: 80 for the total input length (a 64-bit VLQ) and input_lenght * 9 (literal flag + byte)
+    u64 total_bits = 80 + input_length * 9;
 
     // If it's divisible by 8, we return the length. If not we sum 1 to account for the extra bits.
-    return (total_bits / 8) + ((total_bits % 8 > 0) ? 1 : 0);
+    // The split streams variant adds its stream lengths and padding on top.
+    return (total_bits / 8) + ((total_bits % 8 > 0) ? 1 : 0) + SPLIT_STREAM_OVERHEAD;
 }
 
-_API error_t lzss_get_original_length(array_t input, u32 *original_length)
+_API error_t lzss_get_original_length(array_t input, u64 *original_length)
 {
     bit_stream_t stream = bit_stream_init(input);
 
-    u32 length = 0;
-    error_t error = bit_stream_read_7bit_int32(&stream, &length);
+    u64 length = 0;
+    error_t error = bit_stream_read_7bit_int64(&stream, &length);
 
     if (error)
     {
@@ -42,128 +65,799 @@ _API error_t lzss_get_original_length(array_t input, u32 *original_length)
     return error;
 }
 
+// Number of recent offsets kept with LZSS_FLAG_REP_OFFSETS, and the rep of matches that use a new offset.
+#define REP_COUNT 3
+#define NO_REP REP_COUNT
+
 typedef struct match_t
 {
     u32 offset;
     u32 length;
+    u32 rep;     // Index of the recent offset this match reuses, NO_REP otherwise.
+    u8 prefixed; // Whether the recent offsets get the prefix codes, see __rep_offsets_prefixed.
 } match_t;
 
-static inline match_t __get_longest_match(lzss_config_t config, array_t input, u32 index)
+// Most recent first. Encoder and decoder start from the same made up offsets and update them the same way.
+typedef struct rep_offsets_t
+{
+    u32 offsets[REP_COUNT];
+    u32 history; // A bit per recent match, set when it reused one of the offsets.
+} rep_offsets_t;
+
+// Out of the last 16 matches, how many have to reuse an offset for the prefix codes to pay for their extra bit.
+#define REP_PREFIX_HITS 4
+
+static inline rep_offsets_t __rep_offsets_init(void) { return (rep_offsets_t){.offsets = {1, 2, 3}, .history = 0}; }
+
+// Recent offsets get coded one of two ways, picked from how often the last matches reused them, which the decoder
+// knows as well. Prefixed: 10, 110 and 111, and new offsets are a 0 and the offset. Otherwise new offsets are written
+// as they are, and the offset 0, which no match uses, is followed by a 0, 10 or 11. That's dearer than the offset
+// itself, so the encoder only uses the prefix codes, and data that rarely repeats a distance pays nothing for them.
+static inline u8 __rep_offsets_prefixed(const rep_offsets_t *reps) { return __builtin_popcount(reps->history & 0xFFFF) >= REP_PREFIX_HITS; }
+
+// The used offset moves to the front, new ones push the oldest out. Whether the match reused an offset goes by its
+// value, not by how it was coded.
+static inline void __rep_offsets_update(rep_offsets_t *reps, u32 offset)
+{
+    u32 rep = 0;
+    while (rep < REP_COUNT && reps->offsets[rep] != offset)
+        rep += 1;
+
+    for (u32 i = rep == NO_REP ? REP_COUNT - 1 : rep; i > 0; i -= 1)
+        reps->offsets[i] = reps->offsets[i - 1];
+
+    reps->offsets[0] = offset;
+    reps->history = (reps->history << 1) | (rep != NO_REP);
+}
+
+// With LZSS_FLAG_LONG_MATCHES, the longest match the encoder takes, another one follows past it. The rest of the
+// length after max_length takes an Exp-Golomb code of this order.
+#define LZSS_LONG_MATCH_LIMIT ((u32)1 << 16)
+#define LZSS_LONG_MATCH_GOLOMB_ORDER 4
+
+// Runs of a byte at least this long (or as long as a match gets) are taken without searching the window.
+#define LZSS_RUN_MINIMUM 32
+
+static ALWAYS_INLINE u32 __longest_match(lzss_config_t config)
+{
+    return (config.flags & LZSS_FLAG_LONG_MATCHES) ? MAX(LZSS_LONG_MATCH_LIMIT, config.max_length) : config.max_length;
+}
+
+// Where the run of equal bytes holding position ends. Searches only go forward, so the end found last time holds as
+// long as position is before it, and a run gets scanned once instead of once for every position in it.
+static ALWAYS_INLINE u64 __run_end(array_t input, fragments_t *gather, u64 position, u64 *run_end)
+{
+    if (*run_end > position)
+        return *run_end;
+
+    u64 end = position + 1;
+    if (end < input.length)
+        end += fragments_match_length(input, gather, end, position, input.length - end);
+
+    return *run_end = end;
+}
+
+// run_end caches the end of the last run of equal bytes, for searches going forward through the input. With gather
+// the input is read through its fragments.
+static inline match_t __get_longest_match(lzss_config_t config, array_t input, fragments_t *gather, u64 index, u64 *run_end)
 {
     if (index + config.minimum_length >= input.length)
-        return (match_t){.offset = 0, .length = 0};
+        return (match_t){.offset = 0, .length = 0, .rep = NO_REP};
 
-    u32 best_offset = 0, best_length = 0;
-    u32 offset = (config.max_offset > index) ? 0 : index - config.max_offset;
+    const u64 limit = __longest_match(config);
 
-    while (offset < index && offset < input.length)
+    // In a run, offset 1 matches as far as the run goes. Every other offset in it would compare the same bytes again,
+    // and only one reaching back to the same bytes before an earlier run could get further, so a long enough run is
+    // taken as it is.
+    if (index > 0 && fragments_input_byte(input, gather, index - 1) == fragments_input_byte(input, gather, index))
     {
-        u32 length = 0;
+        u64 run = __run_end(input, gather, index, run_end) - index;
 
-        while (offset + length < input.length && index + length < input.length && input.bytes[offset + length] == input.bytes[index + length])
-            length += 1;
+        if (run >= MIN(limit, LZSS_RUN_MINIMUM))
+            return (match_t){.offset = 1, .length = (u32)MIN(run, limit), .rep = NO_REP};
+    }
 
-        // We compare greater or equal, since a lower offset is better
-        if (length >= best_length)
+    u64 best_offset = 0, best_length = 0;
+    u64 oldest = (config.max_offset > index) ? 0 : index - config.max_offset;
+    const u64 available = MIN(limit, input.length - index);
+
+    // Most windows sit in one fragment, which then gets searched as a buffer of its own. Offsets and lengths come out
+    // the same with the positions counted from the window's start.
+    u8 *window = gather ? fragments_span(gather, oldest, index + available) : NULL;
+    if (window)
+    {
+        input = (array_t){.bytes = window, .length = index + available - oldest};
+        index -= oldest;
+        oldest = 0;
+        gather = NULL;
+    }
+
+    // Newest first, so only a longer match replaces the best one and the lower offset wins a tie. Once a match is as
+    // long as they get, nothing further back can beat it.
+    for (u64 offset = index; offset-- > oldest;)
+    {
+        u64 length = fragments_match_length(input, gather, index, offset, available);
+
+        if (length > best_length)
         {
             best_length = length;
             best_offset = offset;
-        }
 
-        offset += 1;
+            if (length == limit)
+                break;
+        }
     }
 
     // Substract the found offset from the actual index to get the resulting offset.
-    return (match_t){.offset = index - best_offset, .length = MIN(best_length, config.max_length)};
+    return (match_t){.offset = (u32)(index - best_offset), .length = (u32)best_length, .rep = NO_REP};
+}
+
+// The window search, or what the finder threads found at index when there are some.
+static inline match_t __search_window(lzss_config_t config, array_t input, fragments_t *gather, u64 index, u64 *run_end, match_ring_t *ring)
+{
+    if (ring == NULL)
+        return __get_longest_match(config, input, gather, index, run_end);
+
+    const match_candidate_t *candidate = match_ring_get(ring, index);
+    return (match_t){.offset = candidate->offset, .length = candidate->length, .rep = NO_REP};
+}
+
+// A finder thread's side. The window search only reads the input, the run it's in is all a thread keeps, along
+// with cursors of its own into the fragments when there are some.
+typedef struct finder_t
+{
+    lzss_config_t config;
+    array_t input;
+    fragments_t fragments;
+    fragments_t *gather;
+    u64 run_end;
+} finder_t;
+
+static void __find_matches(void *context, u64 first, u64 last, match_candidate_t *candidates)
+{
+    finder_t *finder = (finder_t *)context;
+
+    for (u64 index = first; index < last; index += 1)
+    {
+        match_t match = __get_longest_match(finder->config, finder->input, finder->gather, index, &finder->run_end);
+        candidates[index - first] = (match_candidate_t){.offset = match.offset, .length = match.length};
+    }
+}
+
+// Order of the lengths' Exp-Golomb code. Lengths bunch up near the minimum, so the first few values get cheaper than
+// the fixed field. Offsets spread over the whole window and stay fixed, a variable code loses there.
+static ALWAYS_INLINE u8 __length_golomb_order(lzss_config_t config) { return config.length_bits / 3; }
+
+// With long matches, a length of max_length is followed by the rest of it.
+static ALWAYS_INLINE u8 __is_extended(lzss_config_t config, u32 length) { return (config.flags & LZSS_FLAG_LONG_MATCHES) && length >= config.max_length; }
+
+static ALWAYS_INLINE u32 __extension_bits(lzss_config_t config, u32 length)
+{
+    return __is_extended(config, length) ? vlc_golomb_bits(length - config.max_length, LZSS_LONG_MATCH_GOLOMB_ORDER) : 0;
+}
+
+// Match fields are the same in every layout, only the stream they go to changes.
+static inline u32 __match_bits(lzss_config_t config, match_t match)
+{
+    u32 bits = config.offset_bits;
+    u32 length = MIN(match.length, config.max_length);
+
+    // Without the prefix codes, recent offsets are written as they are too, see __rep_offsets_prefixed.
+    if ((config.flags & LZSS_FLAG_REP_OFFSETS) && match.prefixed)
+        bits = match.rep == NO_REP ? 1u + config.offset_bits : MIN(match.rep + 2, REP_COUNT);
+
+    if (config.flags & LZSS_FLAG_VARIABLE_CODES)
+        return bits + vlc_golomb_bits(length - config.minimum_length, __length_golomb_order(config)) + __extension_bits(config, match.length);
+
+    return bits + config.length_bits + __extension_bits(config, match.length);
+}
+
+// A match has to be cheaper than the literals it replaces (9 bits each at most), which is what the upper bound
+// relies on. token_bits is what the layout spends on top of the fields to tell it from a literal.
+static inline u8 __is_match_worth_it(lzss_config_t config, match_t match, u32 token_bits)
+{
+    return match.length >= config.minimum_length && token_bits + __match_bits(config, match) <= 9 * match.length;
+}
+
+static inline error_t __write_offset(lzss_config_t config, bit_stream_t *stream, match_t match)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (!(config.flags & LZSS_FLAG_REP_OFFSETS) || !match.prefixed)
+        return bit_stream_write_bits(stream, match.offset, config.offset_bits);
+
+    if (match.rep == NO_REP)
+    {
+        if ((error = bit_stream_write_bits(stream, 0, 1)))
+            return error;
+
+        return bit_stream_write_bits(stream, match.offset, config.offset_bits);
+    }
+
+    // 1, then rep ones and the 0 ending them, which the last rep doesn't need.
+    if (match.rep + 1 < REP_COUNT)
+        return bit_stream_write_bits(stream, ((1u << (match.rep + 1)) - 1) << 1, match.rep + 2);
+
+    return bit_stream_write_bits(stream, (1u << REP_COUNT) - 1, REP_COUNT);
+}
+
+static ALWAYS_INLINE error_t __read_offset(lzss_config_t config, bit_stream_t *stream, rep_offsets_t *reps, u32 *offset)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (!(config.flags & LZSS_FLAG_REP_OFFSETS))
+        return bit_stream_read_bits(stream, offset, config.offset_bits);
+
+    u32 rep = 0, bit = 0;
+
+    // Prefixed, a 0 comes before a new offset and a 1 before a rep code. Otherwise the offset comes first, and a
+    // rep code follows an offset of 0. The rep codes are the same from there.
+    if (__rep_offsets_prefixed(reps))
+    {
+        if ((error = bit_stream_read_bits(stream, &bit, 1)) || (!bit && (error = bit_stream_read_bits(stream, offset, config.offset_bits))))
+            return error;
+    }
+    else
+    {
+        if ((error = bit_stream_read_bits(stream, offset, config.offset_bits)))
+            return error;
+
+        bit = *offset == 0;
+    }
+
+    if (!bit)
+    {
+        __rep_offsets_update(reps, *offset);
+        return error;
+    }
+
+    while (rep + 1 < REP_COUNT)
+    {
+        if ((error = bit_stream_read_bits(stream, &bit, 1)))
+            return error;
+
+        if (!bit)
+            break;
+
+        rep += 1;
+    }
+
+    *offset = reps->offsets[rep];
+    __rep_offsets_update(reps, *offset);
+    return error;
+}
+
+static inline error_t __write_match(lzss_config_t config, bit_stream_t *stream, match_t match)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    u32 length = MIN(match.length, config.max_length);
+
+    if ((error = __write_offset(config, stream, match)))
+        return error;
+
+    if (config.flags & LZSS_FLAG_VARIABLE_CODES)
+        error = vlc_write_golomb(stream, length - config.minimum_length, __length_golomb_order(config));
+    else
+        error = bit_stream_write_bits(stream, length, config.length_bits);
+
+    if (error || !__is_extended(config, match.length))
+        return error;
+
+    return vlc_write_golomb(stream, match.length - config.max_length, LZSS_LONG_MATCH_GOLOMB_ORDER);
+}
+
+static ALWAYS_INLINE error_t __read_match(lzss_config_t config, bit_stream_t *stream, const vlc_table_t *table, rep_offsets_t *reps, u32 *offset, u32 *length)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if ((error = __read_offset(config, stream, reps, offset)))
+        return error;
+
+    if (config.flags & LZSS_FLAG_VARIABLE_CODES)
+    {
+        if ((error = vlc_read_golomb(stream, table, __length_golomb_order(config), length)))
+            return error;
+
+        *length += config.minimum_length;
+    }
+    else if ((error = bit_stream_read_bits(stream, length, config.length_bits)))
+        return error;
+
+    if (!(config.flags & LZSS_FLAG_LONG_MATCHES) || *length != config.max_length)
+        return error;
+
+    // A length that doesn't fit is corrupt input.
+    u32 rest = 0;
+    if ((error = vlc_read_golomb(stream, table, LZSS_LONG_MATCH_GOLOMB_ORDER, &rest)))
+        return error;
+
+    if (rest > UINT32_MAX - *length)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    *length += rest;
+    return error;
+}
+
+// Bits a match saves over sending its bytes as literals.
+static inline i64 __match_savings(lzss_config_t config, match_t match) { return 9 * (i64)match.length - (i64)__match_bits(config, match); }
+
+// With rep offsets, the recent offsets are tried first. A rep match that's as long as it can get makes searching the
+// window pointless, otherwise the longest match in the window competes with the best rep on the bits they save.
+static inline match_t __find_match(lzss_config_t config, array_t input, fragments_t *gather, u64 index, const rep_offsets_t *reps, u64 *run_end,
+                                   match_ring_t *ring)
+{
+    if (!(config.flags & LZSS_FLAG_REP_OFFSETS))
+        return __search_window(config, input, gather, index, run_end, ring);
+
+    if (index + config.minimum_length >= input.length)
+        return (match_t){.offset = 0, .length = 0, .rep = NO_REP};
+
+    const u32 limit = __longest_match(config);
+    const u8 prefixed = __rep_offsets_prefixed(reps);
+    match_t best_rep = {.offset = 0, .length = 0, .rep = NO_REP, .prefixed = prefixed};
+
+    for (u32 rep = 0; rep < REP_COUNT; rep += 1)
+    {
+        u64 offset = reps->offsets[rep];
+
+        if (offset > index)
+            continue;
+
+        u32 length = (u32)fragments_match_length(input, gather, index, index - offset, MIN(limit, input.length - index));
+
+        if (length > best_rep.length)
+            best_rep = (match_t){.offset = (u32)offset, .length = length, .rep = rep, .prefixed = prefixed};
+    }
+
+    if (best_rep.length == limit || index + best_rep.length == input.length)
+        return best_rep;
+
+    match_t match = __search_window(config, input, gather, index, run_end, ring);
+    match.prefixed = prefixed;
+
+    for (u32 rep = 0; rep < REP_COUNT && match.rep == NO_REP; rep += 1)
+        if (match.offset == reps->offsets[rep])
+            match.rep = rep;
+
+    if (best_rep.length >= config.minimum_length && (match.length < config.minimum_length || __match_savings(config, best_rep) >= __match_savings(config, match)))
+        return best_rep;
+
+    return match;
+}
+
+// The frame defaults get a copy of the decoder of their own, built with the field widths as compile-time constants,
+// so the bit unpacking unrolls and the masks fold. Flags stay a runtime choice, and other configs take the generic copy.
+#define LZSS_PRESET_OFFSET_BITS 10
+#define LZSS_PRESET_LENGTH_BITS 6
+#define LZSS_PRESET_MINIMUM_LENGTH 2
+
+static inline lzss_config_t __preset_config(u8 flags)
+{
+    return (lzss_config_t){
+        .offset_bits = LZSS_PRESET_OFFSET_BITS,
+        .max_offset = (1 << LZSS_PRESET_OFFSET_BITS) - 1,
+
+        .minimum_length = LZSS_PRESET_MINIMUM_LENGTH,
+        .length_bits = LZSS_PRESET_LENGTH_BITS,
+        .max_length = (1 << LZSS_PRESET_LENGTH_BITS) - 1,
+
+        .flags = flags,
+    };
+}
+
+static inline u8 __is_preset(lzss_config_t config)
+{
+    const lzss_config_t preset = __preset_config(config.flags);
+
+    return config.offset_bits == preset.offset_bits && config.max_offset == preset.max_offset && config.minimum_length == preset.minimum_length &&
+           config.length_bits == preset.length_bits && config.max_length == preset.max_length;
 }
 
 #define try(fn)       \
     if ((error = fn)) \
         goto error_exit;
 
-error_t lzss_encode(lzss_config_t config, array_t input, array_t *output)
+_API u64 lzss_get_in_place_margin_bound(u64 input_length)
 {
-    error_t error = ERROR_ALL_GOOD;
+    // The decoder can only catch up with its input when what's left of it expands, and literals expand by 1/8 at most.
+    return input_length / 8 + 16;
+}
 
-    // If there are no input bytes, we don't have to do anything.
-    if (input.length == 0)
-        return ERROR_NO_OP;
+// Sequences buffered between the parse and the back end: small enough to stay in cache, big enough that going back
+// and forth between the two doesn't show.
+#define LZSS_SEQUENCE_CHUNK 4096
 
-    bit_stream_t stream = bit_stream_init(*output);
+// Where a parse stopped, so it can pick up from there once the sequences so far have been written.
+typedef struct parser_t
+{
+    u64 index;
+    rep_offsets_t reps;
+    match_ring_t *ring; // Where the window matches come from with finder threads, NULL to search here.
+    u64 run_end;
+    fragments_t *gather; // The input's fragments, NULL when it's one buffer.
+} parser_t;
 
-    // Write the initial size of the buffer
-    try(bit_stream_write_7bit_int32(&stream, input.length)); // TODO: Maybe we should handle this total amount of symbols somewhere else?
+// Parses until the input ends or the buffer is full. token_bits is what the layout spends on top of the fields to
+// tell a match from a literal, which decides the matches that are worth it.
+static inline void __parse(lzss_config_t config, array_t input, u32 token_bits, parser_t *parser, sequence_buffer_t *sequences)
+{
+    u64 index = parser->index;
 
-    for (u32 index = 0; index < input.length;)
+    while (index < input.length && sequences->count < sequences->capacity)
     {
-        match_t match = __get_longest_match(config, input, index);
+        match_t match = __find_match(config, input, parser->gather, index, &parser->reps, &parser->run_end, parser->ring);
 
-        if (match.length >= config.minimum_length)
+        if (__is_match_worth_it(config, match, token_bits))
         {
-            try(bit_stream_write_bit(&stream, 1));
-            try(bit_stream_write_int(&stream, match.offset, config.offset_bits));
-            try(bit_stream_write_int(&stream, match.length, config.length_bits));
+            sequence_buffer_add_match(sequences, match.length, match.offset);
+            __rep_offsets_update(&parser->reps, match.offset);
             index += match.length;
         }
         else
         {
-            try(bit_stream_write_bit(&stream, 0));
-            try(bit_stream_write_int(&stream, input.bytes[index], 8));
+            sequence_buffer_add_literals(sequences, 1);
             index += 1;
         }
     }
 
-    try(bit_stream_flush(&stream));
+    parser->index = index;
+}
+
+// The back end's side: where it is in the input, and the recent offsets, kept the same way the decoder does.
+typedef struct coder_t
+{
+    u64 position;
+    rep_offsets_t reps;
+    fragments_t *gather; // The input's fragments, NULL when it's one buffer.
+
+    // Largest difference between bytes decoded and compressed bytes read, after each token, when track_margin is set.
+    i64 max_ahead;
+    u8 track_margin;
+} coder_t;
+
+// The decoder has read every byte the last token touches, including the partially written one.
+static ALWAYS_INLINE void __track_margin(coder_t *coder, const bit_stream_t *stream)
+{
+    if (!coder->track_margin)
+        return;
+
+    i64 ahead = (i64)coder->position - (i64)(stream->buffer_position + (stream->bit_count > 0));
+    coder->max_ahead = ahead > coder->max_ahead ? ahead : coder->max_ahead;
+}
+
+// Without split, the tokens go to the single stream.
+static ALWAYS_INLINE error_t __write_literals(array_t input, u64 count, coder_t *coder, bit_stream_t *stream, split_stream_t *split)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (count > input.length - coder->position)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    for (u64 end = coder->position + count; coder->position < end;)
+    {
+        u8 literal = fragments_input_byte(input, coder->gather, coder->position++);
+
+        if (split)
+        {
+            split_stream_write_literal(split, literal);
+            continue;
+        }
+
+        if ((error = bit_stream_write_bits(stream, 0, 1)) || (error = bit_stream_write_bits(stream, literal, 8)))
+            return error;
+
+        __track_margin(coder, stream);
+    }
+
+    return error;
+}
+
+// The parser's rep index isn't part of the sequence, offsets are unique among the recent ones so it's found again.
+static ALWAYS_INLINE error_t __write_sequence_match(lzss_config_t config, array_t input, const sequence_t *sequence, coder_t *coder, bit_stream_t *stream,
+                                                   split_stream_t *split)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    match_t match = {.offset = sequence->offset, .length = sequence->match_length, .rep = NO_REP};
+
+    // Sequences may come from any parser, so they're checked against what the format and the input allow.
+    if (match.length == 0 || match.length < config.minimum_length || match.length > __longest_match(config) || match.length > input.length - coder->position || match.offset == 0 ||
+        match.offset > config.max_offset || match.offset > coder->position)
+        return ERROR_UNKNOWN_FORMAT;
+
+    if (config.flags & LZSS_FLAG_REP_OFFSETS)
+    {
+        match.prefixed = __rep_offsets_prefixed(&coder->reps);
+
+        for (u32 rep = 0; rep < REP_COUNT && match.rep == NO_REP; rep += 1)
+            if (match.offset == coder->reps.offsets[rep])
+                match.rep = rep;
+    }
+
+    if (split)
+    {
+        split_stream_write_match_flag(split);
+        error = __write_match(config, &split->matches, match);
+    }
+    else if (!(error = bit_stream_write_bits(stream, 1, 1)))
+        error = __write_match(config, stream, match);
+
+    if (error)
+        return error;
+
+    __rep_offsets_update(&coder->reps, match.offset);
+    coder->position += match.length;
+
+    if (!split)
+        __track_margin(coder, stream);
+
+    return error;
+}
+
+// The literals at the end of the buffer are only written when it's the last one, otherwise the next sequence
+// starts with them.
+static ALWAYS_INLINE error_t __write_sequences(lzss_config_t config, array_t input, const sequence_buffer_t *sequences, u8 is_last, coder_t *coder,
+                                              bit_stream_t *stream, split_stream_t *split)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    for (u64 i = 0; i < sequences->count; i += 1)
+    {
+        if ((error = __write_literals(input, sequences->sequences[i].literal_count, coder, stream, split)))
+            return error;
+
+        if ((error = __write_sequence_match(config, input, &sequences->sequences[i], coder, stream, split)))
+            return error;
+    }
+
+    if (is_last)
+        return __write_literals(input, sequences->literal_count, coder, stream, split);
+
+    return error;
+}
+
+// Every layout gets a copy of the back end of its own.
+static inline error_t __write_any(lzss_config_t config, array_t input, const sequence_buffer_t *sequences, u8 is_last, coder_t *coder, bit_stream_t *stream,
+                                  split_stream_t *split)
+{
+    if (split)
+        return __write_sequences(config, input, sequences, is_last, coder, stream, split);
+
+    return __write_sequences(config, input, sequences, is_last, coder, stream, NULL);
+}
+
+// Parses a chunk of sequences and writes it out, until the input ends. With parsed, those sequences get written
+// instead, and must cover the input from start on. When in_place_margin isn't NULL we also track how far the
+// decoder's output gets ahead of its input. Only the bytes from start on get encoded, the ones before are history
+// the decoder already holds. With gather, the input is read through its fragments and only gives the length.
+static inline error_t __encode(lzss_config_t config, array_t input, u64 start, const sequence_buffer_t *parsed, array_t *output, u64 *in_place_margin,
+                               fragments_t *gather)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    // If there are no input bytes, we don't have to do anything.
+    if (input.length <= start)
+        return ERROR_NO_OP;
+
+    // With split streams the tokens go to their own streams, and get appended to the output at the end.
+    const u8 is_split = (config.flags & LZSS_SPLIT_LAYOUTS) != 0;
+    const u8 literal_runs = (config.flags & LZSS_FLAG_LITERAL_RUNS) != 0;
+
+    // With literal runs every match also pays for a run length, so short matches may not be worth it anymore.
+    const u32 token_bits = literal_runs ? SPLIT_STREAM_RUN_BITS : 1;
+
+    split_stream_t split = {0};
+    sequence_buffer_t chunk = {0};
+    parser_t parser = {.index = start, .reps = __rep_offsets_init(), .ring = NULL, .run_end = 0, .gather = gather};
+
+    if (is_split && (error = split_stream_writer_init(&split, input.length - start, literal_runs)))
+        goto error_exit;
+
+    if (parsed == NULL && (error = sequence_buffer_init(&chunk, LZSS_SEQUENCE_CHUNK)))
+        goto error_exit;
+
+    // With finder threads the window search runs ahead of the parse, on inputs that give them more than a chunk. If
+    // they can't be started, the parse searches on its own.
+    finder_t finders[UINT8_MAX];
+    void *finder_contexts[UINT8_MAX];
+    match_ring_t ring;
+
+    for (u32 i = 0; i < config.match_threads; i += 1)
+    {
+        finders[i] = (finder_t){.config = config, .input = input, .gather = NULL, .run_end = 0};
+        finder_contexts[i] = &finders[i];
+
+        // Cursors are per thread, the fragments themselves are shared.
+        if (gather)
+        {
+            finders[i].fragments = *gather;
+            finders[i].gather = &finders[i].fragments;
+        }
+    }
+
+    if (parsed == NULL && config.match_threads > 0 && input.length - start > MATCH_RING_CHUNK)
+    {
+        if (match_ring_init(&ring, start, input.length, __find_matches, finder_contexts, config.match_threads))
+            match_ring_free(&ring);
+        else
+            parser.ring = &ring;
+    }
+
+    bit_stream_t stream = bit_stream_init(*output);
+
+    // Write the initial size of the buffer
+    try(bit_stream_write_7bit_int64(&stream, input.length - start)); // TODO: Maybe we should handle this total amount of symbols somewhere else?
+
+    coder_t coder = {.position = start, .reps = __rep_offsets_init(), .gather = gather, .max_ahead = 0, .track_margin = in_place_margin != NULL};
+
+    if (parsed)
+        try(__write_any(config, input, parsed, 1, &coder, &stream, is_split ? &split : NULL));
+
+    while (parsed == NULL && parser.index < input.length)
+    {
+        __parse(config, input, token_bits, &parser, &chunk);
+        try(__write_any(config, input, &chunk, parser.index == input.length, &coder, &stream, is_split ? &split : NULL));
+
+        // The literals after the last match stay, the next sequence starts with them.
+        chunk.count = 0;
+    }
+
+    if (coder.position != input.length)
+    {
+        error = ERROR_UNKNOWN_FORMAT;
+        goto error_exit;
+    }
+
+    try(is_split ? split_stream_writer_finish(&split, &stream) : bit_stream_flush(&stream));
 
     goto no_error_exit;
 
 error_exit:
+    if (parser.ring)
+        match_ring_free(parser.ring);
+    sequence_buffer_free(&chunk);
+    split_stream_writer_free(&split);
     output->length = 0;
     return error;
 
 no_error_exit:
+    if (parser.ring)
+        match_ring_free(parser.ring);
+    sequence_buffer_free(&chunk);
+    split_stream_writer_free(&split);
     output->length = stream.buffer_position;
+
+    // The compressed data starts (original + margin - compressed) bytes into the buffer, and the output
+    // must never pass what the decoder hasn't read yet.
+    if (in_place_margin)
+    {
+        i64 margin = coder.max_ahead - (i64)input.length + (i64)output->length;
+        *in_place_margin = margin > 0 ? (u64)margin : 0;
+    }
+
     return error;
 }
 
-error_t lzss_decode(lzss_config_t config, array_t input, array_t *output)
+// The encoder isn't specialized: its time goes into the window search, which came out slower with the constants.
+_API error_t lzss_encode(lzss_config_t config, array_t input, array_t *output) { return __encode(config, input, 0, NULL, output, NULL, NULL); }
+
+_API error_t lzss_encode_with_margin(lzss_config_t config, array_t input, array_t *output, u64 *in_place_margin)
+{
+    *in_place_margin = 0;
+
+    // The split streams are read from three places at once, so they can't be decoded in place.
+    if (config.flags & LZSS_SPLIT_LAYOUTS)
+        return ERROR_UNKNOWN_FORMAT;
+
+    return __encode(config, input, 0, NULL, output, in_place_margin, NULL);
+}
+
+_API error_t lzss_parse(lzss_config_t config, array_t input, sequence_buffer_t *sequences)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    sequence_buffer_reset(sequences);
+
+    if (input.length == 0)
+        return ERROR_NO_OP;
+
+    const u32 token_bits = (config.flags & LZSS_FLAG_LITERAL_RUNS) ? SPLIT_STREAM_RUN_BITS : 1;
+    parser_t parser = {.index = 0, .reps = __rep_offsets_init(), .ring = NULL, .run_end = 0};
+
+    while (parser.index < input.length)
+    {
+        if (sequences->count == sequences->capacity && (error = sequence_buffer_reserve(sequences, MAX(LZSS_SEQUENCE_CHUNK, sequences->capacity * 2))))
+            return error;
+
+        __parse(config, input, token_bits, &parser, sequences);
+    }
+
+    return error;
+}
+
+_API error_t lzss_encode_sequences(lzss_config_t config, array_t input, const sequence_buffer_t *sequences, array_t *output)
+{
+    return __encode(config, input, 0, sequences, output, NULL, NULL);
+}
+
+// Matches may overlap their own output, so they copy forwards byte by byte when they do, except runs of the byte
+// before, which are a memset.
+static ALWAYS_INLINE void __copy_match(u8 *to, u32 offset, u32 length)
+{
+    const u8 *from = to - offset;
+
+    if (offset == 1)
+        memset(to, from[0], length);
+    else if (offset >= length)
+        memcpy(to, from, length);
+    else
+        for (u32 i = 0; i < length; i += 1)
+            to[i] = from[i];
+}
+
+// In place, the input lives at the end of the output buffer, so we check that no token writes past what we've read.
+// The output is decoded from start on, matches may reach back into the history before it. With scatter the output
+// goes to its fragments instead, and output only gives the length.
+static ALWAYS_INLINE error_t __decode(lzss_config_t config, array_t input, array_t *output, u64 start, u8 in_place, fragments_t *scatter)
 {
     error_t error = ERROR_ALL_GOOD;
 
-    if (input.length == 0 || output->length == 0)
+    const u64 input_offset = in_place ? (u64)(input.bytes - output->bytes) : 0;
+
+    if (input.length == 0 || output->length <= start)
         return ERROR_NO_OP;
 
     bit_stream_t stream = bit_stream_init(input);
 
-    u32 original_size = 0;
-    try(bit_stream_read_7bit_int32(&stream, &original_size));
+    vlc_table_t table;
+    if (config.flags & (LZSS_FLAG_VARIABLE_CODES | LZSS_FLAG_LONG_MATCHES))
+        vlc_table_init(&table);
 
-    if (original_size != output->length)
+    u64 original_size = 0;
+    try(bit_stream_read_7bit_int64(&stream, &original_size));
+
+    if (original_size != output->length - start)
         return ERROR_WRONG_OUTPUT_SIZE;
 
-    for (u32 index = 0; index < output->length;)
+    rep_offsets_t reps = __rep_offsets_init();
+
+    for (u64 index = start; index < output->length;)
     {
-        u8 is_pair = 0;
-        try(bit_stream_read_bit(&stream, &is_pair));
+        u32 is_pair = 0;
+        try(bit_stream_read_bits(&stream, &is_pair, 1));
 
         if (is_pair)
         {
-            u32 offset = 0;
-            try(bit_stream_read_int(&stream, &offset, config.offset_bits));
+            u32 offset = 0, length = 0;
+            try(__read_match(config, &stream, &table, &reps, &offset, &length));
 
-            u32 length = 0;
-            try(bit_stream_read_int(&stream, &length, config.length_bits));
+            // Checked once per match, so the copy itself can't leave the output whatever the input holds.
+            if (offset == 0 || offset > index || length > output->length - index)
+                return ERROR_BUFFER_OUT_OF_BOUNDS;
 
-            for (u32 i = 0; i < length; i += 1)
-                output->bytes[index + i] = output->bytes[index - offset + i];
+            if (in_place && index + length > input_offset + stream.buffer_position)
+                return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+            if (scatter)
+                fragments_copy(scatter, index, offset, length);
+            else
+                __copy_match(output->bytes + index, offset, length);
 
             index += length;
         }
         else
         {
             u32 literal = 0;
-            try(bit_stream_read_int(&stream, &literal, 8));
-            output->bytes[index] = (u8)(literal & 0xFF);
+            try(bit_stream_read_bits(&stream, &literal, 8));
+
+            if (in_place && index + 1 > input_offset + stream.buffer_position)
+                return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+            if (scatter)
+                fragments_put(scatter, index, (u8)(literal & 0xFF));
+            else
+                output->bytes[index] = (u8)(literal & 0xFF);
             index += 1;
         }
     }
@@ -172,4 +866,332 @@ error_exit:
     return error;
 }
 
+// Literal runs come straight from the literal stream, so only matches go through the bit reader.
+static ALWAYS_INLINE error_t __decode_split(lzss_config_t config, array_t input, array_t *output, u64 start, fragments_t *scatter)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (input.length == 0 || output->length <= start)
+        return ERROR_NO_OP;
+
+    bit_stream_t stream = bit_stream_init(input);
+
+    vlc_table_t table;
+    if (config.flags & (LZSS_FLAG_VARIABLE_CODES | LZSS_FLAG_LONG_MATCHES))
+        vlc_table_init(&table);
+
+    u64 original_size = 0;
+    try(bit_stream_read_7bit_int64(&stream, &original_size));
+
+    if (original_size != output->length - start)
+        return ERROR_WRONG_OUTPUT_SIZE;
+
+    split_stream_t split;
+    try(split_stream_reader_init(&split, &stream, (config.flags & LZSS_FLAG_LITERAL_RUNS) != 0));
+
+    rep_offsets_t reps = __rep_offsets_init();
+
+    for (u64 index = start; index < output->length;)
+    {
+        u64 run = 0;
+        u8 has_match = 0;
+        try(split_stream_read_literal_run(&split, &run, &has_match));
+
+        if (run > output->length - index || run > split.literal_count - split.literal_position)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        if (scatter)
+            fragments_write(scatter, index, split.literals + split.literal_position, run);
+        else
+            memcpy(output->bytes + index, split.literals + split.literal_position, run);
+        split.literal_position += run;
+        index += run;
+
+        if (!has_match)
+        {
+            if (index != output->length)
+                return ERROR_BUFFER_OUT_OF_BOUNDS;
+            break;
+        }
+
+        u32 offset = 0, length = 0;
+        try(__read_match(config, &split.matches, &table, &reps, &offset, &length));
+
+        if (offset == 0 || offset > index || length > output->length - index)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        if (scatter)
+            fragments_copy(scatter, index, offset, length);
+        else
+            __copy_match(output->bytes + index, offset, length);
+
+        index += length;
+    }
+
+error_exit:
+    return error;
+}
+
+static ALWAYS_INLINE error_t __decode_any(lzss_config_t config, array_t input, array_t *output, u64 start, fragments_t *scatter)
+{
+    if (config.flags & LZSS_SPLIT_LAYOUTS)
+        return __decode_split(config, input, output, start, scatter);
+
+    return __decode(config, input, output, start, 0, scatter);
+}
+
+static error_t __decode_preset(u8 flags, array_t input, array_t *output, u64 start) { return __decode_any(__preset_config(flags), input, output, start, NULL); }
+
+static error_t __decode_preset_in_place(u8 flags, array_t input, array_t *output) { return __decode(__preset_config(flags), input, output, 0, 1, NULL); }
+
+static inline error_t __decode_with_history(lzss_config_t config, array_t input, array_t *output, u64 start)
+{
+    if (__is_preset(config))
+        return __decode_preset(config.flags, input, output, start);
+
+    return __decode_any(config, input, output, start, NULL);
+}
+
+_API error_t lzss_decode(lzss_config_t config, array_t input, array_t *output) { return __decode_with_history(config, input, output, 0); }
+
+_API error_t lzss_decode_in_place(lzss_config_t config, array_t buffer, u64 compressed_length)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (config.flags & LZSS_SPLIT_LAYOUTS)
+        return ERROR_UNKNOWN_FORMAT;
+
+    if (compressed_length > buffer.length)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    array_t input = {.bytes = buffer.bytes + buffer.length - compressed_length, .length = compressed_length};
+    array_t output = {.bytes = buffer.bytes, .length = 0};
+
+    if ((error = lzss_get_original_length(input, &output.length)))
+        return error;
+
+    if (output.length > buffer.length)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    if (__is_preset(config))
+        return __decode_preset_in_place(config.flags, input, &output);
+
+    return __decode(config, input, &output, 0, 1, NULL);
+}
+
+_API error_t lzss_encode_fragments(lzss_config_t config, const array_t *input, u64 input_count, array_t *output)
+{
+    if (input_count == 1)
+        return lzss_encode(config, input[0], output);
+
+    if (fragments_worth_gathering(input, input_count, config.max_offset))
+    {
+        array_t gathered = {0};
+        error_t error = fragments_gather(input, input_count, &gathered);
+
+        if (!error)
+            error = lzss_encode(config, gathered, output);
+
+        free(gathered.bytes);
+        return error;
+    }
+
+    fragments_t gather;
+    error_t error = fragments_init(&gather, input, input_count);
+
+    if (error)
+        return error;
+
+    // The encoder only takes the length from it, every byte goes through gather.
+    array_t whole = {.bytes = NULL, .length = gather.length};
+    error = __encode(config, whole, 0, NULL, output, NULL, &gather);
+
+    fragments_free(&gather);
+    return error;
+}
+
+static error_t __decode_preset_scattered(u8 flags, array_t input, array_t *output, fragments_t *scatter)
+{
+    return __decode_any(__preset_config(flags), input, output, 0, scatter);
+}
+
+_API error_t lzss_decode_fragments(lzss_config_t config, array_t input, const array_t *output, u64 output_count)
+{
+    fragments_t scatter;
+    error_t error = fragments_init(&scatter, output, output_count);
+
+    if (error)
+        return error;
+
+    // The decoder only takes the length from it, every byte goes through scatter.
+    array_t whole = {.bytes = NULL, .length = scatter.length};
+
+    if (__is_preset(config))
+        error = __decode_preset_scattered(config.flags, input, &whole, &scatter);
+    else
+        error = __decode_any(config, input, &whole, 0, &scatter);
+
+    fragments_free(&scatter);
+    return error;
+}
+
+// Message streams keep at least the last max_offset bytes as history. Sliding only once the window holds twice that
+// moves about one byte per byte that went through the stream.
+static inline void __stream_slide(lzss_stream_t *stream)
+{
+    const u64 keep = stream->config.max_offset;
+
+    if (stream->history_length < 2 * keep)
+        return;
+
+    u64 shift = stream->history_length - keep;
+
+    memmove(stream->window, stream->window + shift, stream->length - shift);
+    stream->history_length -= shift;
+    stream->length -= shift;
+}
+
+static inline error_t __stream_reserve(lzss_stream_t *stream, u64 length)
+{
+    if (length <= stream->capacity)
+        return ERROR_ALL_GOOD;
+
+    u64 capacity = stream->capacity * 2 > length ? stream->capacity * 2 : length;
+
+    u8 *window = (u8 *)realloc(stream->window, capacity);
+    if (window == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    stream->window = window;
+    stream->capacity = capacity;
+    return ERROR_ALL_GOOD;
+}
+
+_API error_t lzss_stream_init(lzss_config_t config, lzss_stream_t *stream)
+{
+    *stream = (lzss_stream_t){.config = config, .capacity = 2 * ((u64)config.max_offset + 1)};
+
+    stream->window = (u8 *)malloc(stream->capacity);
+
+    return stream->window ? ERROR_ALL_GOOD : ERROR_COULD_NOT_ALLOCATE;
+}
+
+_API void lzss_stream_free(lzss_stream_t *stream)
+{
+    free(stream->window);
+    stream->window = NULL;
+    stream->capacity = stream->length = stream->history_length = 0;
+}
+
+_API error_t lzss_stream_write(lzss_stream_t *stream, array_t input)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    __stream_slide(stream);
+
+    if ((error = __stream_reserve(stream, stream->length + input.length)))
+        return error;
+
+    memcpy(stream->window + stream->length, input.bytes, input.length);
+    stream->length += input.length;
+
+    return error;
+}
+
+_API u64 lzss_stream_get_flush_upper_bound(const lzss_stream_t *stream)
+{
+    return LZSS_STREAM_CHUNK_HEADER_LENGTH + lzss_get_upper_bound(stream->length - stream->history_length);
+}
+
+_API error_t lzss_stream_flush(lzss_stream_t *stream, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (stream->length == stream->history_length)
+    {
+        output->length = 0;
+        return ERROR_NO_OP;
+    }
+
+    if (output->length < LZSS_STREAM_CHUNK_HEADER_LENGTH)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    // The payload goes right after the room for its length, every match can reach back into the history.
+    array_t window = {.bytes = stream->window, .length = stream->length};
+    array_t payload = {.bytes = output->bytes + LZSS_STREAM_CHUNK_HEADER_LENGTH, .length = output->length - LZSS_STREAM_CHUNK_HEADER_LENGTH};
+
+    error = __encode(stream->config, window, stream->history_length, NULL, &payload, NULL, NULL);
+
+    if (error == ERROR_ALL_GOOD && payload.length > UINT32_MAX)
+        error = ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    if (error)
+    {
+        output->length = 0;
+        return error;
+    }
+
+    bit_stream_t header = bit_stream_init(*output);
+    bit_stream_write_bits(&header, (u32)payload.length, 32);
+
+    output->length = LZSS_STREAM_CHUNK_HEADER_LENGTH + payload.length;
+    stream->history_length = stream->length;
+
+    return error;
+}
+
+_API error_t lzss_stream_get_chunk_length(array_t input, u64 *chunk_length)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    bit_stream_t header = bit_stream_init(input);
+
+    u32 payload_length = 0;
+    if ((error = bit_stream_read_bits(&header, &payload_length, 32)))
+    {
+        *chunk_length = 0;
+        return error;
+    }
+
+    *chunk_length = LZSS_STREAM_CHUNK_HEADER_LENGTH + (u64)payload_length;
+    return error;
+}
+
+_API error_t lzss_stream_decode(lzss_stream_t *stream, array_t input, array_t *message)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    *message = (array_t){.bytes = NULL, .length = 0};
+
+    // A chunk that hasn't fully arrived yet is reported before anything changes, so the caller can try again later.
+    u64 chunk_length = 0, message_length = 0;
+    if ((error = lzss_stream_get_chunk_length(input, &chunk_length)))
+        return error;
+
+    if (chunk_length > input.length)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    array_t payload = {.bytes = input.bytes + LZSS_STREAM_CHUNK_HEADER_LENGTH, .length = chunk_length - LZSS_STREAM_CHUNK_HEADER_LENGTH};
+    if ((error = lzss_get_original_length(payload, &message_length)))
+        return error;
+
+    // Every token takes a bit at least, so a length past that is corrupt and shouldn't get its window allocated.
+    if (message_length / payload.length / 8 > __longest_match(stream->config))
+        return ERROR_UNKNOWN_FORMAT;
+
+    __stream_slide(stream);
+
+    if ((error = __stream_reserve(stream, stream->history_length + message_length)))
+        return error;
+
+    array_t window = {.bytes = stream->window, .length = stream->history_length + message_length};
+    if ((error = __decode_with_history(stream->config, payload, &window, stream->history_length)))
+        return error;
+
+    *message = (array_t){.bytes = stream->window + stream->history_length, .length = message_length};
+    stream->history_length = stream->length = window.length;
+
+    return error;
+}
+
 #undef try
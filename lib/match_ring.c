@@ -0,0 +1,127 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "match_ring.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+struct match_ring_worker_t
+{
+    match_ring_t *ring;
+    void *context;
+};
+
+static void *__finder_thread(void *argument)
+{
+    match_ring_worker_t *worker = (match_ring_worker_t *)argument;
+    match_ring_t *ring = worker->ring;
+
+    mutex_lock(&ring->mutex);
+
+    while (1)
+    {
+        // A chunk may only take the slot of the one a ring before it once the parser is past that one.
+        while (!ring->stop && ring->next_chunk < ring->chunk_count && ring->next_chunk >= ring->needed_chunk + ring->slot_count)
+            condition_wait(&ring->slot_free, &ring->mutex);
+
+        if (ring->stop || ring->next_chunk >= ring->chunk_count)
+            break;
+
+        u64 chunk = ring->next_chunk++;
+        u32 slot = (u32)(chunk % ring->slot_count);
+
+        mutex_unlock(&ring->mutex);
+
+        u64 first = ring->start + chunk * MATCH_RING_CHUNK;
+        ring->find(worker->context, first, MIN(first + MATCH_RING_CHUNK, ring->end), ring->candidates + slot * MATCH_RING_CHUNK);
+
+        mutex_lock(&ring->mutex);
+
+        ring->ready[slot] = chunk + 1;
+        condition_broadcast(&ring->chunk_ready);
+    }
+
+    mutex_unlock(&ring->mutex);
+    return NULL;
+}
+
+error_t match_ring_init(match_ring_t *ring, u64 start, u64 end, match_ring_find_t find, void **contexts, u32 thread_count)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    *ring = (match_ring_t){0};
+
+    ring->find = find;
+    ring->start = start;
+    ring->end = end;
+    ring->chunk_count = (end - start + MATCH_RING_CHUNK - 1) >> MATCH_RING_CHUNK_BITS;
+    ring->current_chunk = UINT64_MAX;
+
+    // Every finder gets a chunk to work on and one done ahead, the parser holds the one it's on.
+    ring->slot_count = 2 * thread_count + 1;
+
+    mutex_init(&ring->mutex);
+    condition_init(&ring->chunk_ready);
+    condition_init(&ring->slot_free);
+
+    ring->candidates = (match_candidate_t *)malloc(ring->slot_count * MATCH_RING_CHUNK * sizeof(match_candidate_t));
+    ring->ready = (u64 *)calloc(ring->slot_count, sizeof(u64));
+    ring->threads = (thread_t *)calloc(thread_count, sizeof(thread_t));
+    ring->workers = (match_ring_worker_t *)calloc(thread_count, sizeof(match_ring_worker_t));
+
+    if (!ring->candidates || !ring->ready || !ring->threads || !ring->workers)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    // Fewer finders than asked for still find everything, only a ring without any fails.
+    for (u32 i = 0; i < thread_count; i += 1)
+    {
+        ring->workers[i] = (match_ring_worker_t){.ring = ring, .context = contexts[i]};
+
+        if ((error = thread_create(&ring->threads[ring->thread_count], __finder_thread, &ring->workers[i])))
+            continue;
+
+        ring->thread_count += 1;
+    }
+
+    return ring->thread_count > 0 ? ERROR_ALL_GOOD : error;
+}
+
+void match_ring_free(match_ring_t *ring)
+{
+    mutex_lock(&ring->mutex);
+    ring->stop = 1;
+    condition_broadcast(&ring->slot_free);
+    mutex_unlock(&ring->mutex);
+
+    for (u32 i = 0; i < ring->thread_count; i += 1)
+        thread_join(&ring->threads[i]);
+
+    condition_destroy(&ring->slot_free);
+    condition_destroy(&ring->chunk_ready);
+    mutex_destroy(&ring->mutex);
+
+    free(ring->candidates);
+    free(ring->ready);
+    free(ring->threads);
+    free(ring->workers);
+    *ring = (match_ring_t){0};
+}
+
+// The parser moving to chunk is done with the ones before it, so their slots go back to the finders.
+const match_candidate_t *match_ring_wait(match_ring_t *ring, u64 chunk)
+{
+    u32 slot = (u32)(chunk % ring->slot_count);
+
+    mutex_lock(&ring->mutex);
+
+    ring->needed_chunk = chunk;
+    condition_broadcast(&ring->slot_free);
+
+    while (ring->ready[slot] != chunk + 1)
+        condition_wait(&ring->chunk_ready, &ring->mutex);
+
+    mutex_unlock(&ring->mutex);
+
+    ring->current_chunk = chunk;
+    return ring->candidates + slot * MATCH_RING_CHUNK;
+}
@@ -0,0 +1,76 @@
+#ifndef __MATCH_RING_H__
+#define __MATCH_RING_H__
+
+#include <common.h>
+
+#include "thread.h"
+
+// Match finding ahead of the parser, on threads of its own. The finder threads take the positions in chunks, in
+// order, and each writes the best match at every position of its chunk to a slot of the ring. The parser reads the
+// candidates of a chunk without any locking once the chunk is done, and only waits on the lock when it moves to the
+// next one, which frees the slots before it. The finders can't get more than a ring ahead, so memory stays fixed.
+// Candidates at positions the parser jumps over are never read, that's the work the finder wastes.
+#define MATCH_RING_CHUNK_BITS 14
+#define MATCH_RING_CHUNK ((u64)1 << MATCH_RING_CHUNK_BITS)
+
+// What the window search gave at a position. The codec decides what the offset is, the steps back for ROLZ.
+typedef struct match_candidate_t
+{
+    u32 offset;
+    u32 length;
+} match_candidate_t;
+
+// Fills candidates[i - first] for every position i in [first, last). context is the finder thread's own, and the
+// chunks a thread gets only go forward.
+typedef void (*match_ring_find_t)(void *context, u64 first, u64 last, match_candidate_t *candidates);
+
+typedef struct match_ring_worker_t match_ring_worker_t;
+
+typedef struct match_ring_t
+{
+    match_ring_find_t find;
+    u64 start;
+    u64 end;
+    u64 chunk_count;
+
+    match_candidate_t *candidates; // slot_count chunks back to back.
+    u64 *ready;                    // Chunk each slot holds plus one, once it's written.
+    u32 slot_count;
+
+    mutex_t mutex;
+    condition_t chunk_ready;
+    condition_t slot_free;
+    u64 next_chunk;   // Next chunk a finder takes.
+    u64 needed_chunk; // Chunk the parser is on, the ones before are done with.
+    u8 stop;
+
+    // The parser's side, only touched by its thread.
+    u64 current_chunk;
+    const match_candidate_t *current;
+
+    thread_t *threads;
+    match_ring_worker_t *workers;
+    u32 thread_count;
+} match_ring_t;
+
+// Starts thread_count finders on the positions in [start, end), each with its own contexts[i]. If some threads
+// can't be started the others do their chunks, with none it fails.
+error_t match_ring_init(match_ring_t *ring, u64 start, u64 end, match_ring_find_t find, void **contexts, u32 thread_count);
+
+// Stops the finders, waiting for them to end. Also works on a ring that failed to start.
+void match_ring_free(match_ring_t *ring);
+
+const match_candidate_t *match_ring_wait(match_ring_t *ring, u64 chunk);
+
+// The candidate at position, which must not go back from the last one asked for.
+static inline const match_candidate_t *match_ring_get(match_ring_t *ring, u64 position)
+{
+    u64 chunk = (position - ring->start) >> MATCH_RING_CHUNK_BITS;
+
+    if (chunk != ring->current_chunk)
+        ring->current = match_ring_wait(ring, chunk);
+
+    return ring->current + ((position - ring->start) & (MATCH_RING_CHUNK - 1));
+}
+
+#endif
@@ -1,16 +1,50 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include <rolz.h>
 #include "bit_stream.h"
+#include "fragments.h"
+#include "match_ring.h"
+#include "split_stream.h"
+#include "vlc.h"
 
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+// Flags that store the tokens in split streams instead of a single bit stream.
+#define ROLZ_SPLIT_LAYOUTS (ROLZ_FLAG_SPLIT_STREAMS | ROLZ_FLAG_LITERAL_RUNS)
+
+// With ROLZ_FLAG_EXPLICIT_OFFSETS a match may give a distance back instead, and then the steps don't count.
 typedef struct match_t
 {
     u32 steps;
     u32 length;
+    u32 distance; // 0 for a context match.
 } match_t;
 
+#define ROLZ_EXPLICIT_MAX_OFFSET (((u64)1 << ROLZ_EXPLICIT_OFFSET_BITS) - 1)
+
+// With ROLZ_FLAG_LONG_MATCHES, the longest match the encoder takes, another one follows past it. The rest of the
+// length after max_count takes an Exp-Golomb code of this order.
+#define ROLZ_LONG_MATCH_LIMIT ((u32)1 << 16)
+#define ROLZ_LONG_MATCH_GOLOMB_ORDER 2
+
+// Runs of a byte at least this long (or as long as a match gets) are taken without following the chain.
+#define ROLZ_RUN_MINIMUM 32
+
+// The fields have to fit a shift of an int, and the dictionary takes 8 bytes per history position, so 24 bits are
+// 128MB already.
+static const u8 ROLZ_MAXIMUM_STEP_BITS = 16;
+static const u8 ROLZ_MAXIMUM_COUNT_BITS = 16;
+static const u8 ROLZ_MAXIMUM_HISTORY_BUFFER_BITS = 24;
+
 _API rolz_config_t rolz_config_init(u8 step_bits, u8 count_bits, u8 minimum_match, u8 history_buffer_bits)
 {
+    step_bits = MAX(1, MIN(step_bits, ROLZ_MAXIMUM_STEP_BITS));
+    count_bits = MAX(1, MIN(count_bits, ROLZ_MAXIMUM_COUNT_BITS));
+    history_buffer_bits = MAX(1, MIN(history_buffer_bits, ROLZ_MAXIMUM_HISTORY_BUFFER_BITS));
+    minimum_match = MAX(1, minimum_match);
+
     return (rolz_config_t){
         .step_bits = step_bits,
         .max_step = (1 << step_bits) - 1,
@@ -22,32 +56,78 @@ _API rolz_config_t rolz_config_init(u8 step_bits, u8 count_bits, u8 minimum_matc
         .max_offset = (1 << history_buffer_bits) - 1,
 
         .minimum_match = minimum_match,
+
+        .flags = 0,
+        .match_threads = 0,
     };
 }
 
-_API u32 rolz_get_upper_bound(u32 input_length)
+_API u64 rolz_get_upper_bound(u64 input_length)
 {
-    // We sum all bits in the worst case scenario: 32 for the total input length and input_lenght * 9 (literal flag + byte)
-    u32 total_bits = 32 + input_length * 9;
+    // We sum all bits in the worst case scenario: 80 for the total input length (a 64-bit VLQ) and input_lenght * 9 (literal flag + byte)
+    u64 total_bits = 80 + input_length * 9;
 
     // If it's divisible by 8, we return the length. If not we sum 1 to account for the extra bits.
-    return (total_bits / 8) + ((total_bits % 8 > 0) ? 1 : 0);
+    // The split streams variant adds its stream lengths and padding on top.
+    return (total_bits / 8) + ((total_bits % 8 > 0) ? 1 : 0) + SPLIT_STREAM_OVERHEAD;
+}
+
+static ALWAYS_INLINE u32 __longest_match(rolz_config_t config)
+{
+    return (config.flags & ROLZ_FLAG_LONG_MATCHES) ? MAX(ROLZ_LONG_MATCH_LIMIT, config.max_count) : config.max_count;
+}
+
+// Where the run of equal bytes holding position ends. Searches only go forward, so the end found last time holds as
+// long as position is before it, and a run gets scanned once instead of once for every position in it.
+static ALWAYS_INLINE u64 __run_end(array_t input, fragments_t *gather, u64 position, u64 *run_end)
+{
+    if (*run_end > position)
+        return *run_end;
+
+    u64 end = position + 1;
+    if (end < input.length)
+        end += fragments_match_length(input, gather, end, position, input.length - end);
+
+    return *run_end = end;
 }
 
-static inline match_t __get_longest_match(rolz_config_t config, array_t input, u32 index, u32 *dictionary, u32 buffer_mask)
+// index is the byte before the match. run_end caches the end of the last run of equal bytes, for searches going
+// forward through the input. With gather the input is read through its fragments.
+static ALWAYS_INLINE match_t __get_longest_match(rolz_config_t config, array_t input, fragments_t *gather, u64 index, u64 *dictionary, u32 buffer_mask,
+                                                 u64 *run_end)
 {
     // If index-length difference is smaller than minimum match, we can't match a pair.
     if (index + config.minimum_match >= input.length)
         return (match_t){.steps = 0, .length = 0};
 
-    u32 last_position = index;
+    const u32 limit = __longest_match(config);
+
+    // In a run the last position after the same byte is the one right before, and steps 0 matches as far as the run
+    // goes. Every other step would compare the same bytes again, and only one reaching back to the same bytes before
+    // an earlier run could get further, so a long enough run is taken as it is.
+    if (index > 0 && fragments_input_byte(input, gather, index - 1) == fragments_input_byte(input, gather, index))
+    {
+        u64 run = __run_end(input, gather, index, run_end) - index - 1;
+
+        if (run >= MIN(limit, ROLZ_RUN_MINIMUM))
+            return (match_t){.steps = 0, .length = (u32)MIN(run, limit)};
+    }
+
+    u64 last_position = index;
+    const u64 available = MIN(limit, input.length - index - 1);
+
+    // Most windows sit in one fragment, which then gets compared as a buffer of its own, with the positions counted
+    // from the window's start.
+    const u64 oldest = (config.max_offset > index) ? 0 : index - config.max_offset;
+    u8 *window = gather ? fragments_span(gather, oldest, index + 1 + available) : NULL;
+    const array_t window_input = {.bytes = window, .length = index + 1 + available - oldest};
 
     u32 max_count = 0, max_steps = 0;
     u32 steps = 0;
 
     while (1)
     {
-        u32 position = dictionary[last_position & buffer_mask];
+        u64 position = dictionary[last_position & buffer_mask];
 
         // We reached the index or there is no other match.
         if (position >= last_position)
@@ -57,21 +137,18 @@ static inline match_t __get_longest_match(rolz_config_t config, array_t input, u
         if ((index - position) > config.max_offset)
             break;
 
-        u32 count = 0;
-
-        while (count < config.max_count && (index + count + 1) < input.length)
-        {
-            // If the current byte is equal to the previous match
-            if (input.bytes[index + count + 1] == input.bytes[position + count + 1])
-                count += 1;
-            else
-                break;
-        }
+        // The bytes after both of them.
+        u32 count = window ? (u32)fragments_match_length(window_input, NULL, index + 1 - oldest, position + 1 - oldest, available)
+                           : (u32)fragments_match_length(input, gather, index + 1, position + 1, available);
 
         if (count > max_count)
         {
             max_count = count;
             max_steps = steps;
+
+            // Nothing further back can be longer.
+            if (count == limit)
+                break;
         }
 
         if (steps >= config.max_step)
@@ -84,183 +161,1375 @@ static inline match_t __get_longest_match(rolz_config_t config, array_t input, u
     return (match_t){.steps = max_steps, .length = max_count};
 }
 
-#define try(fn)       \
-    if ((error = fn)) \
-        goto error_exit;
+// Order of the steps' Exp-Golomb code. Recent positions are picked a bit more often than old ones, but steps still
+// spread over most of their range, so only the first few get cheaper. Counts are spread evenly over theirs with
+// text and stay fixed, a variable code loses there.
+static ALWAYS_INLINE u8 __steps_golomb_order(rolz_config_t config) { return config.step_bits / 2 + 1; }
 
-_API error_t rolz_encode(rolz_config_t config, array_t input, array_t *output)
+// With long matches, a count of max_count is followed by the rest of the length.
+static ALWAYS_INLINE u8 __is_extended(rolz_config_t config, u32 length) { return (config.flags & ROLZ_FLAG_LONG_MATCHES) && length >= config.max_count; }
+
+static ALWAYS_INLINE u32 __count_bits(rolz_config_t config, u32 length)
+{
+    if (__is_extended(config, length))
+        return config.count_bits + vlc_golomb_bits(length - config.max_count, ROLZ_LONG_MATCH_GOLOMB_ORDER);
+
+    return config.count_bits;
+}
+
+static ALWAYS_INLINE error_t __write_count(rolz_config_t config, bit_stream_t *stream, u32 length)
 {
     error_t error = ERROR_ALL_GOOD;
 
-    // If there are no input bytes, we don't have to do anything.
-    if (input.length == 0)
-        return ERROR_NO_OP;
+    if (!__is_extended(config, length))
+        return bit_stream_write_bits(stream, length, config.count_bits);
 
-    // Rolz dictionary creation
-    u32 buffer_mask = (1 << config.history_buffer_bits) - 1;
-    u32 last_position_lookup[256] = {0};
-    u32 *dictionary = (u32 *)malloc((buffer_mask + 1) * sizeof(u32));
+    if ((error = bit_stream_write_bits(stream, config.max_count, config.count_bits)))
+        return error;
 
-    if (dictionary == NULL)
-        return ERROR_COULD_NOT_ALLOCATE;
+    return vlc_write_golomb(stream, length - config.max_count, ROLZ_LONG_MATCH_GOLOMB_ORDER);
+}
+
+// The rest of a long count, once its field has been read. A length that doesn't fit is corrupt input.
+static ALWAYS_INLINE error_t __read_count_extension(rolz_config_t config, bit_stream_t *stream, const vlc_table_t *table, u32 *count)
+{
+    error_t error = ERROR_ALL_GOOD;
 
-    u32 dictionary_index = 0;
+    if (!(config.flags & ROLZ_FLAG_LONG_MATCHES) || *count != config.max_count)
+        return error;
 
-    bit_stream_t stream = bit_stream_init(*output);
+    u32 rest = 0;
+    if ((error = vlc_read_golomb(stream, table, ROLZ_LONG_MATCH_GOLOMB_ORDER, &rest)))
+        return error;
+
+    if (rest > UINT32_MAX - *count)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    *count += rest;
+    return error;
+}
+
+// Match fields are the same in every layout, only the stream they go to changes.
+static ALWAYS_INLINE u32 __match_bits(rolz_config_t config, match_t match)
+{
+    // An explicit match spends a count of 0 on top of its fields.
+    if (match.distance)
+        return config.count_bits + __count_bits(config, match.length) + ROLZ_EXPLICIT_OFFSET_BITS;
+
+    if (config.flags & ROLZ_FLAG_VARIABLE_CODES)
+        return __count_bits(config, match.length) + vlc_golomb_bits(match.steps, __steps_golomb_order(config));
+
+    return __count_bits(config, match.length) + config.step_bits;
+}
+
+// A match has to be cheaper than the literals it replaces (9 bits each at most), which is what the upper bound
+// relies on. token_bits is what the layout spends on top of the fields to tell it from a literal.
+static ALWAYS_INLINE u8 __is_match_worth_it(rolz_config_t config, match_t match, u32 token_bits)
+{
+    return match.length >= config.minimum_match && token_bits + __match_bits(config, match) <= 9 * match.length;
+}
+
+static ALWAYS_INLINE error_t __write_match(rolz_config_t config, bit_stream_t *stream, match_t match)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (match.distance)
+    {
+        if ((error = bit_stream_write_bits(stream, 0, config.count_bits)) || (error = __write_count(config, stream, match.length)))
+            return error;
+
+        return bit_stream_write_bits(stream, match.distance, ROLZ_EXPLICIT_OFFSET_BITS);
+    }
+
+    if ((error = __write_count(config, stream, match.length)))
+        return error;
+
+    if (config.flags & ROLZ_FLAG_VARIABLE_CODES)
+        return vlc_write_golomb(stream, match.steps, __steps_golomb_order(config));
+
+    return bit_stream_write_bits(stream, match.steps, config.step_bits);
+}
+
+// distance is 0 unless the match is an explicit one.
+static ALWAYS_INLINE error_t __read_match(rolz_config_t config, bit_stream_t *stream, const vlc_table_t *table, u32 *count, u32 *steps, u32 *distance)
+{
+    error_t error = ERROR_ALL_GOOD;
 
-    try(bit_stream_write_7bit_int32(&stream, input.length));
+    *distance = 0;
 
-    u32 index = 0;
+    if ((error = bit_stream_read_bits(stream, count, config.count_bits)))
+        return error;
 
-    do
+    if ((config.flags & ROLZ_FLAG_EXPLICIT_OFFSETS) && *count == 0)
     {
-        u8 byte = input.bytes[index];
-        dictionary[dictionary_index & buffer_mask] = last_position_lookup[byte];
-        last_position_lookup[byte] = dictionary_index;
-        dictionary_index += 1;
+        if ((error = bit_stream_read_bits(stream, count, config.count_bits)) || (error = __read_count_extension(config, stream, table, count)) ||
+            (error = bit_stream_read_bits(stream, distance, ROLZ_EXPLICIT_OFFSET_BITS)))
+            return error;
 
-        try(bit_stream_write_bit(&stream, 0));
-        try(bit_stream_write_int(&stream, byte, 8));
+        return *count == 0 || *distance == 0 ? ERROR_BUFFER_OUT_OF_BOUNDS : ERROR_ALL_GOOD;
+    }
 
-        while (1)
-        {
-            match_t match = __get_longest_match(config, input, index, dictionary, buffer_mask);
+    if ((error = __read_count_extension(config, stream, table, count)))
+        return error;
 
-            if (match.length >= config.minimum_match)
-            {
-                try(bit_stream_write_bit(&stream, 1));
-                try(bit_stream_write_int(&stream, match.length, config.count_bits));
-                try(bit_stream_write_int(&stream, match.steps, config.step_bits));
-
-                for (u32 i = 0; i < match.length; i += 1)
-                {
-                    index += 1;
-                    u8 literal = input.bytes[index];
-                    dictionary[dictionary_index & buffer_mask] = last_position_lookup[literal];
-                    last_position_lookup[literal] = dictionary_index;
-                    dictionary_index += 1;
-                }
-            }
-            else
-                break;
-        }
-        index += 1;
-    } while (index < input.length);
+    if (config.flags & ROLZ_FLAG_VARIABLE_CODES)
+        return vlc_read_golomb(stream, table, __steps_golomb_order(config), steps);
 
-    try(bit_stream_flush(&stream));
+    return bit_stream_read_bits(stream, steps, config.step_bits);
+}
 
-    goto no_error_exit;
+// The frame defaults get copies of the codec of their own, built with the field widths and the history size as
+// compile-time constants, so the bit packing unrolls and the masks fold. Flags stay a runtime choice, and other
+// configs take the generic copy.
+#define ROLZ_PRESET_STEP_BITS 8
+#define ROLZ_PRESET_COUNT_BITS 4
+#define ROLZ_PRESET_MINIMUM_MATCH 2
+#define ROLZ_PRESET_HISTORY_BUFFER_BITS 16
 
-error_exit:
-    free(dictionary);
-    output->length = 0;
-    return error;
+static inline rolz_config_t __preset_config(u8 flags)
+{
+    return (rolz_config_t){
+        .step_bits = ROLZ_PRESET_STEP_BITS,
+        .max_step = (1 << ROLZ_PRESET_STEP_BITS) - 1,
 
-no_error_exit:
-    free(dictionary);
-    output->length = stream.buffer_position;
-    return ERROR_ALL_GOOD;
+        .count_bits = ROLZ_PRESET_COUNT_BITS,
+        .max_count = (1 << ROLZ_PRESET_COUNT_BITS) - 1,
+
+        .history_buffer_bits = ROLZ_PRESET_HISTORY_BUFFER_BITS,
+        .max_offset = (1 << ROLZ_PRESET_HISTORY_BUFFER_BITS) - 1,
+
+        .minimum_match = ROLZ_PRESET_MINIMUM_MATCH,
+
+        .flags = flags,
+    };
 }
 
-_API error_t rolz_get_original_length(array_t input, u32 *original_length)
+static inline u8 __is_preset(rolz_config_t config)
 {
-    bit_stream_t stream = bit_stream_init(input);
+    const rolz_config_t preset = __preset_config(config.flags);
 
-    u32 length = 0;
-    error_t error = bit_stream_read_7bit_int32(&stream, &length);
+    return config.step_bits == preset.step_bits && config.max_step == preset.max_step && config.count_bits == preset.count_bits &&
+           config.max_count == preset.max_count && config.history_buffer_bits == preset.history_buffer_bits && config.max_offset == preset.max_offset &&
+           config.minimum_match == preset.minimum_match;
+}
 
-    if (error)
+// Follows the chain from the byte before index, like the encoder did when it counted the steps. Every link the
+// encoder follows goes strictly back, so a link that doesn't means corrupt input, and checking that is enough to
+// stay on slots already written and to land before index.
+static ALWAYS_INLINE error_t __walk_steps(const u64 *dictionary, u32 buffer_mask, u64 index, u32 steps, u64 *position)
+{
+    // A match always follows at least one literal.
+    if (index == 0)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    u64 current = index - 1;
+
+    for (u32 i = 0; i <= steps; i += 1)
     {
-        *original_length = 0;
+        u64 next = dictionary[current & buffer_mask];
+
+        if (next >= current)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        current = next;
+    }
+
+    *position = current;
+    return ERROR_ALL_GOOD;
+}
+
+// How far back a match's source starts, from its distance or its steps.
+static ALWAYS_INLINE error_t __match_offset(const u64 *dictionary, u32 buffer_mask, u64 index, u32 steps, u32 distance, u64 *offset)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (distance)
+    {
+        if (distance > index)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        *offset = distance;
         return error;
     }
 
-    *original_length = length;
+    u64 position = 0;
+    if ((error = __walk_steps(dictionary, buffer_mask, index, steps, &position)))
+        return error;
+
+    *offset = index - 1 - position;
     return error;
 }
 
-_API error_t rolz_decode(rolz_config_t config, array_t input, array_t *output)
+#define try(fn)       \
+    if ((error = fn)) \
+        goto error_exit;
+
+_API u64 rolz_get_in_place_margin_bound(u64 input_length)
 {
-    error_t error = ERROR_ALL_GOOD;
+    // The decoder can only catch up with its input when what's left of it expands, and literals expand by 1/8 at most.
+    return input_length / 8 + 16;
+}
 
-    // If there are no input bytes, we don't have to do anything.
-    if (input.length == 0 || output->length == 0)
-        return ERROR_NO_OP;
+// Sequences buffered between the parse and the back end: small enough to stay in cache, big enough that going back
+// and forth between the two doesn't show.
+#define ROLZ_SEQUENCE_CHUNK 4096
 
-    // Rolz dictionary creation
-    u32 buffer_mask = (1 << config.history_buffer_bits) - 1;
-    u32 last_position_lookup[256] = {0};
-    u32 *dictionary = (u32 *)malloc((buffer_mask + 1) * sizeof(u32));
+// Puts the positions [first, first + count) of a run of byte in the dictionary: the first links to the last one
+// before, the others to the position right before them. Slots come back every buffer, so only the last buffer's worth
+// of positions gets written, which leaves the dictionary as if they all had been.
+static ALWAYS_INLINE void __insert_run(u64 *dictionary, u32 buffer_mask, u64 *last_position_lookup, u8 byte, u64 first, u64 count)
+{
+    u64 i = count > (u64)buffer_mask + 1 ? count - buffer_mask - 1 : 0;
 
-    if (dictionary == NULL)
-        return ERROR_COULD_NOT_ALLOCATE;
+    if (i == 0)
+    {
+        dictionary[first & buffer_mask] = last_position_lookup[byte];
+        i = 1;
+    }
 
-    u32 dictionary_index = 0;
+    for (; i < count; i += 1)
+        dictionary[(first + i) & buffer_mask] = first + i - 1;
 
-    bit_stream_t stream = bit_stream_init(input);
+    last_position_lookup[byte] = first + count - 1;
+}
+
+// Explicit matches come from hash chains over the positions the distance field reaches back to, on their first
+// ROLZ_EXPLICIT_HASH_LENGTH bytes. Only the parse searches them, finder threads keep to the context matches.
+#define ROLZ_EXPLICIT_HASH_BITS 15
+#define ROLZ_EXPLICIT_HASH_LENGTH 3
+#define ROLZ_EXPLICIT_CHAIN_DEPTH 16
 
-    u32 total_length = 0;
-    try(bit_stream_read_7bit_int32(&stream, &total_length));
+typedef struct explicit_finder_t
+{
+    u64 *heads;  // Last position of every hash.
+    u64 *chains; // Position before with the same hash, indexed by position.
+} explicit_finder_t;
+
+// Where a parse stopped, so it can pick up from there once the sequences so far have been written. The dictionary
+// slots are indexed by input position.
+typedef struct parser_t
+{
+    u64 index; // Next byte to parse.
+    u64 *dictionary;
+    u64 last_position_lookup[256];
+    explicit_finder_t explicit_finder;
+    u64 run_end;
+    fragments_t *gather; // The input's fragments, NULL when it's one buffer.
+} parser_t;
+
+static ALWAYS_INLINE u32 __explicit_hash(const u8 *bytes)
+{
+    u32 sequence = (u32)bytes[0] | (u32)bytes[1] << 8 | (u32)bytes[2] << 16;
+    return (sequence * 2654435761u) >> (32 - ROLZ_EXPLICIT_HASH_BITS);
+}
+
+// Adds the positions in [first, last) that have enough bytes after them to hash.
+static ALWAYS_INLINE void __explicit_insert(explicit_finder_t *finder, array_t input, fragments_t *gather, u64 first, u64 last)
+{
+    u8 stitch[ROLZ_EXPLICIT_HASH_LENGTH];
 
-    if (total_length != output->length)
+    for (u64 position = first; position < last && position + ROLZ_EXPLICIT_HASH_LENGTH <= input.length; position += 1)
     {
-        error = ERROR_WRONG_OUTPUT_SIZE;
-        goto error_exit;
+        u64 *head = finder->heads + __explicit_hash(fragments_input_bytes(input, gather, position, ROLZ_EXPLICIT_HASH_LENGTH, stitch));
+
+        finder->chains[position & ROLZ_EXPLICIT_MAX_OFFSET] = *head;
+        *head = position;
     }
+}
 
-    u32 index = 0;
+// The longest match reaching back to a position before index, within reach of the distance field. Every link the
+// finder follows has to go strictly back, and a slot only gets written again once its position is out of reach, so
+// an unwritten or stale link ends the chain. Candidates are checked byte by byte, hashes collide.
+static ALWAYS_INLINE match_t __get_explicit_match(rolz_config_t config, array_t input, fragments_t *gather, u64 index, const explicit_finder_t *finder)
+{
+    match_t best = {.steps = 0, .length = 0, .distance = 0};
 
-    while (index < output->length)
+    if (index + ROLZ_EXPLICIT_HASH_LENGTH > input.length)
+        return best;
+
+    u8 stitch[ROLZ_EXPLICIT_HASH_LENGTH];
+    const u32 max_length = (u32)MIN((u64)__longest_match(config), input.length - index);
+    u64 candidate = finder->heads[__explicit_hash(fragments_input_bytes(input, gather, index, ROLZ_EXPLICIT_HASH_LENGTH, stitch))];
+
+    for (u32 depth = 0; depth < ROLZ_EXPLICIT_CHAIN_DEPTH && candidate < index && index - candidate <= ROLZ_EXPLICIT_MAX_OFFSET; depth += 1)
     {
-        u8 is_pair = 0;
-        try(bit_stream_read_bit(&stream, &is_pair));
+        u32 length = (u32)fragments_match_length(input, gather, index, candidate, max_length);
 
-        if (is_pair)
+        if (length > best.length)
         {
-            u32 count = 0;
-            try(bit_stream_read_int(&stream, &count, config.count_bits));
+            best = (match_t){.steps = 0, .length = length, .distance = (u32)(index - candidate)};
 
-            u32 steps = 0;
-            try(bit_stream_read_int(&stream, &steps, config.step_bits));
+            if (length == max_length)
+                break;
+        }
 
-            // Find the position from the amount of steps.
-            u32 position = index - 1;
-            for (u32 i = 0; i <= steps; i += 1)
-                position = dictionary[position & buffer_mask];
+        u64 next = finder->chains[candidate & ROLZ_EXPLICIT_MAX_OFFSET];
 
-            u32 offset = index - 1 - position;
-            for (u32 i = 0; i < count; i += 1)
-            {
-                u8 literal = output->bytes[index - offset];
+        if (next >= candidate)
+            break;
 
-                // We update the dictionary.
-                dictionary[dictionary_index & buffer_mask] = last_position_lookup[literal];
-                last_position_lookup[literal] = dictionary_index;
-                dictionary_index += 1;
+        candidate = next;
+    }
 
-                // And output the literal.
-                output->bytes[index] = literal;
-                index += 1;
-            }
+    return best;
+}
+
+// With history, the positions the distance field reaches back to go in first.
+static error_t __explicit_init(rolz_config_t config, explicit_finder_t *finder, array_t input, fragments_t *gather, u64 start)
+{
+    *finder = (explicit_finder_t){.heads = NULL, .chains = NULL};
+
+    if (!(config.flags & ROLZ_FLAG_EXPLICIT_OFFSETS))
+        return ERROR_ALL_GOOD;
+
+    finder->heads = (u64 *)calloc((u64)1 << ROLZ_EXPLICIT_HASH_BITS, sizeof(u64));
+    finder->chains = (u64 *)calloc(ROLZ_EXPLICIT_MAX_OFFSET + 1, sizeof(u64));
+
+    if (!finder->heads || !finder->chains)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    __explicit_insert(finder, input, gather, start > ROLZ_EXPLICIT_MAX_OFFSET ? start - ROLZ_EXPLICIT_MAX_OFFSET : 0, start);
+    return ERROR_ALL_GOOD;
+}
+
+static void __explicit_free(explicit_finder_t *finder)
+{
+    free(finder->heads);
+    free(finder->chains);
+    *finder = (explicit_finder_t){.heads = NULL, .chains = NULL};
+}
+
+// Context matches are so cheap that the bytes after one mostly go in another, not in literals, so a longer explicit
+// match only pays off when it costs less per byte. Without one, short explicit matches tend to take the bytes a
+// context match would have covered from the next one on, so they have to be long enough to be worth it on their own.
+// The context match wins a tie.
+#define ROLZ_EXPLICIT_MINIMUM_ALONE 8
+
+static ALWAYS_INLINE match_t __choose_match(rolz_config_t config, match_t context, match_t explicit_match, u32 token_bits)
+{
+    if (!__is_match_worth_it(config, explicit_match, token_bits))
+        return context;
+
+    if (!__is_match_worth_it(config, context, token_bits))
+        return explicit_match.length >= ROLZ_EXPLICIT_MINIMUM_ALONE ? explicit_match : context;
+
+    u64 context_bits = token_bits + __match_bits(config, context);
+    u64 explicit_bits = token_bits + __match_bits(config, explicit_match);
+
+    return explicit_bits * context.length < context_bits * explicit_match.length ? explicit_match : context;
+}
+
+// Matches follow the byte before them, so every byte is first searched as the start of a match after the one before
+// it, and becomes a literal when there's none worth it. With history the first search runs on the last history byte,
+// which the decoder already holds. token_bits is what the layout spends on top of the fields to tell a match from a
+// literal. With a ring the matches come from the finder threads, which keep the dictionaries then. Explicit matches
+// start at the byte itself, and are searched for here either way.
+static ALWAYS_INLINE void __parse(rolz_config_t config, array_t input, u32 token_bits, parser_t *parser, match_ring_t *ring, sequence_buffer_t *sequences)
+{
+    const u32 buffer_mask = (1 << config.history_buffer_bits) - 1;
+    u64 *dictionary = parser->dictionary;
+    fragments_t *gather = parser->gather;
+    u64 index = parser->index;
+
+    // A local copy keeps the lookup out of the dictionary's way, the compiler can't tell they don't overlap otherwise.
+    u64 last_position_lookup[256];
+    memcpy(last_position_lookup, parser->last_position_lookup, sizeof(last_position_lookup));
+
+    while (index < input.length && sequences->count < sequences->capacity)
+    {
+        match_t match = {.steps = 0, .length = 0};
+
+        if (index > 0 && ring)
+        {
+            const match_candidate_t *candidate = match_ring_get(ring, index - 1);
+            match = (match_t){.steps = candidate->offset, .length = candidate->length};
+        }
+        else if (index > 0)
+            match = __get_longest_match(config, input, gather, index - 1, dictionary, buffer_mask, &parser->run_end);
+
+        // A context match as long as a run gets leaves an explicit one next to nothing to gain.
+        if ((config.flags & ROLZ_FLAG_EXPLICIT_OFFSETS) && index > 0 && match.length < ROLZ_RUN_MINIMUM)
+            match = __choose_match(config, match, __get_explicit_match(config, input, gather, index, &parser->explicit_finder), token_bits);
+
+        u64 end = index + 1;
+
+        if (__is_match_worth_it(config, match, token_bits))
+        {
+            sequence_buffer_add_match(sequences, match.length, match.distance ? match.distance | ROLZ_SEQUENCE_EXPLICIT_OFFSET : match.steps);
+            end = index + match.length;
         }
         else
+            sequence_buffer_add_literals(sequences, 1);
+
+        if (config.flags & ROLZ_FLAG_EXPLICIT_OFFSETS)
+            __explicit_insert(&parser->explicit_finder, input, gather, index, end);
+
+        if (ring)
+            index = end;
+
+        // A run of the byte before, which only needs its last dictionary buffer's worth of positions written.
+        if (end - index >= ROLZ_RUN_MINIMUM && match.distance == 0 && match.steps == 0 && index >= 2 &&
+            fragments_input_byte(input, gather, index - 2) == fragments_input_byte(input, gather, index - 1))
         {
-            u32 literal = 0;
-            try(bit_stream_read_int(&stream, &literal, 8));
+            __insert_run(dictionary, buffer_mask, last_position_lookup, fragments_input_byte(input, gather, index), index, end - index);
+            index = end;
+        }
 
-            // We update the dictionary.
-            dictionary[dictionary_index & buffer_mask] = last_position_lookup[(u8)literal];
-            last_position_lookup[(u8)literal] = dictionary_index;
-            dictionary_index += 1;
+        for (; index < end; index += 1)
+        {
+            u8 byte = fragments_input_byte(input, gather, index);
+            dictionary[index & buffer_mask] = last_position_lookup[byte];
+            last_position_lookup[byte] = index;
+        }
+    }
 
-            // And output the literal
-            output->bytes[index] = (u8)literal;
-            index += 1;
+    memcpy(parser->last_position_lookup, last_position_lookup, sizeof(last_position_lookup));
+    parser->index = index;
+}
+
+// A finder thread's side, with a dictionary of its own, and cursors of its own into the fragments when there are some.
+typedef struct finder_t
+{
+    rolz_config_t config;
+    array_t input;
+    fragments_t fragments;
+    fragments_t *gather;
+    u64 *dictionary;
+    u64 last_position_lookup[256];
+    u64 position; // Next byte to go into the dictionary.
+    u64 run_end;
+} finder_t;
+
+// Searches every position in [first, last) like the parse does, after bringing the dictionary up to first. Chains
+// stop at positions more than a history buffer back, so when the last chunk ended further back than that, the
+// dictionary starts over a history buffer before first and gives the same matches.
+static ALWAYS_INLINE void __find_range(rolz_config_t config, finder_t *finder, u64 first, u64 last, match_candidate_t *candidates)
+{
+    const u32 buffer_mask = (1 << config.history_buffer_bits) - 1;
+    const array_t input = finder->input;
+    fragments_t *gather = finder->gather;
+    u64 *dictionary = finder->dictionary;
+    u64 position = finder->position;
+
+    u64 last_position_lookup[256];
+    memcpy(last_position_lookup, finder->last_position_lookup, sizeof(last_position_lookup));
+
+    if (first - position > (u64)buffer_mask + 1)
+    {
+        position = first - buffer_mask - 1;
+        memset(last_position_lookup, 0, sizeof(last_position_lookup));
+    }
+
+    for (; position < first; position += 1)
+    {
+        u8 byte = fragments_input_byte(input, gather, position);
+        dictionary[position & buffer_mask] = last_position_lookup[byte];
+        last_position_lookup[byte] = position;
+    }
+
+    for (; position < last; position += 1)
+    {
+        u8 byte = fragments_input_byte(input, gather, position);
+        dictionary[position & buffer_mask] = last_position_lookup[byte];
+        last_position_lookup[byte] = position;
+
+        match_t match = __get_longest_match(config, input, gather, position, dictionary, buffer_mask, &finder->run_end);
+        candidates[position - first] = (match_candidate_t){.offset = match.steps, .length = match.length};
+    }
+
+    memcpy(finder->last_position_lookup, last_position_lookup, sizeof(last_position_lookup));
+    finder->position = last;
+}
+
+static void __find_matches(void *context, u64 first, u64 last, match_candidate_t *candidates)
+{
+    finder_t *finder = (finder_t *)context;
+
+    if (__is_preset(finder->config))
+        __find_range(__preset_config(finder->config.flags), finder, first, last, candidates);
+    else
+        __find_range(finder->config, finder, first, last, candidates);
+}
+
+// The back end's side: where it is in the input, and with track_margin the largest difference between bytes decoded
+// and compressed bytes read, after each token.
+typedef struct coder_t
+{
+    u64 position;
+    fragments_t *gather; // The input's fragments, NULL when it's one buffer.
+
+    i64 max_ahead;
+    u8 track_margin;
+} coder_t;
+
+// The decoder has read every byte the last token touches, including the partially written one.
+static ALWAYS_INLINE void __track_margin(coder_t *coder, const bit_stream_t *stream)
+{
+    if (!coder->track_margin)
+        return;
+
+    i64 ahead = (i64)coder->position - (i64)(stream->buffer_position + (stream->bit_count > 0));
+    coder->max_ahead = ahead > coder->max_ahead ? ahead : coder->max_ahead;
+}
+
+// Without split, the tokens go to the single stream.
+static ALWAYS_INLINE error_t __write_literals(array_t input, u64 count, coder_t *coder, bit_stream_t *stream, split_stream_t *split)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (count > input.length - coder->position)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    for (u64 end = coder->position + count; coder->position < end;)
+    {
+        u8 literal = fragments_input_byte(input, coder->gather, coder->position++);
+
+        if (split)
+        {
+            split_stream_write_literal(split, literal);
+            continue;
         }
+
+        if ((error = bit_stream_write_bits(stream, 0, 1)) || (error = bit_stream_write_bits(stream, literal, 8)))
+            return error;
+
+        __track_margin(coder, stream);
     }
 
-error_exit:
-    free(dictionary);
+    return error;
+}
+
+static ALWAYS_INLINE error_t __write_sequence_match(rolz_config_t config, array_t input, const sequence_t *sequence, coder_t *coder, bit_stream_t *stream,
+                                                   split_stream_t *split)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    match_t match = {.steps = sequence->offset, .length = sequence->match_length, .distance = 0};
+
+    if (sequence->offset & ROLZ_SEQUENCE_EXPLICIT_OFFSET)
+        match = (match_t){.steps = 0, .length = sequence->match_length, .distance = sequence->offset & ~ROLZ_SEQUENCE_EXPLICIT_OFFSET};
+
+    // Sequences may come from any parser, so they're checked against what the format and the input allow. The steps
+    // can't be, that needs the dictionary, the decoder turns down the ones that lead nowhere.
+    if (match.length == 0 || match.length > __longest_match(config) || match.length > input.length - coder->position || coder->position == 0)
+        return ERROR_UNKNOWN_FORMAT;
+
+    if (match.distance == 0 && (match.length < config.minimum_match || match.steps > config.max_step))
+        return ERROR_UNKNOWN_FORMAT;
+
+    if (match.distance && (!(config.flags & ROLZ_FLAG_EXPLICIT_OFFSETS) || match.distance > ROLZ_EXPLICIT_MAX_OFFSET || match.distance > coder->position))
+        return ERROR_UNKNOWN_FORMAT;
+
+    if (split)
+    {
+        split_stream_write_match_flag(split);
+        error = __write_match(config, &split->matches, match);
+    }
+    else if (!(error = bit_stream_write_bits(stream, 1, 1)))
+        error = __write_match(config, stream, match);
+
+    if (error)
+        return error;
+
+    coder->position += match.length;
+
+    if (!split)
+        __track_margin(coder, stream);
+
+    return error;
+}
+
+// The literals at the end of the buffer are only written when it's the last one, otherwise the next sequence
+// starts with them.
+static ALWAYS_INLINE error_t __write_sequences(rolz_config_t config, array_t input, const sequence_buffer_t *sequences, u8 is_last, coder_t *coder,
+                                              bit_stream_t *stream, split_stream_t *split)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    for (u64 i = 0; i < sequences->count; i += 1)
+    {
+        if ((error = __write_literals(input, sequences->sequences[i].literal_count, coder, stream, split)))
+            return error;
+
+        if ((error = __write_sequence_match(config, input, &sequences->sequences[i], coder, stream, split)))
+            return error;
+    }
+
+    if (is_last)
+        return __write_literals(input, sequences->literal_count, coder, stream, split);
+
+    return error;
+}
+
+// Every layout gets a copy of the back end of its own.
+static ALWAYS_INLINE error_t __write_any(rolz_config_t config, array_t input, const sequence_buffer_t *sequences, u8 is_last, coder_t *coder,
+                                        bit_stream_t *stream, split_stream_t *split)
+{
+    if (split)
+        return __write_sequences(config, input, sequences, is_last, coder, stream, split);
+
+    return __write_sequences(config, input, sequences, is_last, coder, stream, NULL);
+}
+
+// Parses a chunk of sequences and writes it out, until the input ends. With parsed, those sequences get written
+// instead, and must cover the input from start on. When in_place_margin isn't NULL we also track how far the
+// decoder's output gets ahead of its input. If context_dictionary is NULL we allocate our own, or leave the matches
+// to finder threads with config.match_threads. Message streams only encode the bytes from start on, and carry the
+// dictionary and the last positions over from the bytes before, which the decoder already holds. With gather, the
+// input is read through its fragments and only gives the length.
+static ALWAYS_INLINE error_t __encode(rolz_config_t config, array_t input, u64 start, const sequence_buffer_t *parsed, array_t *output, u64 *in_place_margin,
+                                     u64 *context_dictionary, u64 *context_lookup, fragments_t *gather)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    // If there are no input bytes, we don't have to do anything.
+    if (input.length <= start)
+        return ERROR_NO_OP;
+
+    // Rolz dictionary creation, which only the parse needs.
+    u32 buffer_mask = (1 << config.history_buffer_bits) - 1;
+    parser_t parser = {.index = start, .dictionary = context_dictionary, .last_position_lookup = {0}, .gather = gather};
+
+    // With finder threads the search runs ahead of the parse, on inputs that give them more than a chunk. The
+    // dictionary a context carries over would need the parse to keep it, so those always search here. If the threads
+    // can't be started, the parse searches on its own.
+    void *finder_contexts[UINT8_MAX];
+    finder_t *finders = NULL;
+    u64 *finder_dictionaries = NULL;
+    match_ring_t ring, *finder_ring = NULL;
+
+    if (parsed == NULL && context_dictionary == NULL && config.match_threads > 0 && input.length - start > MATCH_RING_CHUNK &&
+        (finders = (finder_t *)malloc(config.match_threads * sizeof(finder_t))) &&
+        (finder_dictionaries = (u64 *)malloc((u64)config.match_threads * (buffer_mask + 1) * sizeof(u64))))
+    {
+        for (u32 i = 0; i < config.match_threads; i += 1)
+        {
+            finders[i] = (finder_t){.config = config, .input = input, .gather = NULL, .dictionary = finder_dictionaries + (u64)i * (buffer_mask + 1),
+                                    .position = 0, .run_end = 0};
+            memset(finders[i].last_position_lookup, 0, sizeof(finders[i].last_position_lookup));
+            finder_contexts[i] = &finders[i];
+
+            // Cursors are per thread, the fragments themselves are shared.
+            if (gather)
+            {
+                finders[i].fragments = *gather;
+                finders[i].gather = &finders[i].fragments;
+            }
+        }
+
+        if (match_ring_init(&ring, start, input.length, __find_matches, finder_contexts, config.match_threads))
+            match_ring_free(&ring);
+        else
+            finder_ring = &ring;
+    }
+
+    if (parsed == NULL && finder_ring == NULL && parser.dictionary == NULL && !(parser.dictionary = (u64 *)malloc((buffer_mask + 1) * sizeof(u64))))
+    {
+        free(finders);
+        free(finder_dictionaries);
+        return ERROR_COULD_NOT_ALLOCATE;
+    }
+
+    if (context_lookup)
+        memcpy(parser.last_position_lookup, context_lookup, sizeof(parser.last_position_lookup));
+
+    // With split streams the tokens go to their own streams, and get appended to the output at the end.
+    const u8 is_split = (config.flags & ROLZ_SPLIT_LAYOUTS) != 0;
+    const u8 literal_runs = (config.flags & ROLZ_FLAG_LITERAL_RUNS) != 0;
+    split_stream_t split = {0};
+    sequence_buffer_t chunk = {0};
+
+    if (is_split && (error = split_stream_writer_init(&split, input.length - start, literal_runs)))
+        goto error_exit;
+
+    if (parsed == NULL && (error = sequence_buffer_init(&chunk, ROLZ_SEQUENCE_CHUNK)))
+        goto error_exit;
+
+    if (parsed == NULL && (error = __explicit_init(config, &parser.explicit_finder, input, gather, start)))
+        goto error_exit;
+
+    // With literal runs every match also pays for a run length, so short matches may not be worth it anymore.
+    const u32 token_bits = literal_runs ? SPLIT_STREAM_RUN_BITS : 1;
+
+    bit_stream_t stream = bit_stream_init(*output);
+
+    try(bit_stream_write_7bit_int64(&stream, input.length - start));
+
+    coder_t coder = {.position = start, .gather = gather, .max_ahead = 0, .track_margin = in_place_margin != NULL};
+
+    if (parsed)
+        try(__write_any(config, input, parsed, 1, &coder, &stream, is_split ? &split : NULL));
+
+    while (parsed == NULL && parser.index < input.length)
+    {
+        // A copy of its own, so the parse without finder threads doesn't check for them at every byte.
+        if (finder_ring)
+            __parse(config, input, token_bits, &parser, finder_ring, &chunk);
+        else
+            __parse(config, input, token_bits, &parser, NULL, &chunk);
+
+        try(__write_any(config, input, &chunk, parser.index == input.length, &coder, &stream, is_split ? &split : NULL));
+
+        // The literals after the last match stay, the next sequence starts with them.
+        chunk.count = 0;
+    }
+
+    if (coder.position != input.length)
+    {
+        error = ERROR_UNKNOWN_FORMAT;
+        goto error_exit;
+    }
+
+    try(is_split ? split_stream_writer_finish(&split, &stream) : bit_stream_flush(&stream));
+
+    goto no_error_exit;
+
+error_exit:
+    if (finder_ring)
+        match_ring_free(finder_ring);
+    free(finders);
+    free(finder_dictionaries);
+    if (parser.dictionary != context_dictionary)
+        free(parser.dictionary);
+    __explicit_free(&parser.explicit_finder);
+    sequence_buffer_free(&chunk);
+    split_stream_writer_free(&split);
+    output->length = 0;
+    return error;
+
+no_error_exit:
+    if (finder_ring)
+        match_ring_free(finder_ring);
+    free(finders);
+    free(finder_dictionaries);
+    if (parser.dictionary != context_dictionary)
+        free(parser.dictionary);
+    __explicit_free(&parser.explicit_finder);
+    if (context_lookup)
+        memcpy(context_lookup, parser.last_position_lookup, sizeof(parser.last_position_lookup));
+    sequence_buffer_free(&chunk);
+    split_stream_writer_free(&split);
+    output->length = stream.buffer_position;
+
+    // The compressed data starts (original + margin - compressed) bytes into the buffer, and the output
+    // must never pass what the decoder hasn't read yet.
+    if (in_place_margin)
+    {
+        i64 margin = coder.max_ahead - (i64)input.length + (i64)output->length;
+        *in_place_margin = margin > 0 ? (u64)margin : 0;
+    }
+
+    return ERROR_ALL_GOOD;
+}
+
+static error_t __encode_preset(u8 flags, u8 match_threads, array_t input, u64 start, array_t *output, u64 *in_place_margin, u64 *context_dictionary,
+                               u64 *context_lookup, fragments_t *gather)
+{
+    rolz_config_t config = __preset_config(flags);
+    config.match_threads = match_threads;
+
+    return __encode(config, input, start, NULL, output, in_place_margin, context_dictionary, context_lookup, gather);
+}
+
+static inline error_t __encode_any(rolz_config_t config, array_t input, u64 start, array_t *output, u64 *in_place_margin, u64 *context_dictionary,
+                                   u64 *context_lookup, fragments_t *gather)
+{
+    if (__is_preset(config))
+        return __encode_preset(config.flags, config.match_threads, input, start, output, in_place_margin, context_dictionary, context_lookup, gather);
+
+    return __encode(config, input, start, NULL, output, in_place_margin, context_dictionary, context_lookup, gather);
+}
+
+_API error_t rolz_encode(rolz_config_t config, array_t input, array_t *output)
+{
+    return __encode_any(config, input, 0, output, NULL, NULL, NULL, NULL);
+}
+
+_API error_t rolz_encode_with_margin(rolz_config_t config, array_t input, array_t *output, u64 *in_place_margin)
+{
+    *in_place_margin = 0;
+
+    // The split streams are read from three places at once, so they can't be decoded in place.
+    if (config.flags & ROLZ_SPLIT_LAYOUTS)
+        return ERROR_UNKNOWN_FORMAT;
+    return __encode_any(config, input, 0, output, in_place_margin, NULL, NULL, NULL);
+}
+
+// Not specialized for the presets, the encoders are what's worth it there.
+_API error_t rolz_parse(rolz_config_t config, array_t input, sequence_buffer_t *sequences)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    sequence_buffer_reset(sequences);
+
+    if (input.length == 0)
+        return ERROR_NO_OP;
+
+    const u32 token_bits = (config.flags & ROLZ_FLAG_LITERAL_RUNS) ? SPLIT_STREAM_RUN_BITS : 1;
+    parser_t parser = {.index = 0, .dictionary = (u64 *)malloc(((u64)1 << config.history_buffer_bits) * sizeof(u64)), .last_position_lookup = {0}};
+
+    if (parser.dictionary == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    if ((error = __explicit_init(config, &parser.explicit_finder, input, NULL, 0)))
+    {
+        __explicit_free(&parser.explicit_finder);
+        free(parser.dictionary);
+        return error;
+    }
+
+    while (parser.index < input.length)
+    {
+        if (sequences->count == sequences->capacity && (error = sequence_buffer_reserve(sequences, MAX(ROLZ_SEQUENCE_CHUNK, sequences->capacity * 2))))
+            break;
+
+        __parse(config, input, token_bits, &parser, NULL, sequences);
+    }
+
+    __explicit_free(&parser.explicit_finder);
+    free(parser.dictionary);
+    return error;
+}
+
+_API error_t rolz_encode_sequences(rolz_config_t config, array_t input, const sequence_buffer_t *sequences, array_t *output)
+{
+    return __encode(config, input, 0, sequences, output, NULL, NULL, NULL, NULL);
+}
+
+_API error_t rolz_get_original_length(array_t input, u64 *original_length)
+{
+    bit_stream_t stream = bit_stream_init(input);
+
+    u64 length = 0;
+    error_t error = bit_stream_read_7bit_int64(&stream, &length);
+
+    if (error)
+    {
+        *original_length = 0;
+        return error;
+    }
+
+    *original_length = length;
+    return error;
+}
+
+// Matches are copied byte by byte, since every byte goes through the dictionary, except runs of the byte before,
+// which are a memset and a run in the dictionary. Scattered output only goes through the fragments one byte at a time
+// when the match or its source crosses from one fragment to the next.
+static ALWAYS_INLINE void __copy_match(array_t *output, fragments_t *scatter, u64 index, u64 offset, u32 count, u64 *dictionary, u32 buffer_mask,
+                                       u64 *last_position_lookup)
+{
+    u8 *to = NULL;
+    const u8 *from = NULL;
+
+    if (scatter && count > 0)
+    {
+        to = fragments_at(scatter, &scatter->write, index);
+        from = fragments_at(scatter, &scatter->read, index - offset);
+
+        if (index + count > scatter->write.end || index - offset + count > scatter->read.end)
+        {
+            for (u32 i = 0; i < count; i += 1)
+            {
+                u8 literal = fragments_get(scatter, index - offset + i);
+
+                dictionary[(index + i) & buffer_mask] = last_position_lookup[literal];
+                last_position_lookup[literal] = index + i;
+
+                fragments_put(scatter, index + i, literal);
+            }
+
+            return;
+        }
+    }
+    else if (!scatter)
+    {
+        to = output->bytes + index;
+        from = to - offset;
+    }
+
+    if (offset == 1 && count > 0)
+    {
+        memset(to, from[0], count);
+        __insert_run(dictionary, buffer_mask, last_position_lookup, from[0], index, count);
+        return;
+    }
+
+    for (u32 i = 0; i < count; i += 1)
+    {
+        u8 literal = from[i];
+
+        // We update the dictionary, and output the literal.
+        dictionary[(index + i) & buffer_mask] = last_position_lookup[literal];
+        last_position_lookup[literal] = index + i;
+
+        to[i] = literal;
+    }
+}
+
+// Literal runs come straight from the literal stream, they only have to go through the dictionary one by one.
+// The decoder's dictionary index always equals its output index, so we use that.
+static ALWAYS_INLINE error_t __decode_split(rolz_config_t config, bit_stream_t *stream, const vlc_table_t *table, array_t *output, u64 start, u64 *dictionary,
+                                           u32 buffer_mask, u64 *last_position_lookup, fragments_t *scatter)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    split_stream_t split;
+    if ((error = split_stream_reader_init(&split, stream, (config.flags & ROLZ_FLAG_LITERAL_RUNS) != 0)))
+        return error;
+
+    for (u64 index = start; index < output->length;)
+    {
+        u64 run = 0;
+        u8 has_match = 0;
+        if ((error = split_stream_read_literal_run(&split, &run, &has_match)))
+            return error;
+
+        if (run > output->length - index || run > split.literal_count - split.literal_position)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        const u8 *literals = split.literals + split.literal_position;
+
+        for (u64 i = 0; i < run; i += 1)
+        {
+            dictionary[(index + i) & buffer_mask] = last_position_lookup[literals[i]];
+            last_position_lookup[literals[i]] = index + i;
+        }
+
+        if (scatter)
+            fragments_write(scatter, index, literals, run);
+        else
+            memcpy(output->bytes + index, literals, run);
+        split.literal_position += run;
+        index += run;
+
+        if (!has_match)
+        {
+            if (index != output->length)
+                return ERROR_BUFFER_OUT_OF_BOUNDS;
+            break;
+        }
+
+        u32 count = 0, steps = 0, distance = 0;
+        u64 offset = 0;
+        if ((error = __read_match(config, &split.matches, table, &count, &steps, &distance)) ||
+            (error = __match_offset(dictionary, buffer_mask, index, steps, distance, &offset)))
+            return error;
+
+        if (count > output->length - index)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+        __copy_match(output, scatter, index, offset, count, dictionary, buffer_mask, last_position_lookup);
+        index += count;
+    }
+
+    return error;
+}
+
+// In place, the input lives at the end of the output buffer, so we check that no token writes past what we've read.
+// Message streams decode from start on, with the dictionary and last positions of the history before it. With scatter
+// the output goes to its fragments instead, and output only gives the length.
+static ALWAYS_INLINE error_t __decode(rolz_config_t config, array_t input, array_t *output, u64 start, u8 in_place, u64 *context_dictionary, u64 *context_lookup,
+                                     fragments_t *scatter)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    const u64 input_offset = in_place ? (u64)(input.bytes - output->bytes) : 0;
+
+    // If there are no input bytes, we don't have to do anything.
+    if (input.length == 0 || output->length <= start)
+        return ERROR_NO_OP;
+
+    // Rolz dictionary creation
+    u32 buffer_mask = (1 << config.history_buffer_bits) - 1;
+    u64 last_position_lookup[256] = {0};
+    u64 *dictionary = context_dictionary ? context_dictionary : (u64 *)malloc((buffer_mask + 1) * sizeof(u64));
+
+    if (dictionary == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    if (context_lookup)
+        memcpy(last_position_lookup, context_lookup, sizeof(last_position_lookup));
+
+    u64 dictionary_index = start;
+
+    bit_stream_t stream = bit_stream_init(input);
+
+    u64 total_length = 0;
+    try(bit_stream_read_7bit_int64(&stream, &total_length));
+
+    if (total_length != output->length - start)
+    {
+        error = ERROR_WRONG_OUTPUT_SIZE;
+        goto error_exit;
+    }
+
+    vlc_table_t table;
+    if (config.flags & (ROLZ_FLAG_VARIABLE_CODES | ROLZ_FLAG_LONG_MATCHES))
+        vlc_table_init(&table);
+
+    if (config.flags & ROLZ_SPLIT_LAYOUTS)
+    {
+        error = __decode_split(config, &stream, &table, output, start, dictionary, buffer_mask, last_position_lookup, scatter);
+        goto error_exit;
+    }
+
+    u64 index = start;
+
+    while (index < output->length)
+    {
+        u32 is_pair = 0;
+        try(bit_stream_read_bits(&stream, &is_pair, 1));
+
+        if (is_pair)
+        {
+            u32 count = 0, steps = 0, distance = 0;
+            try(__read_match(config, &stream, &table, &count, &steps, &distance));
+
+            // Find the source from the amount of steps, or the distance.
+            u64 offset = 0;
+            try(__match_offset(dictionary, buffer_mask, index, steps, distance, &offset));
+
+            if (count > output->length - index || (in_place && index + count > input_offset + stream.buffer_position))
+            {
+                error = ERROR_BUFFER_OUT_OF_BOUNDS;
+                goto error_exit;
+            }
+
+            __copy_match(output, scatter, index, offset, count, dictionary, buffer_mask, last_position_lookup);
+            dictionary_index += count;
+            index += count;
+        }
+        else
+        {
+            u32 literal = 0;
+            try(bit_stream_read_bits(&stream, &literal, 8));
+
+            if (in_place && index + 1 > input_offset + stream.buffer_position)
+            {
+                error = ERROR_BUFFER_OUT_OF_BOUNDS;
+                goto error_exit;
+            }
+
+            // We update the dictionary.
+            dictionary[dictionary_index & buffer_mask] = last_position_lookup[(u8)literal];
+            last_position_lookup[(u8)literal] = dictionary_index;
+            dictionary_index += 1;
+
+            // And output the literal
+            if (scatter)
+                fragments_put(scatter, index, (u8)literal);
+            else
+                output->bytes[index] = (u8)literal;
+            index += 1;
+        }
+    }
+
+error_exit:
+    if (dictionary != context_dictionary)
+        free(dictionary);
+    if (context_lookup && error == ERROR_ALL_GOOD)
+        memcpy(context_lookup, last_position_lookup, sizeof(last_position_lookup));
+    return error;
+}
+
+static error_t __decode_preset(u8 flags, array_t input, array_t *output, u64 start, u8 in_place, u64 *context_dictionary, u64 *context_lookup)
+{
+    return __decode(__preset_config(flags), input, output, start, in_place, context_dictionary, context_lookup, NULL);
+}
+
+static inline error_t __decode_any(rolz_config_t config, array_t input, array_t *output, u64 start, u8 in_place, u64 *context_dictionary, u64 *context_lookup)
+{
+    if (__is_preset(config))
+        return __decode_preset(config.flags, input, output, start, in_place, context_dictionary, context_lookup);
+
+    return __decode(config, input, output, start, in_place, context_dictionary, context_lookup, NULL);
+}
+
+_API error_t rolz_decode(rolz_config_t config, array_t input, array_t *output)
+{
+    return __decode_any(config, input, output, 0, 0, NULL, NULL);
+}
+
+_API error_t rolz_decode_in_place(rolz_config_t config, array_t buffer, u64 compressed_length)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (config.flags & ROLZ_SPLIT_LAYOUTS)
+        return ERROR_UNKNOWN_FORMAT;
+
+    if (compressed_length > buffer.length)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    array_t input = {.bytes = buffer.bytes + buffer.length - compressed_length, .length = compressed_length};
+    array_t output = {.bytes = buffer.bytes, .length = 0};
+
+    if ((error = rolz_get_original_length(input, &output.length)))
+        return error;
+
+    if (output.length > buffer.length)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    return __decode_any(config, input, &output, 0, 1, NULL, NULL);
+}
+
+_API error_t rolz_encode_fragments(rolz_config_t config, const array_t *input, u64 input_count, array_t *output)
+{
+    if (input_count == 1)
+        return rolz_encode(config, input[0], output);
+
+    if (fragments_worth_gathering(input, input_count, config.max_offset))
+    {
+        array_t gathered = {0};
+        error_t error = fragments_gather(input, input_count, &gathered);
+
+        if (!error)
+            error = rolz_encode(config, gathered, output);
+
+        free(gathered.bytes);
+        return error;
+    }
+
+    fragments_t gather;
+    error_t error = fragments_init(&gather, input, input_count);
+
+    if (error)
+        return error;
+
+    // The encoder only takes the length from it, every byte goes through gather.
+    array_t whole = {.bytes = NULL, .length = gather.length};
+    error = __encode_any(config, whole, 0, output, NULL, NULL, NULL, &gather);
+
+    fragments_free(&gather);
+    return error;
+}
+
+static error_t __decode_preset_scattered(u8 flags, array_t input, array_t *output, fragments_t *scatter)
+{
+    return __decode(__preset_config(flags), input, output, 0, 0, NULL, NULL, scatter);
+}
+
+_API error_t rolz_decode_fragments(rolz_config_t config, array_t input, const array_t *output, u64 output_count)
+{
+    fragments_t scatter;
+    error_t error = fragments_init(&scatter, output, output_count);
+
+    if (error)
+        return error;
+
+    // The decoder only takes the length from it, every byte goes through scatter.
+    array_t whole = {.bytes = NULL, .length = scatter.length};
+
+    if (__is_preset(config))
+        error = __decode_preset_scattered(config.flags, input, &whole, &scatter);
+    else
+        error = __decode(config, input, &whole, 0, 0, NULL, NULL, &scatter);
+
+    fragments_free(&scatter);
+    return error;
+}
+
+_API error_t rolz_context_init(rolz_config_t config, rolz_context_t *context)
+{
+    // The dictionary doesn't need clearing between inputs: every slot is written before the chain walks over it.
+    context->config = config;
+    context->dictionary = (u64 *)malloc(((u64)1 << config.history_buffer_bits) * sizeof(u64));
+
+    return context->dictionary ? ERROR_ALL_GOOD : ERROR_COULD_NOT_ALLOCATE;
+}
+
+_API void rolz_context_free(rolz_context_t *context)
+{
+    free(context->dictionary);
+    context->dictionary = NULL;
+}
+
+_API error_t rolz_encode_with_context(rolz_context_t *context, array_t input, array_t *output)
+{
+    return __encode_any(context->config, input, 0, output, NULL, context->dictionary, NULL, NULL);
+}
+
+_API error_t rolz_decode_with_context(rolz_context_t *context, array_t input, array_t *output)
+{
+    return __decode_any(context->config, input, output, 0, 0, context->dictionary, NULL);
+}
+
+// Message streams keep at least a whole dictionary's worth of bytes as history, and slide by whole dictionaries, so
+// every position keeps its slot and only the positions stored need moving down. Ones that fall off the front become
+// a position no chain walk follows, the encoder had stopped there already because of max_offset.
+static inline void __stream_slide(rolz_stream_t *stream)
+{
+    const u64 dictionary_length = (u64)1 << stream->config.history_buffer_bits;
+
+    if (stream->history_length < 2 * dictionary_length)
+        return;
+
+    u64 shift = (stream->history_length - dictionary_length) & ~(dictionary_length - 1);
+
+    for (u64 i = 0; i < dictionary_length; i += 1)
+        stream->dictionary[i] = stream->dictionary[i] >= shift ? stream->dictionary[i] - shift : UINT64_MAX;
+
+    for (u32 i = 0; i < 256; i += 1)
+        stream->last_position_lookup[i] = stream->last_position_lookup[i] >= shift ? stream->last_position_lookup[i] - shift : UINT64_MAX;
+
+    memmove(stream->window, stream->window + shift, stream->length - shift);
+    stream->history_length -= shift;
+    stream->length -= shift;
+}
+
+static inline error_t __stream_reserve(rolz_stream_t *stream, u64 length)
+{
+    if (length <= stream->capacity)
+        return ERROR_ALL_GOOD;
+
+    u64 capacity = stream->capacity * 2 > length ? stream->capacity * 2 : length;
+
+    u8 *window = (u8 *)realloc(stream->window, capacity);
+    if (window == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    stream->window = window;
+    stream->capacity = capacity;
+    return ERROR_ALL_GOOD;
+}
+
+_API error_t rolz_stream_init(rolz_config_t config, rolz_stream_t *stream)
+{
+    const u64 dictionary_length = (u64)1 << config.history_buffer_bits;
+
+    *stream = (rolz_stream_t){.config = config, .capacity = 2 * dictionary_length};
+
+    // Cleared, since sliding goes over every slot.
+    stream->dictionary = (u64 *)calloc(dictionary_length, sizeof(u64));
+    stream->window = (u8 *)malloc(stream->capacity);
+
+    if (stream->dictionary == NULL || stream->window == NULL)
+    {
+        rolz_stream_free(stream);
+        return ERROR_COULD_NOT_ALLOCATE;
+    }
+
+    return ERROR_ALL_GOOD;
+}
+
+_API void rolz_stream_free(rolz_stream_t *stream)
+{
+    free(stream->dictionary);
+    free(stream->window);
+    stream->dictionary = NULL;
+    stream->window = NULL;
+    stream->capacity = stream->length = stream->history_length = 0;
+}
+
+_API error_t rolz_stream_write(rolz_stream_t *stream, array_t input)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    __stream_slide(stream);
+
+    if ((error = __stream_reserve(stream, stream->length + input.length)))
+        return error;
+
+    memcpy(stream->window + stream->length, input.bytes, input.length);
+    stream->length += input.length;
+
+    return error;
+}
+
+_API u64 rolz_stream_get_flush_upper_bound(const rolz_stream_t *stream)
+{
+    return ROLZ_STREAM_CHUNK_HEADER_LENGTH + rolz_get_upper_bound(stream->length - stream->history_length);
+}
+
+_API error_t rolz_stream_flush(rolz_stream_t *stream, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (stream->length == stream->history_length)
+    {
+        output->length = 0;
+        return ERROR_NO_OP;
+    }
+
+    if (output->length < ROLZ_STREAM_CHUNK_HEADER_LENGTH)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    // The encoder only updates the lookup once it's done, but the dictionary as it goes, so a chunk that didn't fit
+    // leaves the stream unusable.
+    array_t window = {.bytes = stream->window, .length = stream->length};
+    array_t payload = {.bytes = output->bytes + ROLZ_STREAM_CHUNK_HEADER_LENGTH, .length = output->length - ROLZ_STREAM_CHUNK_HEADER_LENGTH};
+
+    error = __encode_any(stream->config, window, stream->history_length, &payload, NULL, stream->dictionary, stream->last_position_lookup, NULL);
+
+    if (error == ERROR_ALL_GOOD && payload.length > UINT32_MAX)
+        error = ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    if (error)
+    {
+        output->length = 0;
+        return error;
+    }
+
+    bit_stream_t header = bit_stream_init(*output);
+    bit_stream_write_bits(&header, (u32)payload.length, 32);
+
+    output->length = ROLZ_STREAM_CHUNK_HEADER_LENGTH + payload.length;
+    stream->history_length = stream->length;
+
+    return error;
+}
+
+_API error_t rolz_stream_get_chunk_length(array_t input, u64 *chunk_length)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    bit_stream_t header = bit_stream_init(input);
+
+    u32 payload_length = 0;
+    if ((error = bit_stream_read_bits(&header, &payload_length, 32)))
+    {
+        *chunk_length = 0;
+        return error;
+    }
+
+    *chunk_length = ROLZ_STREAM_CHUNK_HEADER_LENGTH + (u64)payload_length;
+    return error;
+}
+
+_API error_t rolz_stream_decode(rolz_stream_t *stream, array_t input, array_t *message)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    *message = (array_t){.bytes = NULL, .length = 0};
+
+    // A chunk that hasn't fully arrived yet is reported before anything changes, so the caller can try again later.
+    u64 chunk_length = 0, message_length = 0;
+    if ((error = rolz_stream_get_chunk_length(input, &chunk_length)))
+        return error;
+
+    if (chunk_length > input.length)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    array_t payload = {.bytes = input.bytes + ROLZ_STREAM_CHUNK_HEADER_LENGTH, .length = chunk_length - ROLZ_STREAM_CHUNK_HEADER_LENGTH};
+    if ((error = rolz_get_original_length(payload, &message_length)))
+        return error;
+
+    // Every token takes a bit at least, so a length past that is corrupt and shouldn't get its window allocated.
+    if (message_length / payload.length / 8 > __longest_match(stream->config))
+        return ERROR_UNKNOWN_FORMAT;
+
+    __stream_slide(stream);
+
+    if ((error = __stream_reserve(stream, stream->history_length + message_length)))
+        return error;
+
+    array_t window = {.bytes = stream->window, .length = stream->history_length + message_length};
+    if ((error = __decode_any(stream->config, payload, &window, stream->history_length, 0, stream->dictionary, stream->last_position_lookup)))
+        return error;
+
+    *message = (array_t){.bytes = stream->window + stream->history_length, .length = message_length};
+    stream->history_length = stream->length = window.length;
+
     return error;
 }
 
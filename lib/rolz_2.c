@@ -14,7 +14,7 @@ typedef struct match_t
 typedef struct pair_t
 {
     u16 key;
-    u32 position;
+    u64 position;
 } pair_t;
 
 _API rolz_config_t rolz_config_init(u8 step_bits, u8 count_bits, u8 minimum_match, u8 history_buffer_bits)
@@ -33,22 +33,22 @@ _API rolz_config_t rolz_config_init(u8 step_bits, u8 count_bits, u8 minimum_matc
     };
 }
 
-_API u32 rolz_get_upper_bound(u32 input_length)
+_API u64 rolz_get_upper_bound(u64 input_length)
 {
-    // We sum all bits in the worst case scenario: 32 for the total input length and input_lenght * 9 (literal flag + byte)
-    u32 total_bits = 32 + input_length * 9;
+    // We sum all bits in the worst case scenario: 80 for the total input length (a 64-bit VLQ) and input_lenght * 9 (literal flag + byte)
+    u64 total_bits = 80 + input_length * 9;
 
     // If it's divisible by 8, we return the length. If not we sum 1 to account for the extra bits.
     return (total_bits / 8) + ((total_bits % 8 > 0) ? 1 : 0);
 }
 
-static inline match_t __get_longest_match(rolz_config_t config, array_t input, u32 index, pair_t *dictionary, u32 buffer_mask, u16 key)
+static inline match_t __get_longest_match(rolz_config_t config, array_t input, u64 index, pair_t *dictionary, u32 buffer_mask, u16 key)
 {
     // If index-length difference is smaller than minimum match, we can't match a pair.
     if (index + config.minimum_match >= input.length)
         return (match_t){.steps = 0, .length = 0};
 
-    u32 last_position = index;
+    u64 last_position = index;
 
     u32 max_count = 0, max_steps = 0;
     u32 steps = 0;
@@ -56,7 +56,7 @@ static inline match_t __get_longest_match(rolz_config_t config, array_t input, u
     while (1)
     {
         pair_t pair = dictionary[last_position & buffer_mask];
-        u32 position = pair.position;
+        u64 position = pair.position;
 
         // We reached the index or there is no other match.
         if (position >= last_position)
@@ -110,19 +110,19 @@ _API error_t rolz_encode(rolz_config_t config, array_t input, array_t *output)
 
     // Rolz dictionary creation
     u32 buffer_mask = (1 << config.history_buffer_bits) - 1;
-    u32 last_position_lookup[256] = {0};
+    u64 last_position_lookup[256] = {0};
     pair_t *dictionary = (pair_t *)calloc((buffer_mask + 1), sizeof(pair_t));
 
     if (dictionary == NULL)
         return ERROR_COULD_NOT_ALLOCATE;
 
-    u32 dictionary_index = 0;
+    u64 dictionary_index = 0;
 
     bit_stream_t stream = bit_stream_init(*output);
 
-    try(bit_stream_write_7bit_int32(&stream, input.length));
+    try(bit_stream_write_7bit_int64(&stream, input.length));
 
-    u32 index = 0;
+    u64 index = 0;
     u16 key = 0;
 
     do
@@ -183,12 +183,12 @@ no_error_exit:
     return ERROR_ALL_GOOD;
 }
 
-_API error_t rolz_get_original_length(array_t input, u32 *original_length)
+_API error_t rolz_get_original_length(array_t input, u64 *original_length)
 {
     bit_stream_t stream = bit_stream_init(input);
 
-    u32 length = 0;
-    error_t error = bit_stream_read_7bit_int32(&stream, &length);
+    u64 length = 0;
+    error_t error = bit_stream_read_7bit_int64(&stream, &length);
 
     if (error)
     {
@@ -210,18 +210,18 @@ _API error_t rolz_decode(rolz_config_t config, array_t input, array_t *output)
 
     // Rolz dictionary creation
     u32 buffer_mask = (1 << config.history_buffer_bits) - 1;
-    u32 last_position_lookup[256] = {0};
-    u32 *dictionary = (u32 *)malloc((buffer_mask + 1) * sizeof(u32));
+    u64 last_position_lookup[256] = {0};
+    u64 *dictionary = (u64 *)malloc((buffer_mask + 1) * sizeof(u64));
 
     if (dictionary == NULL)
         return ERROR_COULD_NOT_ALLOCATE;
 
-    u32 dictionary_index = 0;
+    u64 dictionary_index = 0;
 
     bit_stream_t stream = bit_stream_init(input);
 
-    u32 total_length = 0;
-    try(bit_stream_read_7bit_int32(&stream, &total_length));
+    u64 total_length = 0;
+    try(bit_stream_read_7bit_int64(&stream, &total_length));
 
     if (total_length != output->length)
     {
@@ -229,7 +229,7 @@ _API error_t rolz_decode(rolz_config_t config, array_t input, array_t *output)
         goto error_exit;
     }
 
-    u32 index = 0;
+    u64 index = 0;
 
     while (index < output->length)
     {
@@ -245,11 +245,11 @@ _API error_t rolz_decode(rolz_config_t config, array_t input, array_t *output)
             try(bit_stream_read_int(&stream, &steps, config.step_bits));
 
             // Find the position from the amount of steps.
-            u32 position = index - 1;
+            u64 position = index - 1;
             for (u32 i = 0; i <= steps; i += 1)
                 position = dictionary[position & buffer_mask];
 
-            u32 offset = index - 1 - position;
+            u64 offset = index - 1 - position;
             for (u32 i = 0; i < count; i += 1)
             {
                 u8 literal = output->bytes[index - offset];
@@ -0,0 +1,47 @@
+#include <stdlib.h>
+
+#include <sequence.h>
+
+_API error_t sequence_buffer_init(sequence_buffer_t *buffer, u64 capacity)
+{
+    *buffer = (sequence_buffer_t){0};
+
+    return sequence_buffer_reserve(buffer, capacity);
+}
+
+_API void sequence_buffer_free(sequence_buffer_t *buffer)
+{
+    free(buffer->sequences);
+    *buffer = (sequence_buffer_t){0};
+}
+
+_API void sequence_buffer_reset(sequence_buffer_t *buffer)
+{
+    buffer->count = 0;
+    buffer->literal_count = 0;
+}
+
+_API error_t sequence_buffer_reserve(sequence_buffer_t *buffer, u64 capacity)
+{
+    if (capacity <= buffer->capacity)
+        return ERROR_ALL_GOOD;
+
+    sequence_t *sequences = (sequence_t *)realloc(buffer->sequences, capacity * sizeof(sequence_t));
+    if (sequences == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    buffer->sequences = sequences;
+    buffer->capacity = capacity;
+
+    return ERROR_ALL_GOOD;
+}
+
+_API u64 sequence_buffer_get_length(const sequence_buffer_t *buffer)
+{
+    u64 length = buffer->literal_count;
+
+    for (u64 i = 0; i < buffer->count; i += 1)
+        length += buffer->sequences[i].literal_count + buffer->sequences[i].match_length;
+
+    return length;
+}
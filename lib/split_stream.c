@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "split_stream.h"
+
+error_t split_stream_writer_init(split_stream_t *split, u64 input_length, u8 literal_runs)
+{
+    // Worst cases: one flag or at most three run length bits and one literal per input byte, plus the final run. Like
+    // the upper bounds, we assume the match fields are never bigger than the literals they replace, and running out
+    // of room is an error rather than an overflow anyway.
+    u64 flags_length = literal_runs ? input_length / 2 + 24 : input_length / 8 + 1;
+    u64 matches_length = input_length + input_length / 8 + 1;
+
+    *split = (split_stream_t){0};
+
+    if (!(split->scratch = (u8 *)calloc(flags_length + input_length + matches_length, 1)))
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    split->literal_runs = literal_runs;
+    split->flags = split->scratch;
+    split->literals = split->flags + flags_length;
+    split->matches = bit_stream_init((array_t){.bytes = split->literals + input_length, .length = matches_length});
+
+    return ERROR_ALL_GOOD;
+}
+
+void split_stream_writer_free(split_stream_t *split)
+{
+    free(split->scratch);
+    split->scratch = NULL;
+}
+
+error_t split_stream_writer_finish(split_stream_t *split, bit_stream_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if ((error = bit_stream_flush(&split->matches)))
+        return error;
+
+    // The literals after the last match.
+    if (split->literal_runs)
+        __split_stream_write_run(split);
+
+    u64 flags_length = (split->flag_position + 7) / 8;
+
+    if ((error = bit_stream_write_7bit_int64(output, split->flag_position)) ||
+        (error = bit_stream_write_7bit_int64(output, split->literal_position)) ||
+        (error = bit_stream_write_7bit_int64(output, split->matches.buffer_position)))
+        return error;
+
+    if ((error = bit_stream_write_bytes(output, split->flags, flags_length)) ||
+        (error = bit_stream_write_bytes(output, split->literals, split->literal_position)) ||
+        (error = bit_stream_write_bytes(output, split->matches.buffer, split->matches.buffer_position)))
+        return error;
+
+    return error;
+}
+
+error_t split_stream_reader_init(split_stream_t *split, bit_stream_t *input, u8 literal_runs)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    u64 matches_length = 0;
+
+    *split = (split_stream_t){.literal_runs = literal_runs};
+
+    if ((error = bit_stream_read_7bit_int64(input, &split->flag_count)) ||
+        (error = bit_stream_read_7bit_int64(input, &split->literal_count)) ||
+        (error = bit_stream_read_7bit_int64(input, &matches_length)))
+        return error;
+
+    u64 flags_length = split->flag_count / 8 + (split->flag_count % 8 > 0);
+    u64 available = input->buffer_length - input->buffer_position;
+
+    // Each length on its own first, so the sum can't overflow.
+    if (flags_length > available || split->literal_count > available || matches_length > available ||
+        flags_length + split->literal_count + matches_length > available)
+        return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+    split->flags = input->buffer + input->buffer_position;
+    split->literals = split->flags + flags_length;
+    split->matches = bit_stream_init((array_t){.bytes = split->literals + split->literal_count, .length = matches_length});
+
+    input->buffer_position += flags_length + split->literal_count + matches_length;
+
+    return error;
+}
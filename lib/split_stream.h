@@ -0,0 +1,156 @@
+#ifndef __SPLIT_STREAM_H__
+#define __SPLIT_STREAM_H__
+
+#include <common.h>
+
+#include "bit_stream.h"
+
+// Split stream layout used by the codecs' SPLIT_STREAMS and LITERAL_RUNS variants. Instead of one serial bit
+// stream, tokens are stored in three streams so the decoder can handle each one with plain loads:
+//  - the token stream, which tells literals and matches apart. For split streams it's one bit per token (1 for a
+//    match) packed least significant bit first. For literal runs it's the length of the literal run before every
+//    match, plus the one after the last match, as an interleaved Elias gamma code of the length plus one: a 1 and
+//    the next bit below the top one for every such bit, then a 0. Back to back matches pay a single bit like split
+//    streams, short runs 3 or 5.
+//  - literal bytes, byte aligned, so runs of literals are a single memcpy,
+//  - match fields, bit packed exactly like in the single stream format.
+// They're written after the original length as three 64-bit VLQs (token stream length in bits, literal
+// count, match field bytes) followed by the three streams back to back.
+typedef struct split_stream_t
+{
+    u8 literal_runs;
+
+    u8 *flags;
+    u64 flag_count;
+    u64 flag_position;
+    u64 run; // Literals since the last match, only used when writing literal runs.
+
+    u8 *literals;
+    u64 literal_count;
+    u64 literal_position;
+
+    bit_stream_t matches;
+
+    u8 *scratch; // Only set for writers, which own the stream buffers.
+} split_stream_t;
+
+// Extra bytes the split layouts can take over the single stream one: the three lengths, the padding of two streams
+// and the final literal run.
+#define SPLIT_STREAM_OVERHEAD 48
+
+// Bits a literal run length adds to every match. A run of n literals takes at most n + 2 bits, against n + 1 flags
+// in the single stream format. Encoders only take matches that cover their fields plus this at 9 bits per byte, so
+// literal runs never cost more than the single stream format and share its upper bound.
+#define SPLIT_STREAM_RUN_BITS 2
+
+error_t split_stream_writer_init(split_stream_t *split, u64 input_length, u8 literal_runs);
+void split_stream_writer_free(split_stream_t *split);
+
+// Appends the three streams to the output, which must be byte aligned.
+error_t split_stream_writer_finish(split_stream_t *split, bit_stream_t *output);
+
+// Points the streams into the input, right after its original length.
+error_t split_stream_reader_init(split_stream_t *split, bit_stream_t *input, u8 literal_runs);
+
+static inline void split_stream_write_literal(split_stream_t *split, u8 literal)
+{
+    // Flag bits start cleared, so a literal only has to move the position forward.
+    if (split->literal_runs)
+        split->run += 1;
+    else
+        split->flag_position += 1;
+
+    split->literals[split->literal_position++] = literal;
+}
+
+static inline void __split_stream_write_flag(split_stream_t *split, u8 bit)
+{
+    split->flags[split->flag_position >> 3] |= bit << (split->flag_position & 7);
+    split->flag_position += 1;
+}
+
+static inline void __split_stream_write_run(split_stream_t *split)
+{
+    u64 value = split->run + 1;
+
+    for (i32 bit = 62 - __builtin_clzll(value); bit >= 0; bit--)
+    {
+        __split_stream_write_flag(split, 1);
+        __split_stream_write_flag(split, (value >> bit) & 1);
+    }
+
+    // Flag bits start cleared, so the stop bit only has to move the position forward.
+    split->flag_position += 1;
+    split->run = 0;
+}
+
+static inline void split_stream_write_match_flag(split_stream_t *split)
+{
+    if (split->literal_runs)
+    {
+        __split_stream_write_run(split);
+        return;
+    }
+
+    __split_stream_write_flag(split, 1);
+}
+
+static inline u8 __split_stream_read_flag(split_stream_t *split)
+{
+    u8 bit = (split->flags[split->flag_position >> 3] >> (split->flag_position & 7)) & 1;
+    split->flag_position += 1;
+    return bit;
+}
+
+// Number of literal tokens before the next match, consuming the match token if there is one.
+static inline error_t split_stream_read_literal_run(split_stream_t *split, u64 *run, u8 *has_match)
+{
+    if (split->literal_runs)
+    {
+        u64 value = 1;
+
+        for (;;)
+        {
+            if (split->flag_position >= split->flag_count)
+                return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+            if (!__split_stream_read_flag(split))
+                break;
+
+            if (split->flag_position >= split->flag_count || value >> 63)
+                return ERROR_BUFFER_OUT_OF_BOUNDS;
+
+            value = (value << 1) | __split_stream_read_flag(split);
+        }
+
+        // Every run is followed by a match, except the last one.
+        *run = value - 1;
+        *has_match = split->flag_position < split->flag_count;
+        return ERROR_ALL_GOOD;
+    }
+
+    u64 position = split->flag_position;
+
+    while (position < split->flag_count)
+    {
+        // Whole bytes without matches are 8 literals at once.
+        if ((position & 7) == 0 && position + 8 <= split->flag_count && split->flags[position >> 3] == 0)
+        {
+            position += 8;
+            continue;
+        }
+
+        if ((split->flags[position >> 3] >> (position & 7)) & 1)
+            break;
+
+        position += 1;
+    }
+
+    *run = position - split->flag_position;
+    *has_match = position < split->flag_count;
+
+    split->flag_position = position + *has_match;
+    return ERROR_ALL_GOOD;
+}
+
+#endif
@@ -0,0 +1,83 @@
+#include "thread.h"
+
+#ifdef _WIN32
+
+// Win32 thread functions return a DWORD, so we go through a trampoline to call a pthread-style function.
+static DWORD WINAPI __thread_trampoline(LPVOID parameter)
+{
+    thread_t *thread = (thread_t *)parameter;
+    thread->function(thread->argument);
+    return 0;
+}
+
+error_t thread_create(thread_t *thread, thread_function_t function, void *argument)
+{
+    thread->function = function;
+    thread->argument = argument;
+    thread->handle = CreateThread(NULL, 0, __thread_trampoline, thread, 0, NULL);
+
+    return thread->handle == NULL ? ERROR_COULD_NOT_ALLOCATE : ERROR_ALL_GOOD;
+}
+
+error_t thread_join(thread_t *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+
+    return ERROR_ALL_GOOD;
+}
+
+u32 thread_get_cpu_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+void mutex_init(mutex_t *mutex) { InitializeCriticalSection(mutex); }
+void mutex_destroy(mutex_t *mutex) { DeleteCriticalSection(mutex); }
+void mutex_lock(mutex_t *mutex) { EnterCriticalSection(mutex); }
+void mutex_unlock(mutex_t *mutex) { LeaveCriticalSection(mutex); }
+
+void condition_init(condition_t *condition) { InitializeConditionVariable(condition); }
+void condition_destroy(condition_t *condition) { (void)condition; }
+void condition_wait(condition_t *condition, mutex_t *mutex) { SleepConditionVariableCS(condition, mutex, INFINITE); }
+void condition_signal(condition_t *condition) { WakeConditionVariable(condition); }
+void condition_broadcast(condition_t *condition) { WakeAllConditionVariable(condition); }
+
+#else
+
+#include <unistd.h>
+
+error_t thread_create(thread_t *thread, thread_function_t function, void *argument)
+{
+    return pthread_create(&thread->handle, NULL, function, argument) ? ERROR_COULD_NOT_ALLOCATE : ERROR_ALL_GOOD;
+}
+
+error_t thread_join(thread_t *thread)
+{
+    pthread_join(thread->handle, NULL);
+
+    return ERROR_ALL_GOOD;
+}
+
+u32 thread_get_cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? (u32)count : 1;
+}
+
+void mutex_init(mutex_t *mutex) { pthread_mutex_init(mutex, NULL); }
+void mutex_destroy(mutex_t *mutex) { pthread_mutex_destroy(mutex); }
+void mutex_lock(mutex_t *mutex) { pthread_mutex_lock(mutex); }
+void mutex_unlock(mutex_t *mutex) { pthread_mutex_unlock(mutex); }
+
+void condition_init(condition_t *condition) { pthread_cond_init(condition, NULL); }
+void condition_destroy(condition_t *condition) { pthread_cond_destroy(condition); }
+void condition_wait(condition_t *condition, mutex_t *mutex) { pthread_cond_wait(condition, mutex); }
+void condition_signal(condition_t *condition) { pthread_cond_signal(condition); }
+void condition_broadcast(condition_t *condition) { pthread_cond_broadcast(condition); }
+
+#endif
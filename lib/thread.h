@@ -0,0 +1,49 @@
+#ifndef __THREAD_H__
+#define __THREAD_H__
+
+#include <common.h>
+
+// Minimal portable threading layer, Win32 threads on Windows and pthreads everywhere else.
+#ifdef _WIN32
+#include <windows.h>
+
+typedef struct thread_t
+{
+    HANDLE handle;
+    void *(*function)(void *argument);
+    void *argument;
+} thread_t;
+
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE condition_t;
+#else
+#include <pthread.h>
+
+typedef struct thread_t
+{
+    pthread_t handle;
+} thread_t;
+
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t condition_t;
+#endif
+
+typedef void *(*thread_function_t)(void *argument);
+
+error_t thread_create(thread_t *thread, thread_function_t function, void *argument);
+error_t thread_join(thread_t *thread);
+
+u32 thread_get_cpu_count(void);
+
+void mutex_init(mutex_t *mutex);
+void mutex_destroy(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+void condition_init(condition_t *condition);
+void condition_destroy(condition_t *condition);
+void condition_wait(condition_t *condition, mutex_t *mutex);
+void condition_signal(condition_t *condition);
+void condition_broadcast(condition_t *condition);
+
+#endif
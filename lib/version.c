@@ -0,0 +1,14 @@
+#include <common.h>
+
+#define __STRINGIFY(x) #x
+#define __VERSION_STRING(major, minor, patch) __STRINGIFY(major) "." __STRINGIFY(minor) "." __STRINGIFY(patch)
+
+_API u32 compression_version(void)
+{
+    return (COMPRESSION_VERSION_MAJOR << 16) | (COMPRESSION_VERSION_MINOR << 8) | COMPRESSION_VERSION_PATCH;
+}
+
+_API const char *compression_version_string(void)
+{
+    return __VERSION_STRING(COMPRESSION_VERSION_MAJOR, COMPRESSION_VERSION_MINOR, COMPRESSION_VERSION_PATCH);
+}
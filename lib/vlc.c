@@ -0,0 +1,22 @@
+#include "vlc.h"
+
+void vlc_table_init(vlc_table_t *table)
+{
+    for (u32 bits = 0; bits < (1 << VLC_TABLE_BITS); bits += 1)
+    {
+        // Leading zeros of the peeked bits, all of them being zero means the code is too long for the table.
+        u8 zeros = 0;
+        while (zeros < VLC_TABLE_BITS && !(bits & (1 << (VLC_TABLE_BITS - 1 - zeros))))
+            zeros += 1;
+
+        u8 length = 2 * zeros + 1;
+
+        if (length > VLC_TABLE_BITS)
+        {
+            table->entries[bits] = (vlc_entry_t){.value = 0, .length = 0};
+            continue;
+        }
+
+        table->entries[bits] = (vlc_entry_t){.value = (u8)(bits >> (VLC_TABLE_BITS - length)), .length = length};
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef __VLC_H__
+#define __VLC_H__
+
+#include <common.h>
+
+#include "bit_stream.h"
+
+// Variable length codes for match fields, used by the codecs' VARIABLE_CODES flag.
+//  - Elias-gamma for values >= 1: n zeros, then the value in n + 1 bits (its top bit is the 1 ending the zeros).
+//    1 takes 1 bit, 2-3 take 3, 4-7 take 5 and so on, so small lengths are cheap.
+//  - Exp-Golomb of order k for values >= 0: (value >> k) + 1 gamma coded, then the k low bits. Values below 2^k
+//    take k + 1 bits, each doubling of the range costs 2 more. Codecs pick k from the configured field width, so
+//    fields that spread over their whole range (offsets, steps) lose little and the common small ones get cheaper.
+// Decoding peeks VLC_TABLE_BITS bits and looks the gamma code up in a table, falling back to reading bit by bit
+// for the rare codes that don't fit.
+#define VLC_TABLE_BITS 8
+
+typedef struct vlc_entry_t
+{
+    u8 value;
+    u8 length; // 0 when the code is longer than VLC_TABLE_BITS.
+} vlc_entry_t;
+
+typedef struct vlc_table_t
+{
+    vlc_entry_t entries[1 << VLC_TABLE_BITS];
+} vlc_table_t;
+
+// Cheap enough (256 entries) to build once per decode call, so the table can live on the decoder's stack.
+void vlc_table_init(vlc_table_t *table);
+
+static inline u8 __vlc_log2(u32 value)
+{
+    u8 log = 0;
+
+    while (value >>= 1)
+        log += 1;
+
+    return log;
+}
+
+static inline u32 vlc_gamma_bits(u32 value) { return 2 * __vlc_log2(value) + 1; }
+
+static inline u32 vlc_golomb_bits(u32 value, u8 k) { return vlc_gamma_bits((value >> k) + 1) + k; }
+
+static inline error_t vlc_write_gamma(bit_stream_t *stream, u32 value)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    u8 log = __vlc_log2(value);
+
+    if ((error = bit_stream_write_int(stream, 0, log)))
+        return error;
+
+    return bit_stream_write_int(stream, value, log + 1);
+}
+
+static inline error_t vlc_write_golomb(bit_stream_t *stream, u32 value, u8 k)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if ((error = vlc_write_gamma(stream, (value >> k) + 1)))
+        return error;
+
+    return bit_stream_write_int(stream, value & ((1u << k) - 1), k);
+}
+
+static inline error_t vlc_read_gamma(bit_stream_t *stream, const vlc_table_t *table, u32 *value)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    vlc_entry_t entry = table->entries[bit_stream_peek_int(stream, VLC_TABLE_BITS)];
+
+    if (entry.length)
+    {
+        *value = entry.value;
+        return bit_stream_skip(stream, entry.length);
+    }
+
+    // Long code: count the zeros, then read the value with its leading 1.
+    u8 zeros = 0, bit = 0;
+
+    while (1)
+    {
+        if ((error = bit_stream_read_bit(stream, &bit)))
+            return error;
+
+        if (bit)
+            break;
+
+        // Nothing we write needs more than 32 bits.
+        if (++zeros > 31)
+            return ERROR_BUFFER_OUT_OF_BOUNDS;
+    }
+
+    u32 rest = 0;
+    if ((error = bit_stream_read_int(stream, &rest, zeros)))
+        return error;
+
+    *value = (1u << zeros) | rest;
+    return error;
+}
+
+static inline error_t vlc_read_golomb(bit_stream_t *stream, const vlc_table_t *table, u8 k, u32 *value)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    u32 high = 0, low = 0;
+    if ((error = vlc_read_gamma(stream, table, &high)) || (error = bit_stream_read_int(stream, &low, k)))
+        return error;
+
+    *value = ((high - 1) << k) | low;
+    return error;
+}
+
+#endif
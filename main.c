@@ -1,16 +1,28 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
-#include <lzss.h>
-#include <rolz.h>
+#include <dedup.h>
+#include <frame.h>
+#include <ldm.h>
 
 #include "command_line.h"
+#include "lib/thread.h"
+#include "pipeline.h"
 
-static error_t do_lzss_encoding(array_t input, array_t *output)
+static frame_config_t get_frame_config(command_line_options_t options)
 {
-    lzss_config_t config = lzss_config_init(10, 6, 2);
-    u32 output_upper_bound = lzss_get_upper_bound(input.length);
+    frame_config_t config = frame_config_init(get_mode_codec(options.mode), options.filter, options.block_bits ? options.block_bits : 22);
+    config.lzss.match_threads = config.rolz.match_threads = options.match_threads;
+
+    return config;
+}
+
+static error_t do_encoding(const frame_config_t *config, array_t input, array_t *output)
+{
+    u64 output_upper_bound = frame_get_upper_bound(*config, input.length);
 
     output->bytes = (u8 *)malloc(output_upper_bound);
     output->length = output_upper_bound;
@@ -18,29 +30,34 @@ static error_t do_lzss_encoding(array_t input, array_t *output)
     if (output->bytes == NULL)
         return ERROR_COULD_NOT_ALLOCATE;
 
-    return lzss_encode(config, input, output);
+    return frame_encode(*config, input, output);
 }
 
-static error_t do_lzss_decoding(array_t input, array_t *output)
+// The frame header records the codec, its configuration, the filter and the pre-passes, so decoding needs no
+// options.
+static error_t do_decoding(const frame_config_t *config, array_t input, array_t *output)
 {
     error_t error = ERROR_ALL_GOOD;
 
-    lzss_config_t config = lzss_config_init(10, 6, 2);
+    (void)config;
 
-    u32 original_length = 0;
-    if ((error = lzss_get_original_length(input, &original_length)))
+    u64 original_length = 0;
+    if ((error = frame_get_original_length(input, &original_length)))
         return error;
 
-    output->bytes = (u8 *)malloc(original_length);
+    // One byte at least, an empty input's frame decodes to nothing.
+    output->bytes = (u8 *)malloc(original_length > 0 ? original_length : 1);
     output->length = original_length;
 
-    return lzss_decode(config, input, output);
+    if (output->bytes == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    return frame_decode(input, output);
 }
 
-static error_t do_rolz_encoding(array_t input, array_t *output)
+static error_t do_long_range_encoding(const frame_config_t *config, array_t input, array_t *output)
 {
-    const rolz_config_t config = rolz_config_init(8, 4, 2, 16);
-    u32 output_upper_bound = rolz_get_upper_bound(input.length);
+    u64 output_upper_bound = ldm_get_upper_bound(input.length);
 
     output->bytes = (u8 *)malloc(output_upper_bound);
     output->length = output_upper_bound;
@@ -48,23 +65,54 @@ static error_t do_rolz_encoding(array_t input, array_t *output)
     if (output->bytes == NULL)
         return ERROR_COULD_NOT_ALLOCATE;
 
-    return rolz_encode(config, input, output);
+    return ldm_encode(config->ldm, input, output);
 }
 
-static error_t do_rolz_decoding(array_t input, array_t *output)
+static error_t do_long_range_decoding(const frame_config_t *config, array_t input, array_t *output)
 {
     error_t error = ERROR_ALL_GOOD;
 
-    const rolz_config_t config = rolz_config_init(8, 4, 2, 16);
+    u64 original_length = 0;
+    if ((error = ldm_get_original_length(input, &original_length)))
+        return error;
+
+    output->bytes = (u8 *)malloc(original_length > 0 ? original_length : 1);
+    output->length = original_length;
+
+    if (output->bytes == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    return ldm_decode(config->ldm, input, output);
+}
+
+static error_t do_dedup_encoding(const frame_config_t *config, array_t input, array_t *output)
+{
+    u64 output_upper_bound = dedup_get_upper_bound(input.length);
 
-    u32 original_length = 0;
-    if ((error = rolz_get_original_length(input, &original_length)))
+    output->bytes = (u8 *)malloc(output_upper_bound);
+    output->length = output_upper_bound;
+
+    if (output->bytes == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    return dedup_encode(config->dedup, input, output);
+}
+
+static error_t do_dedup_decoding(const frame_config_t *config, array_t input, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    u64 original_length = 0;
+    if ((error = dedup_get_original_length(input, &original_length)))
         return error;
 
-    output->bytes = (u8 *)malloc(original_length);
+    output->bytes = (u8 *)malloc(original_length > 0 ? original_length : 1);
     output->length = original_length;
 
-    return rolz_decode(config, input, output);
+    if (output->bytes == NULL)
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    return dedup_decode(config->dedup, input, output);
 }
 
 static int print_error_message(command_line_error_t cli_error, error_t lib_error)
@@ -74,23 +122,35 @@ static int print_error_message(command_line_error_t cli_error, error_t lib_error
         switch (cli_error)
         {
         case CLI_COULD_NOT_ALLOCATE:
-            printf("Error: Could not allocate enough memory.\n");
+            fprintf(stderr, "Error: Could not allocate enough memory.\n");
             break;
 
         case CLI_COULD_NOT_OPEN_FILE:
-            printf("Error: Could not open the file.\n");
+            fprintf(stderr, "Error: Could not open the file.\n");
             break;
 
         case CLI_COULD_NOT_READ_FILE:
-            printf("Error: Could not read the file.\n");
+            fprintf(stderr, "Error: Could not read the file.\n");
+            break;
+
+        case CLI_COULD_NOT_WRITE_FILE:
+            fprintf(stderr, "Error: Could not write the file.\n");
             break;
 
         case CLI_FILE_NOT_FOUND:
-            printf("Error: File not found.\n");
+            fprintf(stderr, "Error: File not found.\n");
+            break;
+
+        case CLI_PRE_PASS_MISMATCH:
+            fprintf(stderr, "Error: The file wasn't compressed with -l or -d, but they were given.\n");
+            break;
+
+        case CLI_PRE_PASS_STREAM:
+            fprintf(stderr, "Error: The file was compressed with -l or -d, decode it from a path instead of stdin.\n");
             break;
 
         default:
-            printf("CLI Error code: %d\n", cli_error);
+            fprintf(stderr, "CLI Error code: %d\n", cli_error);
             break;
         }
 
@@ -101,72 +161,258 @@ static int print_error_message(command_line_error_t cli_error, error_t lib_error
     if (lib_error)
     {
         // TODO: Insert switch/case to print errors
-        printf("Lib Error code: %d\n", lib_error);
+        fprintf(stderr, "Lib Error code: %d\n", lib_error);
         return EXIT_FAILURE;
     }
 
     return EXIT_SUCCESS;
 }
 
-int main(int argc, const char **argv)
+static inline i64 __milliseconds_since(struct timespec start)
 {
-    command_line_error_t cli_error = CLI_NO_ERROR;
-    error_t lib_error = ERROR_ALL_GOOD;
+    struct timespec end;
+    timespec_get(&end, TIME_UTC);
 
-    command_line_options_t options = {0};
-    if ((cli_error = parse_command_line_arguments(argc, argv, &options)))
-        goto exit;
+    return (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+}
+
+// Replaces the buffer with the result of the step, freeing what it held unless it's the original input.
+static inline error_t __run_step(error_t (*step)(const frame_config_t *, array_t, array_t *), const frame_config_t *config, array_t *buffer, const array_t *original)
+{
+    array_t result = {0};
+    error_t error = step(config, *buffer, &result);
+
+    if (buffer->bytes != original->bytes)
+        free(buffer->bytes);
+
+    *buffer = result;
+    return error;
+}
+
+// Reads the whole file, runs the pre-passes and the codec, and writes the result.
+static command_line_error_t process_whole_file(command_line_options_t options, const char *input_name, const char *output_name, error_t *lib_error, u64 *input_length, u64 *output_length)
+{
+    command_line_error_t cli_error = CLI_NO_ERROR;
 
     array_t input_file = {0};
-    if ((cli_error = read_file(argv[3], &input_file)))
-    {
-        printf("Failed when reading input file \"%s\"\n", argv[3]);
-        goto exit;
-    }
+    if ((cli_error = read_file(input_name, &input_file)))
+        return cli_error;
 
-    array_t output_file = {0};
+    *input_length = input_file.length;
 
-    clock_t start_time = clock();
+    // Pre-passes run before the codec (dedup first, then long distance matching), so the codec sees their output.
+    // Empty inputs skip them, the frame alone round-trips those. The frame header records the ones that ran.
+    array_t buffer = input_file;
 
-    switch (options.mode)
+    if (options.operation == OP_ENCODE)
     {
-    case MODE_LZSS:
-        if (options.operation == OP_ENCODE)
+        frame_config_t config = get_frame_config(options);
+
+        if (options.dedup && buffer.length > 0 && !*lib_error)
         {
-            if ((lib_error = do_lzss_encoding(input_file, &output_file)))
-                goto exit;
+            config.pre_passes |= FRAME_PRE_PASS_DEDUP;
+            *lib_error = __run_step(do_dedup_encoding, &config, &buffer, &input_file);
         }
-        else
+
+        if (options.long_range && buffer.length > 0 && !*lib_error)
         {
-            if ((lib_error = do_lzss_decoding(input_file, &output_file)))
-                goto exit;
+            config.pre_passes |= FRAME_PRE_PASS_LDM;
+            *lib_error = __run_step(do_long_range_encoding, &config, &buffer, &input_file);
         }
-        break;
-    case MODE_ROLZ:
-        if (options.operation == OP_ENCODE)
+
+        if (!*lib_error)
+            *lib_error = __run_step(do_encoding, &config, &buffer, &input_file);
+    }
+    else
+    {
+        frame_config_t config = {0};
+
+        if (!(*lib_error = frame_read_config(input_file, &config)))
         {
-            if ((lib_error = do_rolz_encoding(input_file, &output_file)))
-                goto exit;
+            // -l and -d aren't needed to decode, but if they're given the file has to have been compressed with them.
+            if ((options.long_range && !(config.pre_passes & FRAME_PRE_PASS_LDM)) || (options.dedup && !(config.pre_passes & FRAME_PRE_PASS_DEDUP)))
+                cli_error = CLI_PRE_PASS_MISMATCH;
+            else
+                *lib_error = __run_step(do_decoding, &config, &buffer, &input_file);
         }
-        else
+
+        if (!cli_error && !*lib_error && (config.pre_passes & FRAME_PRE_PASS_LDM))
+            *lib_error = __run_step(do_long_range_decoding, &config, &buffer, &input_file);
+
+        if (!cli_error && !*lib_error && (config.pre_passes & FRAME_PRE_PASS_DEDUP))
+            *lib_error = __run_step(do_dedup_decoding, &config, &buffer, &input_file);
+    }
+
+    if (!cli_error && !*lib_error)
+    {
+        *output_length = buffer.length;
+        cli_error = write_file(output_name, buffer);
+    }
+
+    if (buffer.bytes != input_file.bytes)
+        free(buffer.bytes);
+    free(input_file.bytes);
+
+    return cli_error;
+}
+
+// Whether the frame of a compressed file records pre-passes. Only files can be checked before decoding them, a
+// stream's header is gone once the pipeline has read it.
+static u8 __has_pre_passes(const char *input_name)
+{
+    u8 header[64];
+    frame_config_t config = {0};
+
+    FILE *file = fopen(input_name, "rb");
+    if (file == NULL)
+        return 0;
+
+    u64 length = fread(header, 1, sizeof(header), file);
+    fclose(file);
+
+    return frame_read_config((array_t){.bytes = header, .length = length}, &config) == ERROR_ALL_GOOD && config.pre_passes;
+}
+
+// Streams go through the pipeline, which doesn't need them whole, unless a pre-pass does.
+static command_line_error_t process_file(command_line_options_t options, const char *input_name, const char *output_name, error_t *lib_error, u64 *input_length, u64 *output_length)
+{
+    *lib_error = ERROR_ALL_GOOD;
+    *input_length = 0;
+    *output_length = 0;
+
+    u8 streams = is_standard_stream(input_name) || is_standard_stream(output_name);
+    u8 pre_passes = options.long_range || options.dedup ||
+                    (options.operation == OP_DECODE && !is_standard_stream(input_name) && __has_pre_passes(input_name));
+
+    if ((options.pipeline || streams) && !pre_passes)
+    {
+        options.input_file = input_name;
+        options.output_file = output_name;
+        return pipeline_run(options, lib_error, input_length, output_length);
+    }
+
+    return process_whole_file(options, input_name, output_name, lib_error, input_length, output_length);
+}
+
+typedef struct file_queue_t
+{
+    const command_line_options_t *options;
+    const file_list_t *files;
+
+    u32 next;
+    u32 failures;
+    mutex_t mutex;
+} file_queue_t;
+
+// Each worker takes the next file until there's none left, every file is processed whole on one thread.
+static void *process_files(void *argument)
+{
+    file_queue_t *queue = (file_queue_t *)argument;
+
+    while (1)
+    {
+        mutex_lock(&queue->mutex);
+        u32 index = queue->next++;
+        mutex_unlock(&queue->mutex);
+
+        if (index >= queue->files->count)
+            return NULL;
+
+        const char *input_name = queue->files->names[index];
+        char *output_name = get_output_name(queue->options->operation, input_name);
+
+        command_line_error_t cli_error = output_name ? CLI_NO_ERROR : CLI_COULD_NOT_ALLOCATE;
+        error_t lib_error = ERROR_ALL_GOOD;
+        u64 input_length = 0, output_length = 0;
+
+        command_line_options_t options = *queue->options;
+        options.pipeline = 0;
+
+        if (!cli_error)
+            cli_error = process_whole_file(options, input_name, output_name, &lib_error, &input_length, &output_length);
+
+        mutex_lock(&queue->mutex);
+
+        if (cli_error || lib_error)
         {
-            if ((lib_error = do_rolz_decoding(input_file, &output_file)))
-                goto exit;
+            fprintf(stderr, "%s: ", input_name);
+            print_error_message(cli_error, lib_error);
+            queue->failures += 1;
         }
-        break;
+        else
+            fprintf(stderr, "%s: %" PRIu64 " to %" PRIu64 " bytes\n", input_name, input_length, output_length);
+
+        mutex_unlock(&queue->mutex);
+        free(output_name);
+    }
+}
+
+// Files are spread over one thread per CPU.
+static int process_multiple_files(const command_line_options_t *options)
+{
+    file_list_t files = {0};
+    command_line_error_t cli_error = list_files(options->paths, options->path_count, options->recursive, &files);
+
+    if (cli_error)
+    {
+        file_list_free(&files);
+        return print_error_message(cli_error, ERROR_ALL_GOOD);
     }
 
-    clock_t end_time = clock();
+    select_files(options, &files);
+
+    file_queue_t queue = {.options = options, .files = &files};
+    mutex_init(&queue.mutex);
+
+    u32 thread_count = thread_get_cpu_count();
+    thread_count = thread_count < files.count ? thread_count : files.count;
+
+    thread_t *threads = thread_count > 1 ? (thread_t *)calloc(thread_count, sizeof(thread_t)) : NULL;
+    u32 started = 0;
+
+    for (u32 i = 1; threads && i < thread_count; i += 1, started += 1)
+        if (thread_create(&threads[i], process_files, &queue))
+            break;
+
+    process_files(&queue);
 
-    printf("Compressed %d to %d bytes in %ldms\n", input_file.length, output_file.length, (end_time - start_time) / (CLOCKS_PER_SEC / 1000));
+    for (u32 i = 1; i <= started; i += 1)
+        thread_join(&threads[i]);
 
-    if ((cli_error = write_file(argv[4], output_file)))
+    free(threads);
+    mutex_destroy(&queue.mutex);
+
+    u32 failures = queue.failures;
+    file_list_free(&files);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, const char **argv)
+{
+    command_line_error_t cli_error = CLI_NO_ERROR;
+    error_t lib_error = ERROR_ALL_GOOD;
+
+    command_line_options_t options = {0};
+    if ((cli_error = parse_command_line_arguments(argc, argv, &options)))
+        goto exit;
+
+    if (options.multiple)
+        return process_multiple_files(&options);
+
+    // Wall clock time, the pipeline works on several threads at once.
+    struct timespec start_time;
+    timespec_get(&start_time, TIME_UTC);
+
+    u64 input_length = 0, output_length = 0;
+    if ((cli_error = process_file(options, options.input_file, options.output_file, &lib_error, &input_length, &output_length)) || lib_error)
     {
-        printf("Failed when writing output file \"%s\"\n", argv[4]);
+        fprintf(stderr, "Failed when processing \"%s\" into \"%s\"\n", options.input_file, options.output_file);
         goto exit;
     }
 
+    fprintf(stderr, "Compressed %" PRIu64 " to %" PRIu64 " bytes in %" PRId64 "ms\n", input_length, output_length, __milliseconds_since(start_time));
+
 exit:
-    // TODO: Should we deallocate? We're finishing the program here.
     return print_error_message(cli_error, lib_error);
 }
@@ -0,0 +1,509 @@
+#include "pipeline.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <frame.h>
+
+#include "lib/thread.h"
+
+typedef enum slot_state_t
+{
+    SLOT_FREE,    // Waiting for the reader.
+    SLOT_READ,    // Holds a block for the workers.
+    SLOT_WORKING, // A worker is on it.
+    SLOT_DONE     // Holds a result for the writer.
+} slot_state_t;
+
+// Blocks go through the slots in order, block i always uses slot i % slot_count. Whoever moves a slot out of a
+// state owns its buffers until it moves it to the next one.
+typedef struct slot_t
+{
+    slot_state_t state;
+
+    // The frame the block belongs to, and its original length.
+    frame_config_t config;
+    u64 block_length;
+
+    // Buffers grow as needed, decoded frames don't have to share a block size.
+    array_t input;
+    u64 input_capacity;
+
+    array_t output;
+    u64 output_capacity;
+
+    error_t error;
+} slot_t;
+
+typedef struct pipeline_t
+{
+    operation_t operation;
+    frame_config_t config;
+
+    FILE *input_file;
+    FILE *output_file;
+
+    // Streams don't tell their length up front, so their blocks are encoded as frames of their own.
+    u8 streamed;
+    u64 original_length;
+    u64 bytes_read;
+
+    // Read ahead for frame headers, which have a variable length. Whatever's past a header belongs to its blocks.
+    u8 pending[32];
+    u64 pending_length;
+    u64 pending_position;
+
+    // What's left of the frame being decoded, and how many headers were read.
+    frame_config_t frame;
+    u64 frame_left;
+    u64 frame_count;
+
+    slot_t *slots;
+    u32 slot_count;
+
+    // block_count is only final once reading_done is set.
+    u64 block_count;
+    u8 reading_done;
+    u64 next_to_work;
+
+    // Set by whoever hits an error first, everyone else stops at their next wait.
+    u8 failed;
+    command_line_error_t cli_error;
+    error_t lib_error;
+
+    mutex_t mutex;
+    condition_t changed;
+} pipeline_t;
+
+static void __fail(pipeline_t *pipeline, command_line_error_t cli_error, error_t lib_error)
+{
+    mutex_lock(&pipeline->mutex);
+
+    if (!pipeline->failed)
+    {
+        pipeline->cli_error = cli_error;
+        pipeline->lib_error = lib_error;
+    }
+
+    pipeline->failed = 1;
+    condition_broadcast(&pipeline->changed);
+    mutex_unlock(&pipeline->mutex);
+}
+
+// Waits until the slot reaches the state, returns 0 if the pipeline failed in the meantime.
+static u8 __wait_for(pipeline_t *pipeline, slot_t *slot, slot_state_t state)
+{
+    mutex_lock(&pipeline->mutex);
+
+    while (slot->state != state && !pipeline->failed)
+        condition_wait(&pipeline->changed, &pipeline->mutex);
+
+    u8 ok = !pipeline->failed;
+    mutex_unlock(&pipeline->mutex);
+
+    return ok;
+}
+
+// Waits until the block is in the state, returns 0 if the pipeline failed or there's no such block.
+static u8 __wait_for_block(pipeline_t *pipeline, u64 block, slot_state_t state)
+{
+    slot_t *slot = &pipeline->slots[block % pipeline->slot_count];
+
+    while (!pipeline->failed && slot->state != state && !(pipeline->reading_done && block >= pipeline->block_count))
+        condition_wait(&pipeline->changed, &pipeline->mutex);
+
+    return !pipeline->failed && slot->state == state;
+}
+
+static void __set_state(pipeline_t *pipeline, slot_t *slot, slot_state_t state)
+{
+    mutex_lock(&pipeline->mutex);
+    slot->state = state;
+    condition_broadcast(&pipeline->changed);
+    mutex_unlock(&pipeline->mutex);
+}
+
+static u8 __reserve(array_t *buffer, u64 *capacity, u64 length)
+{
+    if (length <= *capacity)
+        return 1;
+
+    free(buffer->bytes);
+    buffer->bytes = (u8 *)malloc(length);
+    *capacity = buffer->bytes ? length : 0;
+
+    return buffer->bytes != NULL;
+}
+
+// Reads up to length bytes, fewer only at the end of the input.
+static u64 __read_bytes(pipeline_t *pipeline, u8 *bytes, u64 length)
+{
+    u64 pending = pipeline->pending_length - pipeline->pending_position;
+    if (pending > length)
+        pending = length;
+
+    memcpy(bytes, pipeline->pending + pipeline->pending_position, pending);
+    pipeline->pending_position += pending;
+
+    u64 read = pending + fread(bytes + pending, 1, length - pending, pipeline->input_file);
+    pipeline->bytes_read += read;
+
+    return read;
+}
+
+// Starts the next frame, returns 0 when the input ended cleanly before it.
+static u8 __read_frame_header(pipeline_t *pipeline, error_t *lib_error)
+{
+    // Keep what's left of the read ahead and top it up.
+    u64 left = pipeline->pending_length - pipeline->pending_position;
+    memmove(pipeline->pending, pipeline->pending + pipeline->pending_position, left);
+
+    u64 read = fread(pipeline->pending + left, 1, frame_get_header_upper_bound() - left, pipeline->input_file);
+    pipeline->pending_length = left + read;
+    pipeline->pending_position = 0;
+
+    if (pipeline->pending_length == 0)
+        return 0;
+
+    u64 header_length = 0;
+    array_t header = {.bytes = pipeline->pending, .length = pipeline->pending_length};
+
+    if ((*lib_error = frame_read_header(header, &pipeline->frame, &pipeline->frame_left, &header_length)))
+        return 0;
+
+    pipeline->pending_position = header_length;
+    pipeline->bytes_read += header_length;
+    pipeline->frame_count += 1;
+
+    return 1;
+}
+
+// Encoding reads plain blocks, decoding reads each block's compressed length and then its payload. Returns
+// CLI_NO_ERROR with a zero block length at the end of the input.
+static command_line_error_t __read_block(pipeline_t *pipeline, slot_t *slot, error_t *lib_error)
+{
+    slot->block_length = 0;
+
+    if (pipeline->operation == OP_ENCODE)
+    {
+        slot->config = pipeline->config;
+
+        u64 length = pipeline->config.block_length;
+        if (!pipeline->streamed && pipeline->original_length - pipeline->bytes_read < length)
+            length = pipeline->original_length - pipeline->bytes_read;
+
+        // Streamed blocks are whole frames, so they need room for a header too.
+        u64 output_length = frame_get_block_upper_bound(pipeline->config, pipeline->config.block_length) + frame_get_header_upper_bound();
+
+        if (!__reserve(&slot->input, &slot->input_capacity, pipeline->config.block_length) || !__reserve(&slot->output, &slot->output_capacity, output_length))
+            return CLI_COULD_NOT_ALLOCATE;
+
+        slot->input.length = length ? __read_bytes(pipeline, slot->input.bytes, length) : 0;
+        slot->block_length = slot->input.length;
+
+        if (!pipeline->streamed && slot->input.length != length)
+            return CLI_COULD_NOT_READ_FILE;
+
+        return ferror(pipeline->input_file) ? CLI_COULD_NOT_READ_FILE : CLI_NO_ERROR;
+    }
+
+    while (pipeline->frame_left == 0)
+    {
+        if (!__read_frame_header(pipeline, lib_error))
+            return ferror(pipeline->input_file) ? CLI_COULD_NOT_READ_FILE : CLI_NO_ERROR;
+
+        // Pre-passes are undone over the whole output, after every block is decoded.
+        if (pipeline->frame.pre_passes)
+            return CLI_PRE_PASS_STREAM;
+    }
+
+    slot->config = pipeline->frame;
+    slot->block_length = pipeline->frame_left < pipeline->frame.block_length ? pipeline->frame_left : pipeline->frame.block_length;
+    pipeline->frame_left -= slot->block_length;
+
+    u8 length[4];
+    if (__read_bytes(pipeline, length, 4) != 4)
+        return CLI_COULD_NOT_READ_FILE;
+
+    slot->input.length = ((u64)length[0] << 24) | ((u64)length[1] << 16) | ((u64)length[2] << 8) | length[3];
+
+    // A length past the block's upper bound can't come from a valid frame.
+    if (slot->input.length > frame_get_block_upper_bound(slot->config, slot->block_length))
+    {
+        *lib_error = ERROR_UNKNOWN_FORMAT;
+        return CLI_NO_ERROR;
+    }
+
+    if (!__reserve(&slot->input, &slot->input_capacity, slot->input.length) || !__reserve(&slot->output, &slot->output_capacity, slot->block_length))
+        return CLI_COULD_NOT_ALLOCATE;
+
+    return __read_bytes(pipeline, slot->input.bytes, slot->input.length) == slot->input.length ? CLI_NO_ERROR : CLI_COULD_NOT_READ_FILE;
+}
+
+static void *__reader(void *argument)
+{
+    pipeline_t *pipeline = (pipeline_t *)argument;
+
+    u64 block = 0;
+
+    while (1)
+    {
+        slot_t *slot = &pipeline->slots[block % pipeline->slot_count];
+
+        if (!__wait_for(pipeline, slot, SLOT_FREE))
+            return NULL;
+
+        error_t lib_error = ERROR_ALL_GOOD;
+        command_line_error_t cli_error = __read_block(pipeline, slot, &lib_error);
+
+        if (cli_error || lib_error)
+        {
+            __fail(pipeline, cli_error, lib_error);
+            return NULL;
+        }
+
+        if (slot->block_length == 0)
+            break;
+
+        block += 1;
+        __set_state(pipeline, slot, SLOT_READ);
+
+        if (!pipeline->streamed && pipeline->operation == OP_ENCODE && pipeline->bytes_read == pipeline->original_length)
+            break;
+    }
+
+    // Same as frame_decode, a file without a single frame header isn't a frame. Frames of empty inputs have no
+    // blocks, and empty streams are fine too, they encode to an empty frame.
+    if (block == 0 && !pipeline->streamed && pipeline->operation == OP_DECODE && pipeline->frame_count == 0)
+    {
+        __fail(pipeline, CLI_NO_ERROR, ERROR_NO_OP);
+        return NULL;
+    }
+
+    mutex_lock(&pipeline->mutex);
+    pipeline->block_count = block;
+    pipeline->reading_done = 1;
+    condition_broadcast(&pipeline->changed);
+    mutex_unlock(&pipeline->mutex);
+
+    return NULL;
+}
+
+static error_t __process_block(pipeline_t *pipeline, slot_t *slot)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    if (pipeline->operation == OP_DECODE)
+    {
+        slot->output.length = slot->block_length;
+        return frame_decode_block(slot->config, slot->input, &slot->output);
+    }
+
+    array_t header = {.bytes = slot->output.bytes, .length = 0};
+
+    if (pipeline->streamed)
+    {
+        header.length = slot->output_capacity;
+        if ((error = frame_write_header(slot->config, slot->block_length, &header)))
+            return error;
+    }
+
+    array_t block = {.bytes = slot->output.bytes + header.length, .length = slot->output_capacity - header.length};
+    if ((error = frame_encode_block(slot->config, slot->input, &block)))
+        return error;
+
+    slot->output.length = header.length + block.length;
+    return error;
+}
+
+static void *__worker(void *argument)
+{
+    pipeline_t *pipeline = (pipeline_t *)argument;
+
+    while (1)
+    {
+        mutex_lock(&pipeline->mutex);
+
+        // Blocks are taken in order, so a worker only waits on the next one to be read.
+        if (!__wait_for_block(pipeline, pipeline->next_to_work, SLOT_READ))
+        {
+            mutex_unlock(&pipeline->mutex);
+            return NULL;
+        }
+
+        slot_t *slot = &pipeline->slots[pipeline->next_to_work++ % pipeline->slot_count];
+        slot->state = SLOT_WORKING;
+        mutex_unlock(&pipeline->mutex);
+
+        slot->error = __process_block(pipeline, slot);
+
+        __set_state(pipeline, slot, SLOT_DONE);
+    }
+}
+
+// The calling thread writes the blocks as they're done, in order, and hands their slots back to the reader.
+static void __write_blocks(pipeline_t *pipeline, u64 *output_length)
+{
+    for (u64 block = 0;; block += 1)
+    {
+        slot_t *slot = &pipeline->slots[block % pipeline->slot_count];
+
+        mutex_lock(&pipeline->mutex);
+        u8 has_block = __wait_for_block(pipeline, block, SLOT_DONE);
+        mutex_unlock(&pipeline->mutex);
+
+        if (!has_block)
+            return;
+
+        if (slot->error)
+        {
+            __fail(pipeline, CLI_NO_ERROR, slot->error);
+            return;
+        }
+
+        if (fwrite(slot->output.bytes, 1, slot->output.length, pipeline->output_file) != slot->output.length)
+        {
+            __fail(pipeline, CLI_COULD_NOT_WRITE_FILE, ERROR_ALL_GOOD);
+            return;
+        }
+
+        *output_length += slot->output.length;
+        __set_state(pipeline, slot, SLOT_FREE);
+    }
+}
+
+static command_line_error_t __write_header(pipeline_t *pipeline, u64 original_length, error_t *lib_error, u64 *output_length)
+{
+    u8 header[32];
+    array_t output = {.bytes = header, .length = sizeof(header)};
+
+    if ((*lib_error = frame_write_header(pipeline->config, original_length, &output)))
+        return CLI_NO_ERROR;
+
+    if (fwrite(output.bytes, 1, output.length, pipeline->output_file) != output.length)
+        return CLI_COULD_NOT_WRITE_FILE;
+
+    *output_length += output.length;
+    return CLI_NO_ERROR;
+}
+
+// Files get a single frame, whose header we write up front. Decoding reads the headers as they come.
+static command_line_error_t __start(pipeline_t *pipeline, command_line_options_t options, error_t *lib_error, u64 *output_length)
+{
+    pipeline->streamed = pipeline->input_file == stdin;
+
+    if (pipeline->operation == OP_DECODE)
+        return CLI_NO_ERROR;
+
+    pipeline->config = frame_config_init(get_mode_codec(options.mode), options.filter, options.block_bits ? options.block_bits : 22);
+    pipeline->config.lzss.match_threads = pipeline->config.rolz.match_threads = options.match_threads;
+
+    if (pipeline->streamed)
+        return CLI_NO_ERROR;
+
+    pipeline->original_length = get_file_length(pipeline->input_file);
+
+    // An empty file gets the header alone, like frame_encode gives it.
+    return __write_header(pipeline, pipeline->original_length, lib_error, output_length);
+}
+
+static void __free_slots(pipeline_t *pipeline)
+{
+    for (u32 i = 0; pipeline->slots && i < pipeline->slot_count; i += 1)
+    {
+        free(pipeline->slots[i].input.bytes);
+        free(pipeline->slots[i].output.bytes);
+    }
+
+    free(pipeline->slots);
+}
+
+command_line_error_t pipeline_run(command_line_options_t options, error_t *lib_error, u64 *input_length, u64 *output_length)
+{
+    command_line_error_t cli_error = CLI_NO_ERROR;
+
+    *lib_error = ERROR_ALL_GOOD;
+    *input_length = 0;
+    *output_length = 0;
+
+    pipeline_t pipeline = {.operation = options.operation};
+
+    if (!(pipeline.input_file = open_file(options.input_file, "rb")))
+        return CLI_FILE_NOT_FOUND;
+
+    if (!(pipeline.output_file = open_file(options.output_file, "wb")))
+    {
+        close_file(pipeline.input_file);
+        return CLI_COULD_NOT_OPEN_FILE;
+    }
+
+    u32 worker_count = thread_get_cpu_count();
+    thread_t reader, *workers = NULL;
+    u32 started = 0;
+    u8 reader_started = 0;
+
+    if ((cli_error = __start(&pipeline, options, lib_error, output_length)) || *lib_error)
+        goto exit;
+
+    // One slot per worker, plus one being read and one being written.
+    pipeline.slot_count = worker_count + 2;
+
+    pipeline.slots = (slot_t *)calloc(pipeline.slot_count, sizeof(slot_t));
+    workers = (thread_t *)calloc(worker_count, sizeof(thread_t));
+
+    if (pipeline.slots == NULL || workers == NULL)
+    {
+        cli_error = CLI_COULD_NOT_ALLOCATE;
+        goto exit;
+    }
+
+    mutex_init(&pipeline.mutex);
+    condition_init(&pipeline.changed);
+
+    // The writer can't make progress without the reader and at least one worker.
+    if ((*lib_error = thread_create(&reader, __reader, &pipeline)))
+        goto exit_threads;
+    reader_started = 1;
+
+    for (; started < worker_count; started += 1)
+        if (thread_create(&workers[started], __worker, &pipeline))
+            break;
+
+    if (started == 0)
+        __fail(&pipeline, CLI_NO_ERROR, ERROR_COULD_NOT_ALLOCATE);
+
+    __write_blocks(&pipeline, output_length);
+
+
+exit_threads:
+    if (reader_started)
+        thread_join(&reader);
+
+    for (u32 i = 0; i < started; i += 1)
+        thread_join(&workers[i]);
+
+    condition_destroy(&pipeline.changed);
+    mutex_destroy(&pipeline.mutex);
+
+    if (pipeline.failed)
+    {
+        cli_error = pipeline.cli_error;
+        *lib_error = pipeline.lib_error;
+    }
+    // A stream that ended before its first block still gets a frame, an empty one.
+    else if (pipeline.streamed && pipeline.operation == OP_ENCODE && pipeline.block_count == 0)
+        cli_error = __write_header(&pipeline, 0, lib_error, output_length);
+
+exit:
+    *input_length = pipeline.operation == OP_ENCODE && !pipeline.streamed ? pipeline.original_length : pipeline.bytes_read;
+
+    free(workers);
+    __free_slots(&pipeline);
+    close_file(pipeline.input_file);
+
+    if (fflush(pipeline.output_file) && !cli_error)
+        cli_error = CLI_COULD_NOT_WRITE_FILE;
+
+    close_file(pipeline.output_file);
+    return cli_error;
+}
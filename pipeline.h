@@ -0,0 +1,15 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <common.h>
+
+#include "command_line.h"
+
+// Encodes or decodes a frame block by block, so reading, compressing and writing overlap: a reader thread fills
+// block buffers, one worker per CPU runs the codec on them and the calling thread writes the results in order.
+// A fixed ring of buffers sits between them, so memory stays bounded whatever the file size. Files encode to the
+// same frame frame_encode writes. stdin doesn't tell its length up front, so each of its blocks becomes a frame of
+// its own, and decoding reads any number of frames back to back.
+command_line_error_t pipeline_run(command_line_options_t options, error_t *lib_error, u64 *input_length, u64 *output_length);
+
+#endif
@@ -1,10 +1,27 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#include <batch.h>
+#include <checkpoint.h>
+#include <dedup.h>
+#include <frame.h>
+#include <ldm.h>
+#include <lzb.h>
 #include <lzss.h>
 #include <rolz.h>
 #include "command_line.h"
+#include "pipeline.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
 typedef error_t (*process_fn_t)(array_t in, array_t *out);
 
@@ -26,6 +43,225 @@ static error_t encode_rolz(array_t input, array_t *output) { return rolz_encode(
 
 static error_t decode_rolz(array_t input, array_t *output) { return rolz_decode(get_rolz_config(), input, output); }
 
+static error_t encode_lzb(array_t input, array_t *output) { return lzb_encode(lzb_config_init(16), input, output); }
+
+static error_t decode_lzb(array_t input, array_t *output) { return lzb_decode(input, output); }
+
+static inline lzss_config_t get_lzss_split_config()
+{
+    lzss_config_t config = get_lzss_config();
+    config.flags = LZSS_FLAG_SPLIT_STREAMS;
+    return config;
+}
+
+static inline rolz_config_t get_rolz_split_config()
+{
+    rolz_config_t config = get_rolz_config();
+    config.flags = ROLZ_FLAG_SPLIT_STREAMS;
+    return config;
+}
+
+static inline lzss_config_t get_lzss_runs_config()
+{
+    lzss_config_t config = get_lzss_config();
+    config.flags = LZSS_FLAG_LITERAL_RUNS;
+    return config;
+}
+
+static inline rolz_config_t get_rolz_runs_config()
+{
+    rolz_config_t config = get_rolz_config();
+    config.flags = ROLZ_FLAG_LITERAL_RUNS;
+    return config;
+}
+
+// Variable codes make wider windows affordable, so we test them with a bigger one than the defaults.
+static inline lzss_config_t get_lzss_vlc_config()
+{
+    lzss_config_t config = lzss_config_init(12, 8, 2);
+    config.flags = LZSS_FLAG_VARIABLE_CODES;
+    return config;
+}
+
+static inline rolz_config_t get_rolz_vlc_config()
+{
+    rolz_config_t config = get_rolz_config();
+    config.flags = ROLZ_FLAG_VARIABLE_CODES | ROLZ_FLAG_LITERAL_RUNS;
+    return config;
+}
+
+static inline lzss_config_t get_lzss_rep_config()
+{
+    lzss_config_t config = get_lzss_vlc_config();
+    config.flags |= LZSS_FLAG_REP_OFFSETS;
+    return config;
+}
+
+static inline rolz_config_t get_rolz_explicit_config()
+{
+    rolz_config_t config = get_rolz_config();
+    config.flags = ROLZ_FLAG_EXPLICIT_OFFSETS;
+    return config;
+}
+
+static inline lzss_config_t get_lzss_long_config()
+{
+    lzss_config_t config = get_lzss_config();
+    config.flags = LZSS_FLAG_LONG_MATCHES | LZSS_FLAG_VARIABLE_CODES;
+    return config;
+}
+
+static inline rolz_config_t get_rolz_long_config()
+{
+    rolz_config_t config = get_rolz_config();
+    config.flags = ROLZ_FLAG_LONG_MATCHES;
+    return config;
+}
+
+static inline lzss_config_t get_lzss_rep_runs_config()
+{
+    lzss_config_t config = get_lzss_config();
+    config.flags = LZSS_FLAG_REP_OFFSETS | LZSS_FLAG_LITERAL_RUNS;
+    return config;
+}
+
+static error_t encode_lzss_split(array_t input, array_t *output) { return lzss_encode(get_lzss_split_config(), input, output); }
+
+static error_t decode_lzss_split(array_t input, array_t *output) { return lzss_decode(get_lzss_split_config(), input, output); }
+
+static error_t encode_rolz_split(array_t input, array_t *output) { return rolz_encode(get_rolz_split_config(), input, output); }
+
+static error_t decode_rolz_split(array_t input, array_t *output) { return rolz_decode(get_rolz_split_config(), input, output); }
+
+static error_t encode_lzss_runs(array_t input, array_t *output) { return lzss_encode(get_lzss_runs_config(), input, output); }
+
+static error_t decode_lzss_runs(array_t input, array_t *output) { return lzss_decode(get_lzss_runs_config(), input, output); }
+
+static error_t encode_rolz_runs(array_t input, array_t *output) { return rolz_encode(get_rolz_runs_config(), input, output); }
+
+static error_t decode_rolz_runs(array_t input, array_t *output) { return rolz_decode(get_rolz_runs_config(), input, output); }
+
+static error_t encode_lzss_vlc(array_t input, array_t *output) { return lzss_encode(get_lzss_vlc_config(), input, output); }
+
+static error_t decode_lzss_vlc(array_t input, array_t *output) { return lzss_decode(get_lzss_vlc_config(), input, output); }
+
+static error_t encode_rolz_vlc(array_t input, array_t *output) { return rolz_encode(get_rolz_vlc_config(), input, output); }
+
+static error_t decode_rolz_vlc(array_t input, array_t *output) { return rolz_decode(get_rolz_vlc_config(), input, output); }
+
+static error_t encode_lzss_rep(array_t input, array_t *output) { return lzss_encode(get_lzss_rep_config(), input, output); }
+
+static error_t decode_lzss_rep(array_t input, array_t *output) { return lzss_decode(get_lzss_rep_config(), input, output); }
+
+static error_t encode_lzss_rep_runs(array_t input, array_t *output) { return lzss_encode(get_lzss_rep_runs_config(), input, output); }
+
+static error_t decode_lzss_rep_runs(array_t input, array_t *output) { return lzss_decode(get_lzss_rep_runs_config(), input, output); }
+
+static error_t encode_rolz_explicit(array_t input, array_t *output) { return rolz_encode(get_rolz_explicit_config(), input, output); }
+
+static error_t decode_rolz_explicit(array_t input, array_t *output) { return rolz_decode(get_rolz_explicit_config(), input, output); }
+
+static error_t encode_lzss_long(array_t input, array_t *output) { return lzss_encode(get_lzss_long_config(), input, output); }
+
+static error_t decode_lzss_long(array_t input, array_t *output) { return lzss_decode(get_lzss_long_config(), input, output); }
+
+static error_t encode_rolz_long(array_t input, array_t *output) { return rolz_encode(get_rolz_long_config(), input, output); }
+
+static error_t decode_rolz_long(array_t input, array_t *output) { return rolz_decode(get_rolz_long_config(), input, output); }
+
+static inline ldm_config_t get_ldm_config()
+{
+    return ldm_config_init(20, 64, 4);
+}
+
+static inline dedup_config_t get_dedup_config()
+{
+    return dedup_config_init(12, 0);
+}
+
+static error_t encode_ldm(array_t input, array_t *output) { return ldm_encode(get_ldm_config(), input, output); }
+
+static error_t decode_ldm(array_t input, array_t *output) { return ldm_decode(get_ldm_config(), input, output); }
+
+static error_t encode_dedup(array_t input, array_t *output) { return dedup_encode(get_dedup_config(), input, output); }
+
+static error_t decode_dedup(array_t input, array_t *output) { return dedup_decode(get_dedup_config(), input, output); }
+
+typedef u64 (*bound_fn_t)(u64 input_length);
+typedef error_t (*length_fn_t)(array_t input, u64 *original_length);
+
+// Runs a pre-pass over the input and then the codec over the pre-pass output.
+static error_t encode_chain(array_t input, array_t *output, process_fn_t prepass, bound_fn_t get_upper_bound, process_fn_t codec)
+{
+    array_t intermediate = {.length = get_upper_bound(input.length)};
+    if (!(intermediate.bytes = (u8 *)malloc(intermediate.length)))
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    error_t error = prepass(input, &intermediate);
+    if (!error)
+        error = codec(intermediate, output);
+
+    free(intermediate.bytes);
+    return error;
+}
+
+static error_t decode_chain(array_t input, array_t *output, process_fn_t codec, length_fn_t get_original_length, process_fn_t prepass)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    array_t intermediate = {0};
+    if ((error = get_original_length(input, &intermediate.length)))
+        return error;
+
+    if (!(intermediate.bytes = (u8 *)malloc(intermediate.length)))
+        return ERROR_COULD_NOT_ALLOCATE;
+
+    if (!(error = codec(input, &intermediate)))
+        error = prepass(intermediate, output);
+
+    free(intermediate.bytes);
+    return error;
+}
+
+static error_t encode_ldm_rolz(array_t input, array_t *output) { return encode_chain(input, output, encode_ldm, ldm_get_upper_bound, encode_rolz); }
+
+static error_t decode_ldm_rolz(array_t input, array_t *output) { return decode_chain(input, output, decode_rolz, rolz_get_original_length, decode_ldm); }
+
+static error_t encode_dedup_rolz(array_t input, array_t *output) { return encode_chain(input, output, encode_dedup, dedup_get_upper_bound, encode_rolz); }
+
+static error_t decode_dedup_rolz(array_t input, array_t *output) { return decode_chain(input, output, decode_rolz, rolz_get_original_length, decode_dedup); }
+
+static error_t encode_frame(codec_t codec, filter_t filter, array_t input, array_t *output) { return frame_encode(frame_config_init(codec, filter, 16), input, output); }
+
+static error_t decode_frame(array_t input, array_t *output) { return frame_decode(input, output); }
+
+static error_t encode_frame_lzss(array_t input, array_t *output) { return encode_frame(CODEC_LZSS, FILTER_NONE, input, output); }
+
+static error_t encode_frame_text_lzss(array_t input, array_t *output) { return encode_frame(CODEC_LZSS, FILTER_TEXT, input, output); }
+
+static error_t encode_frame_lzb(array_t input, array_t *output) { return encode_frame(CODEC_LZB, FILTER_NONE, input, output); }
+
+static error_t encode_frame_text_rolz(array_t input, array_t *output) { return encode_frame(CODEC_ROLZ, FILTER_TEXT, input, output); }
+
+static error_t encode_frame_delta_rolz(array_t input, array_t *output) { return encode_frame(CODEC_ROLZ, FILTER_DELTA_BYTE, input, output); }
+
+// Two frames back to back, with different codecs, like the CLI writes when streaming stdin.
+static error_t encode_two_frames(array_t input, array_t *output)
+{
+    error_t error = ERROR_ALL_GOOD;
+
+    array_t first = {.bytes = output->bytes, .length = output->length};
+    if ((error = encode_frame_lzss((array_t){.bytes = input.bytes, .length = input.length / 2}, &first)))
+        return error;
+
+    array_t second = {.bytes = output->bytes + first.length, .length = output->length - first.length};
+    if ((error = encode_frame_text_rolz((array_t){.bytes = input.bytes + input.length / 2, .length = input.length - input.length / 2}, &second)))
+        return error;
+
+    output->length = first.length + second.length;
+    return error;
+}
+
 void test_compression(const char *file_name, const char *algorithm, process_fn_t encode, process_fn_t decode)
 {
     printf("Testing %s compression with \"%s\"\n", algorithm, file_name);
@@ -42,7 +278,7 @@ void test_compression(const char *file_name, const char *algorithm, process_fn_t
     const u32 original_hash3 = hash_bytes(input_file);
 
     // Eh. This should be the same
-    const u32 upper_bound_length = lzss_get_upper_bound(input_file.length);
+    const u64 upper_bound_length = lzss_get_upper_bound(input_file.length);
 
     array_t encoded = {0};
     if (!(encoded.bytes = (u8 *)malloc(upper_bound_length)))
@@ -70,7 +306,7 @@ void test_compression(const char *file_name, const char *algorithm, process_fn_t
     const float encoding_percentage = (1.0f - (float)encoded.length / (float)input_file.length) * 100.0f;
     const float encoding_bits_per_ms = (encoded.length * 8.0f) / elapsed_encoding;
 
-    printf("Encoded %d->%d, a %f%% compression rate in %lldms. Speed of %f bits/ms\n", input_file.length, encoded.length, encoding_percentage, elapsed_encoding, encoding_bits_per_ms);
+    printf("Encoded %" PRIu64 "->%" PRIu64 ", a %f%% compression rate in %" PRIu64 "ms. Speed of %f bits/ms\n", input_file.length, encoded.length, encoding_percentage, elapsed_encoding, encoding_bits_per_ms);
 
     array_t decoded = {0};
     if (!(decoded.bytes = (u8 *)malloc(input_file.length)))
@@ -96,7 +332,7 @@ void test_compression(const char *file_name, const char *algorithm, process_fn_t
     const u64 elapsed_decoding = (end_decoding - start_decoding) / (u64)(CLOCKS_PER_SEC / 1000.0f);
     const float decoding_bits_per_ms = (decoded.length * 8.0f) / elapsed_decoding;
 
-    printf("Decoded %d bytes in %lldms. Speed of %f bits/ms\n", input_file.length, elapsed_decoding, decoding_bits_per_ms);
+    printf("Decoded %" PRIu64 " bytes in %" PRIu64 "ms. Speed of %f bits/ms\n", input_file.length, elapsed_decoding, decoding_bits_per_ms);
 
     const u32 decoded_hash1 = jenkins32(decoded);
     const u32 decoded_hash2 = adler32(decoded);
@@ -118,8 +354,1034 @@ void test_compression(const char *file_name, const char *algorithm, process_fn_t
     printf("Success!\n\n");
 }
 
+typedef error_t (*margin_encode_fn_t)(array_t input, array_t *output, u64 *in_place_margin);
+typedef error_t (*in_place_decode_fn_t)(array_t buffer, u64 compressed_length);
+typedef u64 (*margin_bound_fn_t)(u64 input_length);
+
+static error_t encode_lzss_margin(array_t input, array_t *output, u64 *margin) { return lzss_encode_with_margin(get_lzss_config(), input, output, margin); }
+
+static error_t decode_lzss_in_place(array_t buffer, u64 compressed_length) { return lzss_decode_in_place(get_lzss_config(), buffer, compressed_length); }
+
+static error_t encode_rolz_margin(array_t input, array_t *output, u64 *margin) { return rolz_encode_with_margin(get_rolz_config(), input, output, margin); }
+
+static error_t decode_rolz_in_place(array_t buffer, u64 compressed_length) { return rolz_decode_in_place(get_rolz_config(), buffer, compressed_length); }
+
+// Decodes with the compressed data at the end of a single buffer of original length + the reported margin.
+void test_in_place(const char *file_name, const char *algorithm, margin_encode_fn_t encode, in_place_decode_fn_t decode, margin_bound_fn_t get_margin_bound)
+{
+    printf("Testing %s in-place decoding with \"%s\"\n", algorithm, file_name);
+
+    array_t input_file = {0};
+    if (read_file(file_name, &input_file))
+    {
+        printf("Failed when reading input file \"%s\"\n", file_name);
+        return;
+    }
+
+    array_t encoded = {.length = lzss_get_upper_bound(input_file.length)};
+    if (!(encoded.bytes = (u8 *)malloc(encoded.length)))
+    {
+        printf("Failed when allocating memory for the compressed buffer.\n");
+        return;
+    }
+
+    u64 margin = 0;
+    error_t error = ERROR_ALL_GOOD;
+
+    if ((error = encode(input_file, &encoded, &margin)))
+    {
+        printf("Failed encoding, error: %d\n", error);
+        return;
+    }
+
+    const u64 margin_bound = get_margin_bound(input_file.length);
+    if (margin > margin_bound)
+        printf("Failed: margin %" PRIu64 " is over the bound %" PRIu64 "\n", margin, margin_bound);
+
+    array_t buffer = {.length = input_file.length + margin};
+    if (!(buffer.bytes = (u8 *)malloc(buffer.length)))
+    {
+        printf("Failed when allocating memory for the in-place buffer.\n");
+        return;
+    }
+
+    memcpy(buffer.bytes + buffer.length - encoded.length, encoded.bytes, encoded.length);
+
+    if ((error = decode(buffer, encoded.length)))
+        printf("Failed decoding in place, error: %d\n", error);
+    else if (memcmp(buffer.bytes, input_file.bytes, input_file.length) != 0)
+        printf("Failed comparing the decoded bytes\n");
+    else
+        printf("Decoded %" PRIu64 " bytes with a margin of %" PRIu64 " bytes\n\nSuccess!\n\n", input_file.length, margin);
+
+    free(buffer.bytes);
+    free(encoded.bytes);
+    free(input_file.bytes);
+}
+
+// A compressible first half followed by random bytes is the worst case: the decoder gets ahead of its input early on.
+void test_in_place_margin()
+{
+    printf("Testing in-place margins when the decoder gets ahead\n");
+
+    const u64 length = 64 * 1024;
+    u8 *bytes = (u8 *)malloc(length);
+    array_t encoded = {.length = lzss_get_upper_bound(length)};
+    array_t buffer = {.bytes = (u8 *)malloc(length + lzss_get_in_place_margin_bound(length))};
+
+    if (!bytes || !buffer.bytes || !(encoded.bytes = (u8 *)malloc(encoded.length)))
+    {
+        printf("Failed when allocating memory for the in-place buffers.\n");
+        return;
+    }
+
+    srand(99);
+    for (u64 i = 0; i < length; i += 1)
+        bytes[i] = i < length / 2 ? "abcabcabd"[i % 9] : (u8)rand();
+
+    u64 margin = 0;
+    error_t error = ERROR_ALL_GOOD;
+    if ((error = lzss_encode_with_margin(get_lzss_config(), (array_t){.bytes = bytes, .length = length}, &encoded, &margin)))
+    {
+        printf("Failed encoding, error: %d\n", error);
+        return;
+    }
+
+    // One byte less than the reported margin must be caught instead of corrupting the output.
+    buffer.length = length + margin - 1;
+    memcpy(buffer.bytes + buffer.length - encoded.length, encoded.bytes, encoded.length);
+    error = lzss_decode_in_place(get_lzss_config(), buffer, encoded.length);
+
+    buffer.length = length + margin;
+    memcpy(buffer.bytes + buffer.length - encoded.length, encoded.bytes, encoded.length);
+
+    if (margin == 0 || error != ERROR_BUFFER_OUT_OF_BOUNDS)
+        printf("Failed: a margin of %" PRIu64 " - 1 wasn't detected\n", margin);
+    else if ((error = lzss_decode_in_place(get_lzss_config(), buffer, encoded.length)) || memcmp(buffer.bytes, bytes, length) != 0)
+        printf("Failed decoding with a margin of %" PRIu64 ", error: %d\n", margin, error);
+    else
+        printf("Decoded with a margin of %" PRIu64 " bytes\n\nSuccess!\n\n", margin);
+
+    free(bytes);
+    free(encoded.bytes);
+    free(buffer.bytes);
+}
+
+// Slices the file in 1-4KB payloads (plus an empty one) and checks the batch matches encoding them one by one.
+void test_batch(const char *file_name, const char *algorithm, codec_t codec, u32 threads)
+{
+    printf("Testing batch %s on %s with %u threads\n", algorithm, file_name, threads);
+
+    array_t input_file = {0};
+    if (read_file(file_name, &input_file))
+    {
+        printf("Failed when reading input file \"%s\"\n", file_name);
+        return;
+    }
+
+    const u64 max_count = input_file.length / 1024 + 2;
+    array_t *inputs = (array_t *)malloc(max_count * sizeof(array_t));
+    u64 *offsets = (u64 *)malloc((max_count + 1) * sizeof(u64));
+    u64 *decoded_offsets = (u64 *)malloc((max_count + 1) * sizeof(u64));
+
+    if (!inputs || !offsets || !decoded_offsets)
+    {
+        printf("Failed when allocating memory for the batch tables.\n");
+        return;
+    }
+
+    u64 count = 0;
+    inputs[count++] = (array_t){.bytes = input_file.bytes, .length = 0};
+
+    srand(42);
+    for (u64 position = 0; position < input_file.length; count += 1)
+    {
+        u64 length = MIN(1024 + (u64)(rand() % 3072), input_file.length - position);
+        inputs[count] = (array_t){.bytes = input_file.bytes + position, .length = length};
+        position += length;
+    }
+
+    const batch_config_t config = batch_config_init(codec, threads);
+    array_t arena = {.length = batch_get_upper_bound(config, inputs, count)};
+    array_t decoded = {.length = input_file.length};
+    array_t single = {.length = rolz_get_upper_bound(4096)};
+
+    arena.bytes = (u8 *)malloc(arena.length);
+    decoded.bytes = (u8 *)malloc(decoded.length);
+    single.bytes = (u8 *)malloc(single.length);
+
+    if (!arena.bytes || !decoded.bytes || !single.bytes)
+    {
+        printf("Failed when allocating memory for the batch buffers.\n");
+        return;
+    }
+
+    error_t error = ERROR_ALL_GOOD;
+
+    clock_t start_time = clock();
+    for (u64 i = 1; i < count; i += 1)
+    {
+        single.length = rolz_get_upper_bound(4096);
+        if (codec == CODEC_LZSS)
+            error = lzss_encode(config.lzss, inputs[i], &single);
+        else if (codec == CODEC_LZB)
+            error = lzb_encode(config.lzb, inputs[i], &single);
+        else
+            error = rolz_encode(config.rolz, inputs[i], &single);
+    }
+    clock_t single_time = clock() - start_time;
+
+    start_time = clock();
+    error = batch_encode(config, inputs, count, &arena, offsets);
+    clock_t batch_time = clock() - start_time;
+
+    if (error || (error = batch_decode(config, arena, offsets, count, &decoded, decoded_offsets)))
+        printf("Failed with error: %d\n", error);
+    else if (offsets[1] != offsets[0] || decoded_offsets[1] != 0 || decoded.length != input_file.length)
+        printf("Failed keeping the empty payload empty\n");
+    else if (memcmp(decoded.bytes, input_file.bytes, input_file.length) != 0)
+        printf("Failed comparing the decoded payloads\n");
+    else
+        printf("Encoded %" PRIu64 " payloads %" PRIu64 "->%" PRIu64 " in %ldms, %ldms one by one\n\nSuccess!\n\n", count, input_file.length, arena.length,
+               batch_time / (CLOCKS_PER_SEC / 1000), single_time / (CLOCKS_PER_SEC / 1000));
+
+    free(input_file.bytes);
+    free(inputs);
+    free(offsets);
+    free(decoded_offsets);
+    free(arena.bytes);
+    free(decoded.bytes);
+    free(single.bytes);
+}
+
+// Both codecs' message streams behind the same calls.
+typedef struct test_stream_t
+{
+    codec_t codec;
+    lzss_stream_t lzss;
+    rolz_stream_t rolz;
+} test_stream_t;
+
+static error_t test_stream_init(test_stream_t *stream, codec_t codec, u8 flags)
+{
+    lzss_config_t lzss = get_lzss_config();
+    rolz_config_t rolz = get_rolz_config();
+    lzss.flags = rolz.flags = flags;
+
+    stream->codec = codec;
+    return codec == CODEC_LZSS ? lzss_stream_init(lzss, &stream->lzss) : rolz_stream_init(rolz, &stream->rolz);
+}
+
+static void test_stream_free(test_stream_t *stream) { stream->codec == CODEC_LZSS ? lzss_stream_free(&stream->lzss) : rolz_stream_free(&stream->rolz); }
+
+static error_t test_stream_write(test_stream_t *stream, array_t input)
+{
+    return stream->codec == CODEC_LZSS ? lzss_stream_write(&stream->lzss, input) : rolz_stream_write(&stream->rolz, input);
+}
+
+static error_t test_stream_flush(test_stream_t *stream, array_t *output)
+{
+    return stream->codec == CODEC_LZSS ? lzss_stream_flush(&stream->lzss, output) : rolz_stream_flush(&stream->rolz, output);
+}
+
+static error_t test_stream_decode(test_stream_t *stream, array_t input, array_t *message)
+{
+    return stream->codec == CODEC_LZSS ? lzss_stream_decode(&stream->lzss, input, message) : rolz_stream_decode(&stream->rolz, input, message);
+}
+
+// Every message is flushed and decoded right away, and has to come out whole while the history carries over.
+// The decoder first gets all of its chunk but the last byte, which must wait for the rest.
+void test_message_stream(const char *file_name, const char *algorithm, codec_t codec, u8 flags)
+{
+    printf("Testing %s message streams with \"%s\"\n", algorithm, file_name);
+
+    array_t input_file = {0};
+    if (read_file(file_name, &input_file))
+    {
+        printf("Failed when reading input file \"%s\"\n", file_name);
+        return;
+    }
+
+    test_stream_t encoder = {0}, decoder = {0};
+    array_t chunk = {.bytes = (u8 *)malloc(LZSS_STREAM_CHUNK_HEADER_LENGTH + rolz_get_upper_bound(2048))};
+    array_t single = {.bytes = (u8 *)malloc(rolz_get_upper_bound(2048))};
+
+    if (test_stream_init(&encoder, codec, flags) || test_stream_init(&decoder, codec, flags) || !chunk.bytes || !single.bytes)
+    {
+        printf("Failed when allocating memory for the streams.\n");
+        return;
+    }
+
+    lzss_config_t lzss = get_lzss_config();
+    rolz_config_t rolz = get_rolz_config();
+    lzss.flags = rolz.flags = flags;
+
+    u64 count = 0, streamed_length = 0, single_length = 0;
+    error_t error = ERROR_ALL_GOOD;
+
+    srand(7);
+    for (u64 position = 0; position < input_file.length && !error; count += 1)
+    {
+        u64 length = 1 + (u64)(rand() % 2048);
+        array_t message = {.bytes = input_file.bytes + position, .length = MIN(length, input_file.length - position)};
+        array_t head = {.bytes = message.bytes, .length = message.length / 2};
+        array_t tail = {.bytes = message.bytes + head.length, .length = message.length - head.length};
+        array_t decoded = {0};
+        position += message.length;
+
+        chunk.length = LZSS_STREAM_CHUNK_HEADER_LENGTH + rolz_get_upper_bound(2048);
+        if ((error = test_stream_write(&encoder, head)) || (error = test_stream_write(&encoder, tail)) || (error = test_stream_flush(&encoder, &chunk)))
+            break;
+
+        array_t partial = {.bytes = chunk.bytes, .length = chunk.length - 1};
+        if (test_stream_decode(&decoder, partial, &decoded) != ERROR_BUFFER_OUT_OF_BOUNDS)
+        {
+            printf("Failed: a partial chunk wasn't detected\n");
+            error = ERROR_UNKNOWN_FORMAT;
+            break;
+        }
+
+        if ((error = test_stream_decode(&decoder, chunk, &decoded)))
+            break;
+
+        if (decoded.length != message.length || memcmp(decoded.bytes, message.bytes, message.length) != 0)
+        {
+            printf("Failed comparing message %" PRIu64 "\n", count);
+            error = ERROR_UNKNOWN_FORMAT;
+            break;
+        }
+
+        single.length = rolz_get_upper_bound(2048);
+        error = codec == CODEC_LZSS ? lzss_encode(lzss, message, &single) : rolz_encode(rolz, message, &single);
+
+        streamed_length += chunk.length;
+        single_length += single.length;
+    }
+
+    chunk.length = LZSS_STREAM_CHUNK_HEADER_LENGTH;
+    if (error)
+        printf("Failed with error: %d\n", error);
+    else if (test_stream_flush(&encoder, &chunk) != ERROR_NO_OP || chunk.length != 0)
+        printf("Failed: an empty flush wrote a chunk\n");
+    else
+        printf("Streamed %" PRIu64 " messages %" PRIu64 "->%" PRIu64 ", %" PRIu64 " one by one\n\nSuccess!\n\n", count, input_file.length, streamed_length,
+               single_length);
+
+    test_stream_free(&encoder);
+    test_stream_free(&decoder);
+    free(input_file.bytes);
+    free(chunk.bytes);
+    free(single.bytes);
+}
+
+// Checkpoints must decode all at once and one range on its own, and cost little against a single stream.
+// Parsing and writing separately must give the same bytes as the encoders, and LZSS parses must make valid LZB.
+void test_sequences(const char *file_name)
+{
+    printf("Testing sequences on %s\n", file_name);
+
+    array_t input_file = {0};
+    if (read_file(file_name, &input_file))
+    {
+        printf("Failed when reading input file \"%s\"\n", file_name);
+        return;
+    }
+
+    lzss_config_t lzss = get_lzss_config();
+    lzss.flags = LZSS_FLAG_LITERAL_RUNS | LZSS_FLAG_REP_OFFSETS;
+    const rolz_config_t rolz = get_rolz_config();
+
+    const u64 bound = rolz_get_upper_bound(input_file.length) + lzss_get_upper_bound(input_file.length) + lzb_get_upper_bound(input_file.length);
+    array_t expected = {.bytes = (u8 *)malloc(bound), .length = bound};
+    array_t written = {.bytes = (u8 *)malloc(bound), .length = bound};
+    array_t decoded = {.bytes = (u8 *)malloc(input_file.length), .length = input_file.length};
+    sequence_buffer_t sequences = {0};
+
+    if (!expected.bytes || !written.bytes || !decoded.bytes)
+    {
+        printf("Failed when allocating memory for the sequence buffers.\n");
+        return;
+    }
+
+    error_t error = ERROR_ALL_GOOD;
+    u64 lzss_count = 0, rolz_count = 0, lzb_length = 0;
+
+    if ((error = lzss_encode(lzss, input_file, &expected)) || (error = lzss_parse(lzss, input_file, &sequences)) ||
+        (error = lzss_encode_sequences(lzss, input_file, &sequences, &written)))
+        printf("Failed with LZSS, error: %d\n", error);
+    else if (written.length != expected.length || memcmp(written.bytes, expected.bytes, expected.length) != 0)
+        printf("Failed comparing the LZSS sequences to lzss_encode\n");
+    else if ((lzss_count = sequences.count, written.length = bound, error = lzb_encode_sequences(input_file, &sequences, &written)) ||
+             (error = lzb_decode(written, &decoded)) || memcmp(decoded.bytes, input_file.bytes, input_file.length) != 0)
+        printf("Failed writing the LZSS sequences as LZB, error: %d\n", error);
+    else if ((lzb_length = written.length, expected.length = written.length = bound, error = rolz_encode(rolz, input_file, &expected)) ||
+             (error = rolz_parse(rolz, input_file, &sequences)) || (error = rolz_encode_sequences(rolz, input_file, &sequences, &written)))
+        printf("Failed with ROLZ, error: %d\n", error);
+    else if (written.length != expected.length || memcmp(written.bytes, expected.bytes, expected.length) != 0)
+        printf("Failed comparing the ROLZ sequences to rolz_encode\n");
+    else if ((rolz_count = sequences.count, sequences.sequences[0].offset = (u32)lzss.max_offset + 1, written.length = bound,
+              error = lzss_encode_sequences(lzss, input_file, &sequences, &written)) != ERROR_UNKNOWN_FORMAT)
+        printf("Failed turning down a match out of range, error: %d\n", error);
+    else
+        printf("Parsed %" PRIu64 " LZSS and %" PRIu64 " ROLZ sequences, the LZSS ones as LZB %" PRIu64 "->%" PRIu64 "\n\nSuccess!\n\n", lzss_count, rolz_count,
+               input_file.length, lzb_length);
+
+    sequence_buffer_free(&sequences);
+    free(input_file.bytes);
+    free(expected.bytes);
+    free(written.bytes);
+    free(decoded.bytes);
+}
+
+// Finder threads must give the same bytes as searching on the calling thread. The small history makes the ROLZ
+// finders start their dictionaries over at every chunk, the default one carries them from chunk to chunk.
+void test_match_threads(const char *file_name, u8 threads)
+{
+    printf("Testing match finding on %u threads on %s\n", threads, file_name);
+
+    array_t input_file = {0};
+    if (read_file(file_name, &input_file))
+    {
+        printf("Failed when reading input file \"%s\"\n", file_name);
+        return;
+    }
+
+    lzss_config_t lzss[2] = {get_lzss_config(), get_lzss_config()};
+    lzss[1].flags = LZSS_FLAG_LITERAL_RUNS | LZSS_FLAG_REP_OFFSETS;
+    rolz_config_t rolz[2] = {get_rolz_config(), rolz_config_init(6, 4, 2, 12)};
+    rolz[1].flags = ROLZ_FLAG_VARIABLE_CODES;
+
+    const u64 bound = lzss_get_upper_bound(input_file.length) + rolz_get_upper_bound(input_file.length);
+    array_t expected = {.bytes = (u8 *)malloc(bound), .length = bound};
+    array_t threaded = {.bytes = (u8 *)malloc(bound), .length = bound};
+
+    if (!expected.bytes || !threaded.bytes)
+    {
+        printf("Failed when allocating memory for the match finding buffers.\n");
+        return;
+    }
+
+    error_t error = ERROR_ALL_GOOD;
+    u64 lzss_length = 0, rolz_length = 0;
+    u8 same = 1;
+
+    for (u32 i = 0; i < 4 && !error && same; i += 1)
+    {
+        expected.length = threaded.length = bound;
+
+        if (i < 2)
+        {
+            lzss_config_t config = lzss[i];
+            error = lzss_encode(config, input_file, &expected);
+
+            config.match_threads = threads;
+            error = error ? error : lzss_encode(config, input_file, &threaded);
+            lzss_length = i == 0 ? threaded.length : lzss_length;
+        }
+        else
+        {
+            rolz_config_t config = rolz[i - 2];
+            error = rolz_encode(config, input_file, &expected);
+
+            config.match_threads = threads;
+            error = error ? error : rolz_encode(config, input_file, &threaded);
+            rolz_length = i == 2 ? threaded.length : rolz_length;
+        }
+
+        same = threaded.length == expected.length && memcmp(threaded.bytes, expected.bytes, expected.length) == 0;
+    }
+
+    if (error)
+        printf("Failed with error: %d\n", error);
+    else if (!same)
+        printf("Failed comparing the threaded match finder to the single threaded one\n");
+    else
+        printf("Same bytes on %u threads, LZSS %" PRIu64 "->%" PRIu64 " and ROLZ %" PRIu64 "->%" PRIu64 "\n\nSuccess!\n\n", threads, input_file.length,
+               lzss_length, input_file.length, rolz_length);
+
+    free(input_file.bytes);
+    free(expected.bytes);
+    free(threaded.bytes);
+}
+
+// Slices length bytes of a buffer into fragments cycling through sizes, with gap bytes between them.
+static u64 split_fragments(u64 length, const u64 *sizes, u64 size_count, array_t *fragments, u8 *bytes, u64 gap)
+{
+    u64 count = 0;
+
+    for (u64 position = 0; position < length; count += 1)
+    {
+        u64 size = sizes[count % size_count];
+        size = size < length - position ? size : length - position;
+
+        fragments[count] = (array_t){.bytes = bytes + position + gap * count, .length = size};
+        position += size;
+    }
+
+    return count;
+}
+
+// Fragments of uneven sizes, from a single byte to more than the ROLZ window, so matches cross them every way.
+// Encoding them must give the bytes encoding the whole input does, and decoding into fragments with a byte between
+// them must fill them and leave those bytes alone.
+void test_fragments(const char *file_name)
+{
+    printf("Testing fragments on %s\n", file_name);
+
+    array_t input_file = {0};
+    if (read_file(file_name, &input_file))
+    {
+        printf("Failed when reading input file \"%s\"\n", file_name);
+        return;
+    }
+
+    static const u64 input_sizes[] = {1, 3, 700, 64, 5000, 2, 70000};
+    static const u64 output_sizes[] = {4096, 1, 17, 100000, 9, 1500};
+
+    // Fragments are never shorter than a byte, so there are at most as many as bytes.
+    array_t *inputs = (array_t *)malloc(input_file.length * sizeof(array_t));
+    array_t *outputs = (array_t *)malloc(input_file.length * sizeof(array_t));
+    u8 *scattered = (u8 *)malloc(2 * input_file.length);
+
+    const u64 bound = lzss_get_upper_bound(input_file.length) + rolz_get_upper_bound(input_file.length);
+    array_t expected = {.bytes = (u8 *)malloc(bound), .length = bound};
+    array_t gathered = {.bytes = (u8 *)malloc(bound), .length = bound};
+
+    if (!inputs || !outputs || !scattered || !expected.bytes || !gathered.bytes)
+    {
+        printf("Failed when allocating memory for the fragment buffers.\n");
+        return;
+    }
+
+    const u64 input_count = split_fragments(input_file.length, input_sizes, sizeof(input_sizes) / sizeof(u64), inputs, input_file.bytes, 0);
+    const u64 output_count = split_fragments(input_file.length, output_sizes, sizeof(output_sizes) / sizeof(u64), outputs, scattered, 1);
+
+    lzss_config_t lzss[2] = {get_lzss_config(), get_lzss_config()};
+    lzss[1].flags = LZSS_FLAG_LITERAL_RUNS | LZSS_FLAG_REP_OFFSETS | LZSS_FLAG_VARIABLE_CODES;
+    // The short history reads the fragments through cursors, the others' windows are long enough to gather them.
+    rolz_config_t rolz[3] = {get_rolz_config(), get_rolz_config(), rolz_config_init(8, 4, 2, 10)};
+    rolz[1].flags = ROLZ_FLAG_LITERAL_RUNS;
+    rolz[2].flags = ROLZ_FLAG_EXPLICIT_OFFSETS;
+
+    error_t error = ERROR_ALL_GOOD;
+    u8 same = 1, filled = 1;
+
+    for (u32 i = 0; i < 5 && !error && same && filled; i += 1)
+    {
+        expected.length = gathered.length = bound;
+        memset(scattered, 0xAA, 2 * input_file.length);
+
+        if (i < 2 && !(error = lzss_encode(lzss[i], input_file, &expected)) && !(error = lzss_encode_fragments(lzss[i], inputs, input_count, &gathered)))
+            error = lzss_decode_fragments(lzss[i], gathered, outputs, output_count);
+
+        if (i >= 2 && !(error = rolz_encode(rolz[i - 2], input_file, &expected)) && !(error = rolz_encode_fragments(rolz[i - 2], inputs, input_count, &gathered)))
+            error = rolz_decode_fragments(rolz[i - 2], gathered, outputs, output_count);
+
+        same = gathered.length == expected.length && memcmp(gathered.bytes, expected.bytes, expected.length) == 0;
+
+        for (u64 f = 0; f < output_count && filled; f += 1)
+            filled = memcmp(outputs[f].bytes, input_file.bytes + (outputs[f].bytes - scattered) - f, outputs[f].length) == 0 &&
+                     (f + 1 == output_count || outputs[f].bytes[outputs[f].length] == 0xAA);
+    }
+
+    // The fragments have to add up to the original length.
+    error_t short_error = output_count < 2 ? ERROR_WRONG_OUTPUT_SIZE : rolz_decode_fragments(rolz[1], gathered, outputs, output_count - 1);
+
+    if (error)
+        printf("Failed with error: %d\n", error);
+    else if (!same)
+        printf("Failed comparing the fragments' encoding to the whole input's\n");
+    else if (!filled)
+        printf("Failed comparing the decoded fragments to the input\n");
+    else if (short_error != ERROR_WRONG_OUTPUT_SIZE)
+        printf("Failed turning down fragments shorter than the original, error: %d\n", short_error);
+    else
+        printf("Encoded %" PRIu64 " fragments and decoded into %" PRIu64 "\n\nSuccess!\n\n", input_count, output_count);
+
+    free(input_file.bytes);
+    free(inputs);
+    free(outputs);
+    free(scattered);
+    free(expected.bytes);
+    free(gathered.bytes);
+}
+
+void test_checkpoints(const char *file_name, const char *algorithm, codec_t codec, u8 interval_bits, u32 threads)
+{
+    printf("Testing checkpoints %s on %s every %u bytes with %u threads\n", algorithm, file_name, 1u << interval_bits, threads);
+
+    array_t input_file = {0};
+    if (read_file(file_name, &input_file))
+    {
+        printf("Failed when reading input file \"%s\"\n", file_name);
+        return;
+    }
+
+    const checkpoint_config_t config = checkpoint_config_init(codec, interval_bits, threads);
+    const u64 count = checkpoint_get_count(config, input_file.length);
+
+    array_t encoded = {.length = checkpoint_get_upper_bound(config, input_file.length)};
+    array_t single = {.length = encoded.length + rolz_get_upper_bound(input_file.length)};
+    array_t decoded = {.length = input_file.length};
+    u64 *index = (u64 *)malloc((count + 1) * sizeof(u64));
+
+    encoded.bytes = (u8 *)malloc(encoded.length);
+    single.bytes = (u8 *)malloc(single.length);
+    decoded.bytes = (u8 *)malloc(decoded.length);
+
+    if (!encoded.bytes || !single.bytes || !decoded.bytes || !index)
+    {
+        printf("Failed when allocating memory for the checkpoint buffers.\n");
+        return;
+    }
+
+    error_t error = codec == CODEC_LZSS ? lzss_encode(config.batch.lzss, input_file, &single) : rolz_encode(config.batch.rolz, input_file, &single);
+
+    // The second checkpoint alone, from the middle of the stream.
+    array_t range = {.bytes = decoded.bytes, .length = MIN(config.interval, input_file.length - config.interval)};
+
+    if (error || (error = checkpoint_encode(config, input_file, &encoded, index)) || (error = checkpoint_decode(config, encoded, index, count, &decoded)))
+        printf("Failed with error: %d\n", error);
+    else if (index[0] != 0 || index[count] != encoded.length || memcmp(decoded.bytes, input_file.bytes, input_file.length) != 0)
+        printf("Failed comparing the decoded checkpoints\n");
+    else if (count < 2 || (error = checkpoint_decode_range(config, encoded, index, 1, 2, &range)) || memcmp(range.bytes, input_file.bytes + config.interval, range.length) != 0)
+        printf("Failed decoding a single checkpoint, error: %d\n", error);
+    else
+        printf("Encoded %" PRIu64 " checkpoints %" PRIu64 "->%" PRIu64 ", %" PRIu64 " as a single stream (%.2f%% larger)\n\nSuccess!\n\n", count, input_file.length,
+               encoded.length, single.length, 100.0 * ((double)encoded.length / (double)single.length - 1.0));
+
+    free(input_file.bytes);
+    free(encoded.bytes);
+    free(single.bytes);
+    free(decoded.bytes);
+    free(index);
+}
+
+// Every filter must round-trip any input, including lengths that don't fill a whole vector and bytes they escape.
+void test_filters()
+{
+    printf("Testing filters\n");
+
+    const u64 lengths[] = {1, 5, 16, 17, 33, 4096 + 7};
+    const char *names[] = {"none", "delta", "delta16", "x86", "text"};
+
+    u8 *input = (u8 *)malloc(lengths[5]);
+    u8 *filtered = (u8 *)malloc(lengths[5] * 2);
+    u8 *decoded = (u8 *)malloc(lengths[5]);
+
+    if (!input || !filtered || !decoded)
+    {
+        printf("Failed when allocating memory for the filter buffers.\n");
+        return;
+    }
+
+    // A mix of random bytes, CALL opcodes with small displacements and JSON-looking text.
+    srand(4321);
+    for (u64 i = 0; i < lengths[5]; i += 1)
+        input[i] = (u8)rand();
+    for (u64 i = 0; i + 5 < lengths[5]; i += 37)
+        input[i] = 0xE8, input[i + 4] = (i & 1) ? 0xFF : 0x00;
+    for (u64 i = 17; i + 5 < lengths[5]; i += 111)
+        input[i] = 0xE9, input[i + 2] = 0xE8; // Opcodes inside another operand.
+    for (u64 i = 2048; i + 8 < lengths[5]; i += 8)
+        memcpy(input + i, "\": \"a\",\n", 8);
+
+    u32 failures = 0;
+
+    for (u32 filter = FILTER_NONE; filter < FILTER_COUNT; filter += 1)
+    {
+        for (u32 l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l += 1)
+        {
+            array_t in = {.bytes = input, .length = lengths[l]};
+            array_t out = {.bytes = filtered, .length = filter_get_upper_bound(filter, lengths[l])};
+            array_t back = {.bytes = decoded, .length = lengths[l]};
+
+            error_t error = ERROR_ALL_GOOD;
+            if ((error = filter_encode(filter, in, &out)) || (error = filter_decode(filter, out, &back)) || memcmp(input, decoded, lengths[l]) != 0)
+            {
+                printf("Failed round-trip of the %s filter with %" PRIu64 " bytes, error: %d\n", names[filter], lengths[l], error);
+                failures += 1;
+            }
+        }
+    }
+
+    free(input);
+    free(filtered);
+    free(decoded);
+
+    if (failures == 0)
+        printf("\nSuccess!\n\n");
+}
+
+// The pipeline must write exactly what frame_encode does, and read it back, over many small blocks.
+void test_pipeline(const char *file_name, const char *algorithm, cli_mode_t mode, filter_t filter)
+{
+    printf("Testing pipeline %s on %s\n", algorithm, file_name);
+
+    const char *compressed_name = "pipeline_test.cmp", *decoded_name = "pipeline_test.out";
+
+    command_line_options_t options = {.mode = mode, .operation = OP_ENCODE, .input_file = file_name, .output_file = compressed_name, .pipeline = 1, .block_bits = 12, .filter = filter};
+
+    error_t error = ERROR_ALL_GOOD;
+    u64 input_length = 0, output_length = 0;
+    array_t input_file = {0}, compressed = {0}, decoded = {0}, expected = {0};
+
+    if (read_file(file_name, &input_file))
+    {
+        printf("Failed when reading input file \"%s\"\n", file_name);
+        return;
+    }
+
+    if (pipeline_run(options, &error, &input_length, &output_length) || error)
+    {
+        printf("Failed when encoding with the pipeline, error: %d\n", error);
+        return;
+    }
+
+    const frame_config_t config = frame_config_init(get_mode_codec(mode), filter, 12);
+    expected.length = frame_get_upper_bound(config, input_file.length);
+    expected.bytes = (u8 *)malloc(expected.length);
+
+    if (expected.bytes == NULL || (error = frame_encode(config, input_file, &expected)) || read_file(compressed_name, &compressed))
+    {
+        printf("Failed when encoding the reference frame, error: %d\n", error);
+        return;
+    }
+
+    if (compressed.length != output_length || compressed.length != expected.length || memcmp(compressed.bytes, expected.bytes, expected.length) != 0)
+    {
+        printf("Failed: the pipeline wrote %" PRIu64 " bytes, frame_encode %" PRIu64 "\n", compressed.length, expected.length);
+        return;
+    }
+
+    options = (command_line_options_t){.operation = OP_DECODE, .input_file = compressed_name, .output_file = decoded_name, .pipeline = 1};
+
+    if (pipeline_run(options, &error, &input_length, &output_length) || error || read_file(decoded_name, &decoded))
+    {
+        printf("Failed when decoding with the pipeline, error: %d\n", error);
+        return;
+    }
+
+    remove(compressed_name);
+    remove(decoded_name);
+
+    if (decoded.length != input_file.length || memcmp(decoded.bytes, input_file.bytes, input_file.length) != 0)
+    {
+        printf("Failed: the decoded file doesn't match the original\n");
+        return;
+    }
+
+    free(input_file.bytes);
+    free(compressed.bytes);
+    free(decoded.bytes);
+    free(expected.bytes);
+
+    printf("\nSuccess!\n\n");
+}
+
+// Two copies of the same random block, further apart than any codec window, should collapse into a single match.
+void test_long_range()
+{
+    printf("Testing LDM with far repeats\n");
+
+    const u64 block_length = 64 * 1024, gap_length = 2 * 1024 * 1024;
+
+    array_t input = {.length = block_length * 2 + gap_length};
+    array_t encoded = {.length = ldm_get_upper_bound(input.length)};
+    array_t decoded = {.length = input.length};
+
+    input.bytes = (u8 *)malloc(input.length);
+    encoded.bytes = (u8 *)malloc(encoded.length);
+    decoded.bytes = (u8 *)malloc(decoded.length);
+
+    if (!input.bytes || !encoded.bytes || !decoded.bytes)
+    {
+        printf("Failed when allocating memory for the LDM buffers.\n");
+        return;
+    }
+
+    srand(1234);
+    for (u64 i = 0; i < block_length + gap_length; i += 1)
+        input.bytes[i] = (u8)rand();
+    for (u64 i = 0; i < block_length; i += 1)
+        input.bytes[block_length + gap_length + i] = input.bytes[i];
+
+    error_t error = ERROR_ALL_GOOD;
+
+    if ((error = ldm_encode(get_ldm_config(), input, &encoded)) || (error = ldm_decode(get_ldm_config(), encoded, &decoded)))
+        printf("Failed with error: %d\n", error);
+    else if (encoded.length > block_length + gap_length + 64)
+        printf("Failed finding the far repeat, encoded %" PRIu64 "->%" PRIu64 "\n", input.length, encoded.length);
+    else if (jenkins32(input) != jenkins32(decoded) || hash_bytes(input) != hash_bytes(decoded))
+        printf("Failed comparing hashes\n");
+    else
+        printf("Encoded %" PRIu64 "->%" PRIu64 "\n\nSuccess!\n\n", input.length, encoded.length);
+
+    free(input.bytes);
+    free(encoded.bytes);
+    free(decoded.bytes);
+}
+
+#ifndef _WIN32
+static int compare_names(const void *a, const void *b) { return strcmp(*(const char *const *)a, *(const char *const *)b); }
+
+// Lists the tree the way -m -r does for the operation, sorted, with the output names, e.g. "a -> a.cmp b -> b.cmp".
+static void describe_selection(operation_t operation, const char *root, char *description, u32 capacity)
+{
+    const char *paths[] = {root};
+    const command_line_options_t options = {.operation = operation, .multiple = 1, .recursive = 1};
+    file_list_t list = {0};
+
+    description[0] = '\0';
+
+    command_line_error_t error = list_files(paths, 1, 1, &list);
+    if (error)
+        snprintf(description, capacity, "error %d", error);
+
+    select_files(&options, &list);
+    qsort(list.names, list.count, sizeof(char *), compare_names);
+
+    for (u32 i = 0; i < list.count && !error; i += 1)
+    {
+        char *output_name = get_output_name(operation, list.names[i]);
+        size_t length = strlen(description);
+        snprintf(description + length, capacity - length, "%s%s -> %s", i ? " " : "", list.names[i], output_name ? output_name : "?");
+        free(output_name);
+    }
+
+    file_list_free(&list);
+}
+
+// A nested directory, compressed files next to plain ones, a dangling link and one back up the tree.
+void test_list_files()
+{
+    printf("Testing listing files\n");
+
+    static const char *files[] = {"list_test/a.txt", "list_test/b.txt.cmp", "list_test/nested/c.txt", "list_test/nested/d.txt.cmp"};
+    u8 content[] = "list";
+
+    mkdir("list_test", 0755);
+    mkdir("list_test/nested", 0755);
+
+    u8 created = 1;
+    for (u32 i = 0; i < 4; i += 1)
+        created &= write_file(files[i], (array_t){.bytes = content, .length = 4}) == CLI_NO_ERROR;
+
+    created &= symlink("missing.txt", "list_test/dangling.txt") == 0 && symlink("..", "list_test/nested/up") == 0;
+
+    char encoded[512], decoded[512];
+    describe_selection(OP_ENCODE, "list_test", encoded, sizeof(encoded));
+    describe_selection(OP_DECODE, "list_test", decoded, sizeof(decoded));
+
+    // Given on the command line the files are all kept, and a missing one fails the whole run.
+    const char *given[] = {"list_test/a.txt", "list_test/b.txt.cmp"}, *missing[] = {"list_test/a.txt", "list_test/dangling.txt"};
+    file_list_t list = {0};
+    command_line_error_t given_error = list_files(given, 2, 0, &list);
+    u32 given_count = list.count;
+    file_list_free(&list);
+    command_line_error_t missing_error = list_files(missing, 2, 0, &list);
+    file_list_free(&list);
+
+    char *plain_name = get_output_name(OP_DECODE, "list_test/a.txt");
+    u8 plain_named = plain_name && strcmp(plain_name, "list_test/a.txt.out") == 0;
+    free(plain_name);
+
+    remove("list_test/nested/up");
+    remove("list_test/dangling.txt");
+    for (u32 i = 0; i < 4; i += 1)
+        remove(files[i]);
+    remove("list_test/nested");
+    remove("list_test");
+
+    if (!created)
+        printf("Failed when creating the test tree\n");
+    else if (strcmp(encoded, "list_test/a.txt -> list_test/a.txt.cmp list_test/nested/c.txt -> list_test/nested/c.txt.cmp") != 0)
+        printf("Failed selecting the files to encode: %s\n", encoded);
+    else if (strcmp(decoded, "list_test/b.txt.cmp -> list_test/b.txt list_test/nested/d.txt.cmp -> list_test/nested/d.txt") != 0)
+        printf("Failed selecting the files to decode: %s\n", decoded);
+    else if (given_error || given_count != 2 || missing_error != CLI_FILE_NOT_FOUND)
+        printf("Failed with the files given, errors: %d, %d, %u files\n", given_error, missing_error, given_count);
+    else if (!plain_named)
+        printf("Failed naming the output of a file without the extension\n");
+    else
+        printf("%s\n%s\n\nSuccess!\n\n", encoded, decoded);
+}
+#endif
+
+// Random blocks between zero runs of every size, from shorter than a match to far past the longest extension.
+void test_long_runs()
+{
+    printf("Testing long matches on runs\n");
+
+    static const u32 run_lengths[] = {1, 3, 17, 31, 32, 255, 256, 4000, 65535, 65536, 65537, 300000};
+    const u32 block_length = 1000, run_count = sizeof(run_lengths) / sizeof(u32);
+
+    array_t input = {.length = 0};
+    for (u32 i = 0; i < run_count; i += 1)
+        input.length += block_length + run_lengths[i];
+
+    const u64 bound = MAX(lzss_get_upper_bound(input.length), rolz_get_upper_bound(input.length));
+    array_t encoded = {.length = bound}, plain = {.length = bound}, decoded = {.length = input.length};
+
+    input.bytes = (u8 *)malloc(input.length);
+    encoded.bytes = (u8 *)malloc(encoded.length);
+    plain.bytes = (u8 *)malloc(plain.length);
+    decoded.bytes = (u8 *)malloc(decoded.length);
+
+    if (!input.bytes || !encoded.bytes || !plain.bytes || !decoded.bytes)
+    {
+        printf("Failed when allocating memory for the run buffers.\n");
+        return;
+    }
+
+    srand(4321);
+    u64 position = 0;
+    for (u32 i = 0; i < run_count; i += 1)
+    {
+        for (u32 j = 0; j < block_length; j += 1)
+            input.bytes[position++] = (u8)rand();
+        memset(input.bytes + position, (u8)i, run_lengths[i]);
+        position += run_lengths[i];
+    }
+
+    error_t error = ERROR_ALL_GOOD;
+    u8 same = 1, smaller = 1;
+
+    for (u32 i = 0; i < 2 && !error && same && smaller; i += 1)
+    {
+        encoded.length = plain.length = bound;
+        decoded.length = input.length;
+
+        if (i == 0 && !(error = lzss_encode(get_lzss_long_config(), input, &encoded)) && !(error = lzss_encode(get_lzss_vlc_config(), input, &plain)))
+            error = lzss_decode(get_lzss_long_config(), encoded, &decoded);
+
+        if (i == 1 && !(error = rolz_encode(get_rolz_long_config(), input, &encoded)) && !(error = rolz_encode(get_rolz_config(), input, &plain)))
+            error = rolz_decode(get_rolz_long_config(), encoded, &decoded);
+
+        same = decoded.length == input.length && memcmp(decoded.bytes, input.bytes, input.length) == 0;
+        smaller = encoded.length < plain.length;
+    }
+
+    if (error)
+        printf("Failed with error: %d\n", error);
+    else if (!same)
+        printf("Failed comparing the decoded runs\n");
+    else if (!smaller)
+        printf("Failed shrinking the runs, %" PRIu64 " with long matches, %" PRIu64 " without\n", encoded.length, plain.length);
+    else
+        printf("Encoded %" PRIu64 "->%" PRIu64 "\n\nSuccess!\n\n", input.length, encoded.length);
+
+    free(input.bytes);
+    free(encoded.bytes);
+    free(plain.bytes);
+    free(decoded.bytes);
+}
+
+// Empty inputs get a frame with a header and no blocks, which decodes back to nothing.
+void test_empty_frame()
+{
+    printf("Testing frames of empty inputs\n");
+
+    u8 frame_bytes[64], byte = 0;
+    error_t error = ERROR_ALL_GOOD;
+    u64 frame_length = 0, original_length = 0;
+
+    for (u32 codec = CODEC_LZSS; codec <= CODEC_LZB && !error && original_length == 0; codec += 1)
+    {
+        array_t frame = {.bytes = frame_bytes, .length = sizeof(frame_bytes)}, output = {.bytes = &byte, .length = 0};
+
+        if (!(error = frame_encode(frame_config_init((codec_t)codec, FILTER_TEXT, 16), (array_t){.bytes = &byte, .length = 0}, &frame)) &&
+            !(error = frame_get_original_length(frame, &original_length)))
+            error = frame_decode(frame, &output);
+
+        frame_length = frame.length;
+    }
+
+    if (error)
+        printf("Failed with error: %d\n", error);
+    else if (original_length != 0 || frame_length == 0 || frame_length > frame_get_header_upper_bound())
+        printf("Failed: the frame is %" PRIu64 " bytes for an original length of %" PRIu64 "\n", frame_length, original_length);
+    else
+        printf("Encoded 0->%" PRIu64 "\n\nSuccess!\n\n", frame_length);
+}
+
+// The frame header records the pre-passes its caller ran, and a frame with them can't be followed by another one.
+void test_frame_pre_passes()
+{
+    printf("Testing pre-passes in frame headers\n");
+
+    u8 frame_bytes[256], text[] = "pre-passes";
+    array_t frame = {.bytes = frame_bytes, .length = sizeof(frame_bytes) / 2};
+    frame_config_t config = frame_config_init(CODEC_LZSS, FILTER_NONE, 16), read = {0};
+
+    config.pre_passes = FRAME_PRE_PASS_DEDUP | FRAME_PRE_PASS_LDM;
+    config.dedup = dedup_config_init(14, 0);
+    config.ldm = ldm_config_init(18, 48, 3);
+
+    u64 original_length = 0;
+    error_t error = frame_encode(config, (array_t){.bytes = text, .length = sizeof(text)}, &frame);
+    error_t double_error = ERROR_ALL_GOOD;
+
+    if (!error && !(error = frame_read_config(frame, &read)))
+    {
+        memcpy(frame_bytes + frame.length, frame_bytes, frame.length);
+        double_error = frame_get_original_length((array_t){.bytes = frame_bytes, .length = 2 * frame.length}, &original_length);
+    }
+
+    if (error)
+        printf("Failed with error: %d\n", error);
+    else if (read.pre_passes != config.pre_passes || read.dedup.average_bits != 14 || read.ldm.hash_bits != 18 || read.ldm.minimum_length != 48 ||
+             read.ldm.stride_bits != 3)
+        printf("Failed reading the pre-passes back\n");
+    else if (double_error != ERROR_UNKNOWN_FORMAT)
+        printf("Failed rejecting two frames with pre-passes: %d\n", double_error);
+    else
+        printf("Encoded %" PRIu64 "->%" PRIu64 "\n\nSuccess!\n\n", (u64)sizeof(text), frame.length);
+}
+
+// Matches that reach before the start of the output must be turned down, not copied from outside the buffer.
+void test_corrupt_input()
+{
+    printf("Testing decoders on corrupt input\n");
+
+    // Original length 16, then a match as the very first token: offset 5 and length 4, or count 4 and step 0. LZB
+    // gets a literal first, and then a match 5 bytes back.
+    u8 lzss_stream[] = {16, 0x80, 0xA2, 0x00};
+    u8 rolz_stream[] = {16, 0xA0, 0x00, 0x00};
+    u8 lzb_stream[] = {16, 0x10, 'a', 0x05, 0x00};
+
+    u8 bytes[16];
+    array_t output = {.bytes = bytes, .length = sizeof(bytes)};
+    error_t lzss_error = lzss_decode(get_lzss_config(), (array_t){.bytes = lzss_stream, .length = sizeof(lzss_stream)}, &output);
+    error_t rolz_error = rolz_decode(get_rolz_config(), (array_t){.bytes = rolz_stream, .length = sizeof(rolz_stream)}, &output);
+    error_t lzb_error = lzb_decode((array_t){.bytes = lzb_stream, .length = sizeof(lzb_stream)}, &output);
+
+    // Frame headers with codec parameters no encoder writes: a 40-bit LZSS offset, and a ROLZ history of 31 bits.
+    u8 frame_bytes[64], text[] = "header";
+    error_t header_errors[2] = {ERROR_ALL_GOOD, ERROR_ALL_GOOD};
+
+    for (u32 i = 0; i < 2; i += 1)
+    {
+        array_t frame = {.bytes = frame_bytes, .length = sizeof(frame_bytes)};
+        if ((header_errors[i] = frame_encode(frame_config_init(i == 0 ? CODEC_LZSS : CODEC_ROLZ, FILTER_NONE, 16), (array_t){.bytes = text, .length = 6}, &frame)))
+            continue;
+
+        frame.bytes[i == 0 ? 6 : 9] = i == 0 ? 40 : 31;
+        header_errors[i] = frame_decode(frame, &output);
+    }
+
+    if (lzss_error != ERROR_BUFFER_OUT_OF_BOUNDS || rolz_error != ERROR_BUFFER_OUT_OF_BOUNDS || lzb_error != ERROR_BUFFER_OUT_OF_BOUNDS)
+        printf("Failed rejecting a match before the start, errors: %d, %d, %d\n", lzss_error, rolz_error, lzb_error);
+    else if (header_errors[0] != ERROR_UNKNOWN_FORMAT || header_errors[1] != ERROR_UNKNOWN_FORMAT)
+        printf("Failed rejecting frame parameters out of range, errors: %d, %d\n", header_errors[0], header_errors[1]);
+    else
+        printf("\nSuccess!\n\n");
+}
+
 int main(int argc, const char **argv)
 {
+    printf("Testing compression %s\n\n", compression_version_string());
+
     test_compression("files/KingsBounty.md", "LZSS", encode_lzss, decode_lzss);
     test_compression("files/KingsBounty.md", "ROLZ", encode_rolz, decode_rolz);
 
@@ -132,5 +1394,93 @@ int main(int argc, const char **argv)
     test_compression("main.c", "LZSS", encode_lzss, decode_lzss);
     test_compression("main.c", "ROLZ", encode_rolz, decode_rolz);
 
+    test_compression("files/KingsBounty.md", "LZB", encode_lzb, decode_lzb);
+    test_compression("files/package-lock.json", "LZB", encode_lzb, decode_lzb);
+    test_compression("main.c", "LZB", encode_lzb, decode_lzb);
+
+    test_compression("files/package-lock.json", "Split LZSS", encode_lzss_split, decode_lzss_split);
+    test_compression("files/package-lock.json", "Split ROLZ", encode_rolz_split, decode_rolz_split);
+    test_compression("main.c", "Split LZSS", encode_lzss_split, decode_lzss_split);
+    test_compression("main.c", "Split ROLZ", encode_rolz_split, decode_rolz_split);
+
+    test_compression("files/package-lock.json", "Runs LZSS", encode_lzss_runs, decode_lzss_runs);
+    test_compression("files/package-lock.json", "Runs ROLZ", encode_rolz_runs, decode_rolz_runs);
+    test_compression("main.c", "Runs LZSS", encode_lzss_runs, decode_lzss_runs);
+    test_compression("main.c", "Runs ROLZ", encode_rolz_runs, decode_rolz_runs);
+
+    test_compression("files/package-lock.json", "VLC LZSS", encode_lzss_vlc, decode_lzss_vlc);
+    test_compression("files/package-lock.json", "VLC+Runs ROLZ", encode_rolz_vlc, decode_rolz_vlc);
+    test_compression("main.c", "VLC LZSS", encode_lzss_vlc, decode_lzss_vlc);
+    test_compression("main.c", "VLC+Runs ROLZ", encode_rolz_vlc, decode_rolz_vlc);
+
+    test_compression("files/package-lock.json", "Rep+VLC LZSS", encode_lzss_rep, decode_lzss_rep);
+    test_compression("files/package-lock.json", "Rep+Runs LZSS", encode_lzss_rep_runs, decode_lzss_rep_runs);
+    test_compression("main.c", "Rep+VLC LZSS", encode_lzss_rep, decode_lzss_rep);
+    test_compression("main.c", "Rep+Runs LZSS", encode_lzss_rep_runs, decode_lzss_rep_runs);
+
+    test_compression("files/node_modules.tar", "Explicit ROLZ", encode_rolz_explicit, decode_rolz_explicit);
+    test_compression("files/package-lock.json", "Explicit ROLZ", encode_rolz_explicit, decode_rolz_explicit);
+    test_compression("files/node_modules.tar", "Long LZSS", encode_lzss_long, decode_lzss_long);
+    test_compression("files/package-lock.json", "Long LZSS", encode_lzss_long, decode_lzss_long);
+    test_compression("files/node_modules.tar", "Long ROLZ", encode_rolz_long, decode_rolz_long);
+    test_compression("files/package-lock.json", "Long ROLZ", encode_rolz_long, decode_rolz_long);
+
+    test_compression("files/package-lock.json", "LDM+ROLZ", encode_ldm_rolz, decode_ldm_rolz);
+    test_compression("files/node_modules.tar", "LDM+ROLZ", encode_ldm_rolz, decode_ldm_rolz);
+
+    test_compression("files/package-lock.json", "DEDUP+ROLZ", encode_dedup_rolz, decode_dedup_rolz);
+    test_compression("files/node_modules.tar", "DEDUP+ROLZ", encode_dedup_rolz, decode_dedup_rolz);
+
+    test_compression("files/KingsBounty.md", "Frame LZSS", encode_frame_lzss, decode_frame);
+    test_compression("files/package-lock.json", "Frame Text+LZSS", encode_frame_text_lzss, decode_frame);
+    test_compression("files/package-lock.json", "Frame LZB", encode_frame_lzb, decode_frame);
+    test_compression("files/KingsBounty.md", "Two Frames", encode_two_frames, decode_frame);
+    test_compression("files/package-lock.json", "Frame Text+ROLZ", encode_frame_text_rolz, decode_frame);
+    test_compression("files/node_modules.tar", "Frame Delta+ROLZ", encode_frame_delta_rolz, decode_frame);
+
+    test_in_place("files/KingsBounty.md", "LZSS", encode_lzss_margin, decode_lzss_in_place, lzss_get_in_place_margin_bound);
+    test_in_place("files/package-lock.json", "ROLZ", encode_rolz_margin, decode_rolz_in_place, rolz_get_in_place_margin_bound);
+    test_in_place("main.c", "LZSS", encode_lzss_margin, decode_lzss_in_place, lzss_get_in_place_margin_bound);
+    test_in_place("main.c", "ROLZ", encode_rolz_margin, decode_rolz_in_place, rolz_get_in_place_margin_bound);
+    test_in_place_margin();
+
+    test_batch("files/package-lock.json", "LZSS", CODEC_LZSS, 1);
+    test_batch("files/package-lock.json", "ROLZ", CODEC_ROLZ, 1);
+    test_batch("files/package-lock.json", "ROLZ", CODEC_ROLZ, 4);
+    test_batch("files/package-lock.json", "LZB", CODEC_LZB, 4);
+
+    test_sequences("files/KingsBounty.md");
+    test_sequences("files/package-lock.json");
+
+    test_match_threads("files/KingsBounty.md", 1);
+    test_match_threads("files/package-lock.json", 3);
+
+    test_fragments("files/KingsBounty.md");
+    test_fragments("files/package-lock.json");
+
+    test_checkpoints("files/KingsBounty.md", "LZSS", CODEC_LZSS, 16, 1);
+    test_checkpoints("files/package-lock.json", "ROLZ", CODEC_ROLZ, 15, 4);
+
+    test_message_stream("files/KingsBounty.md", "LZSS", CODEC_LZSS, 0);
+    test_message_stream("files/package-lock.json", "Rep+Runs LZSS", CODEC_LZSS, LZSS_FLAG_LITERAL_RUNS | LZSS_FLAG_REP_OFFSETS);
+    test_message_stream("files/KingsBounty.md", "ROLZ", CODEC_ROLZ, 0);
+    test_message_stream("files/package-lock.json", "VLC+Runs ROLZ", CODEC_ROLZ, ROLZ_FLAG_LITERAL_RUNS | ROLZ_FLAG_VARIABLE_CODES);
+    test_message_stream("files/package-lock.json", "Explicit ROLZ", CODEC_ROLZ, ROLZ_FLAG_EXPLICIT_OFFSETS);
+    test_message_stream("files/package-lock.json", "Long ROLZ", CODEC_ROLZ, ROLZ_FLAG_LONG_MATCHES | ROLZ_FLAG_EXPLICIT_OFFSETS);
+
+    test_pipeline("files/package-lock.json", "LZSS", MODE_LZSS, FILTER_NONE);
+    test_pipeline("files/package-lock.json", "ROLZ+Text", MODE_ROLZ, FILTER_TEXT);
+    test_pipeline("files/package-lock.json", "LZB", MODE_LZB, FILTER_NONE);
+
+    test_filters();
+    test_long_range();
+#ifndef _WIN32
+    test_list_files();
+#endif
+    test_long_runs();
+    test_empty_frame();
+    test_frame_pre_passes();
+    test_corrupt_input();
+
     return EXIT_SUCCESS;
 }